@@ -54,6 +54,55 @@ bool fmt2jpg_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, p
  */
 bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg);
 
+/**
+ * @brief JPEG encoder fed a few lines at a time
+ *
+ * Only one row of 8 or 16 lines is held by the encoder, so lines can be
+ * passed on as the camera delivers them instead of from a whole frame.
+ * YUYV and GRAYSCALE lines are encoded as they are; RGB565 and RGB888
+ * lines go through a line of RGB first.
+ */
+typedef struct jpg_encoder_session_t jpg_encoder_session_t;
+
+/**
+ * @brief Start encoding an image
+ *
+ * The JPEG headers are written to the callback before this returns.
+ *
+ * @param width     Width in pixels of the source image, even for YUYV
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image: RGB565, RGB888, YUYV or GRAYSCALE
+ * @param quality   JPEG quality of the resulting image
+ * @param cb        Callback to be called to write the bytes of the output JPEG
+ * @param arg       Pointer to be passed to the callback
+ *
+ * @return the session, or NULL for an unsupported format or out of memory
+ */
+jpg_encoder_session_t *jpg_encoder_start(uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpg_out_cb cb, void * arg);
+
+/**
+ * @brief Encode the next lines of the image
+ *
+ * @param session   Session from jpg_encoder_start()
+ * @param src       Lines in the format of the session, width pixels each, packed
+ * @param lines     Number of lines at src; any number, not past the height of the image
+ *
+ * @return true on success
+ */
+bool jpg_encoder_write(jpg_encoder_session_t *session, const uint8_t *src, size_t lines);
+
+/**
+ * @brief Finish the image and free the session
+ *
+ * May be called before all lines are written to abandon the image; nothing
+ * more is written then.
+ *
+ * @param session   Session from jpg_encoder_start()
+ *
+ * @return true if every line was written and the image was finished
+ */
+bool jpg_encoder_end(jpg_encoder_session_t *session);
+
 /**
  * @brief Convert image buffer to JPEG buffer
  *
@@ -0,0 +1,168 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _JPG_DECODER_H_
+#define _JPG_DECODER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_jpg_decode.h"
+
+/**
+ * @brief JPEG decoder backends
+ */
+typedef enum {
+    JPG_DECODER_JPEGDEC,    /*!< JPEGDEC (components/jpegdec) */
+    JPG_DECODER_TJPGD,      /*!< TJpgDec through esp_jpg_decode() */
+    JPG_DECODER_MAX,
+} jpg_decoder_t;
+
+/**
+ * @brief Output pixel formats
+ */
+typedef enum {
+    JPG_OUTPUT_LUMA,        /*!< 8-bit luma, 1 byte per pixel */
+    JPG_OUTPUT_RGB565,      /*!< RGB565, 2 bytes per pixel, little endian */
+    JPG_OUTPUT_RGB888,      /*!< 3 bytes per pixel in B, G, R order, like fmt2rgb888() */
+    JPG_OUTPUT_MAX,
+} jpg_output_t;
+
+/**
+ * @brief Where and how to decode an image
+ *
+ * The output is (width >> scale) x (height >> scale) pixels.
+ */
+typedef struct {
+    jpg_output_t type;
+    jpg_scale_t scale;
+    uint8_t *buf;
+    size_t stride;              /*!< Bytes from one row to the next, 0 for packed rows */
+    size_t buf_size;            /*!< Bytes available at buf */
+    const uint8_t *row_mask;    /*!< Optional, luma only: one byte per output row, rows with 0 are not written */
+} jpg_decode_output_t;
+
+/**
+ * @brief Time per decode of each backend, as measured by jpg_decoder_calibrate()
+ *
+ * 0 where the backend does not support the output, or it did not fit the buffer.
+ */
+typedef struct {
+    uint32_t us[JPG_OUTPUT_MAX][JPG_SCALE_MAX + 1][JPG_DECODER_MAX];
+} jpg_decoder_timings_t;
+
+/**
+ * @brief Get the size of a JPEG image from its frame header
+ *
+ * @param src       JPEG data
+ * @param len       Length in bytes of the JPEG data
+ * @param width     Image width in pixels
+ * @param height    Image height in pixels
+ *
+ * @return true if a frame header was found before the first scan
+ */
+bool jpg_get_size(const uint8_t *src, size_t len, uint16_t *width, uint16_t *height);
+
+/**
+ * @brief Check if a backend can produce an output
+ *
+ * JPEGDEC has no RGB888 output; TJpgDec produces everything. JPEGDEC's
+ * 1/4 scale only uses the lowest 2x2 DCT coefficients of each block, which
+ * is fast but less accurate than TJpgDec's.
+ */
+bool jpg_decoder_supports(jpg_decoder_t decoder, jpg_output_t type, jpg_scale_t scale);
+
+/**
+ * @brief Decode a JPEG image with the given backend
+ *
+ * @param decoder   Backend to use
+ * @param src       JPEG data
+ * @param len       Length in bytes of the JPEG data
+ * @param out       Output description
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if the data is not a JPEG image
+ *      - ESP_ERR_INVALID_SIZE if the output does not fit the buffer
+ *      - ESP_ERR_NOT_SUPPORTED if the backend cannot produce the output
+ *      - ESP_ERR_NO_MEM if the decoder cannot be allocated
+ *      - ESP_FAIL if decoding fails
+ */
+esp_err_t jpg_decoder_decode(jpg_decoder_t decoder, const uint8_t *src, size_t len, const jpg_decode_output_t *out);
+
+/**
+ * @brief Decode a JPEG image with the backend selected for the output type and scale
+ *
+ * Until another backend is selected, RGB565 and RGB888 are decoded by
+ * TJpgDec, as jpg2rgb565(), fmt2rgb888() and fmt2bmp() always have been,
+ * and luma by JPEGDEC.
+ *
+ * Returns the same errors as jpg_decoder_decode().
+ */
+esp_err_t jpg_decode(const uint8_t *src, size_t len, const jpg_decode_output_t *out);
+
+/**
+ * @brief Set the number of threads JPEGDEC decodes with, 1 by default
+ *
+ * Images with restart markers at the start of MCU rows are cut into that
+ * many horizontal bands, decoded at the same time; on the ESP32 the second
+ * band runs on the other core. Other images, and TJpgDec, use one thread,
+ * as does everything unless CONFIG_JPEG_DECODE_BANDS is enabled.
+ * Each thread has its own decoder, about 20 KB, allocated by its first
+ * decode and kept for the next ones; lowering the count frees the extra
+ * ones. JPEGDEC decodes one image at a time, other callers wait.
+ *
+ * @param threads   1 to 8
+ */
+void jpg_decoder_set_threads(int threads);
+
+/**
+ * @brief Select the backend used by jpg_decode() for an output type and scale
+ *
+ * @return ESP_ERR_NOT_SUPPORTED if the backend cannot produce the output
+ */
+esp_err_t jpg_decoder_select(jpg_output_t type, jpg_scale_t scale, jpg_decoder_t decoder);
+
+/**
+ * @brief Get the backend used by jpg_decode() for an output type and scale
+ */
+jpg_decoder_t jpg_decoder_get_selected(jpg_output_t type, jpg_scale_t scale);
+
+/**
+ * @brief Time every backend on a sample image and select the fastest for each output type and scale
+ *
+ * Each combination is decoded into work, so only those whose output fits
+ * work_size are measured; the others keep their selection.
+ *
+ * @param src        Sample JPEG data, e.g. a camera frame
+ * @param len        Length in bytes of the JPEG data
+ * @param work       Output buffer for the measurements
+ * @param work_size  Bytes available at work
+ * @param iterations Decodes per combination; the fastest one counts
+ * @param timings    Optional, filled with the time per decode of each combination
+ *
+ * @return ESP_ERR_INVALID_ARG if the sample cannot be decoded
+ */
+esp_err_t jpg_decoder_calibrate(const uint8_t *src, size_t len, uint8_t *work, size_t work_size,
+                                int iterations, jpg_decoder_timings_t *timings);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _JPG_DECODER_H_ */
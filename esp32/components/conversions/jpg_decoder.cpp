@@ -0,0 +1,385 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <mutex>
+#include <new>
+#include <string.h>
+#include "jpg_decoder.h"
+#include "JPEGDEC.h"
+#include "JPEGBANDS.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
+#include "esp32-hal-log.h"
+#define TAG ""
+#else
+#include "esp_log.h"
+static const char* TAG = "jpg_decoder";
+#endif
+
+static const uint8_t BYTES_PER_PIXEL[JPG_OUTPUT_MAX] = { 1, 2, 3 };
+
+// Color stays on TJpgDec, which jpg2rgb565(), fmt2rgb888() and fmt2bmp() have
+// always used, until jpg_decoder_select() or jpg_decoder_calibrate() picks
+// JPEGDEC. Luma is only used by motion, which has decoded it with JPEGDEC.
+static jpg_decoder_t s_selected[JPG_OUTPUT_MAX][JPG_SCALE_MAX + 1] = {
+    { JPG_DECODER_JPEGDEC, JPG_DECODER_JPEGDEC, JPG_DECODER_JPEGDEC, JPG_DECODER_JPEGDEC },
+    { JPG_DECODER_TJPGD, JPG_DECODER_TJPGD, JPG_DECODER_TJPGD, JPG_DECODER_TJPGD },
+    { JPG_DECODER_TJPGD, JPG_DECODER_TJPGD, JPG_DECODER_TJPGD, JPG_DECODER_TJPGD },
+};
+
+// Threads for JPEGDEC, on images with restart markers
+#if CONFIG_JPEG_DECODE_BANDS
+#define JPG_DECODER_MAX_THREADS JPEG_MAX_BANDS
+#else
+#define JPG_DECODER_MAX_THREADS 1
+#endif
+static int s_threads = 1;
+
+// One JPEGDEC instance per thread, allocated on first use and kept: the
+// decoder state is about 20 KB. The mutex lets one image use them at a time.
+static JPEGDEC *s_jpegdec[JPG_DECODER_MAX_THREADS];
+static std::mutex s_jpegdec_mutex;
+
+typedef struct {
+    const jpg_decode_output_t *out;
+    size_t stride;
+    uint16_t width;             // output size
+    uint16_t height;
+    const uint8_t *input;       // TJpgDec only
+} jpg_target_t;
+
+bool jpg_get_size(const uint8_t *src, size_t len, uint16_t *width, uint16_t *height)
+{
+    if (len < 4 || src[0] != 0xFF || src[1] != 0xD8) {
+        return false;
+    }
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        if (src[pos] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = src[pos + 1];
+        if (marker == 0xFF) {
+            // fill byte
+            pos++;
+            continue;
+        }
+        size_t segment = (src[pos + 2] << 8) | src[pos + 3];
+        // any SOF except DHT (C4), JPG (C8) and DAC (CC)
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (segment < 7 || pos + 9 > len) {
+                return false;
+            }
+            *height = (src[pos + 5] << 8) | src[pos + 6];
+            *width = (src[pos + 7] << 8) | src[pos + 8];
+            return true;
+        }
+        if (marker == 0xDA || marker == 0xD9) {
+            // start of scan or end of image, no SOF
+            return false;
+        }
+        pos += 2 + segment;
+    }
+    return false;
+}
+
+bool jpg_decoder_supports(jpg_decoder_t decoder, jpg_output_t type, jpg_scale_t scale)
+{
+    if (decoder >= JPG_DECODER_MAX || type >= JPG_OUTPUT_MAX || scale > JPG_SCALE_MAX) {
+        return false;
+    }
+    return decoder == JPG_DECODER_TJPGD || type != JPG_OUTPUT_RGB888;
+}
+
+static inline bool row_wanted(const jpg_target_t *t, int y)
+{
+    return !t->out->row_mask || t->out->row_mask[y];
+}
+
+//JPEGDEC
+
+static int _jpegdec_draw(JPEGDRAW *draw)
+{
+    const jpg_target_t *t = (const jpg_target_t *)draw->pUser;
+    if (draw->x >= t->width) {
+        return 1;
+    }
+    size_t bpp = BYTES_PER_PIXEL[t->out->type];
+    int w = draw->x + draw->iWidth > t->width ? t->width - draw->x : draw->iWidth;
+    const uint8_t *src = (const uint8_t *)draw->pPixels;
+    for (int y = 0; y < draw->iHeight && draw->y + y < t->height; y++) {
+        if (row_wanted(t, draw->y + y)) {
+            memcpy(t->out->buf + (draw->y + y) * t->stride + draw->x * bpp, src + y * draw->iWidth * bpp, w * bpp);
+        }
+    }
+    return 1;
+}
+
+// The decoder of a worker, with s_jpegdec_mutex held
+static JPEGDEC *_jpegdec_get(int worker)
+{
+    if (!s_jpegdec[worker]) {
+        // Too large for the stack of most callers, and decoding is slower
+        // from PSRAM
+        void *mem = heap_caps_malloc(sizeof(JPEGDEC), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!mem) {
+            mem = heap_caps_malloc(sizeof(JPEGDEC), MALLOC_CAP_8BIT);
+        }
+        if (!mem) {
+            ESP_LOGE(TAG, "JPEGDEC malloc failed");
+            return NULL;
+        }
+        s_jpegdec[worker] = new (mem) JPEGDEC;
+    }
+    return s_jpegdec[worker];
+}
+
+// Decodes the whole image, or one band of it
+static esp_err_t _jpegdec_decode_band(const uint8_t *src, size_t len, const jpg_target_t *t, const JPEGBAND *band,
+                                      int worker)
+{
+    JPEGDEC *decoder = _jpegdec_get(worker);
+    if (!decoder) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t ret = ESP_FAIL;
+#if CONFIG_JPEG_DECODE_BANDS
+    const int opened = band ? JPEG_openBand(decoder, band, _jpegdec_draw)
+                            : decoder->openRAM((uint8_t *)src, len, _jpegdec_draw);
+#else
+    const int opened = decoder->openRAM((uint8_t *)src, len, _jpegdec_draw);
+#endif
+    if (opened) {
+        decoder->setUserPointer((void *)t);
+        const jpg_decode_output_t *out = t->out;
+        const int band_y = band ? band->iY : 0;
+        int ok;
+        if (out->type == JPG_OUTPUT_LUMA && out->scale == JPG_SCALE_8X) {
+            // the DC terms are the 1/8 scale image, without any IDCT
+            ok = decoder->decodeLumaDC(out->buf + (band_y >> 3) * t->stride, t->stride,
+                                       out->row_mask ? out->row_mask + (band_y >> 3) : NULL);
+        } else {
+            static const int scales[JPG_SCALE_MAX + 1] = { 0, JPEG_SCALE_HALF, JPEG_SCALE_QUARTER, JPEG_SCALE_EIGHTH };
+            int options = scales[out->scale];
+            if (out->type == JPG_OUTPUT_LUMA) {
+                decoder->setPixelType(EIGHT_BIT_GRAYSCALE);
+                options |= JPEG_LUMA_ONLY;
+            } else {
+                decoder->setPixelType(RGB565_LITTLE_ENDIAN);
+            }
+            ok = decoder->decode(0, band_y >> out->scale, options);
+        }
+        ret = ok ? ESP_OK : ESP_FAIL;
+        if (!ok) {
+            ESP_LOGE(TAG, "JPEGDEC decode failed: %d", decoder->getLastError());
+        }
+        decoder->close();
+    }
+    return ret;
+}
+
+#if CONFIG_JPEG_DECODE_BANDS
+static int _jpegdec_band(const JPEGBAND *band, int worker, void *arg)
+{
+    return _jpegdec_decode_band(NULL, 0, (const jpg_target_t *)arg, band, worker) == ESP_OK;
+}
+#endif
+
+static esp_err_t _jpegdec_decode(const uint8_t *src, size_t len, jpg_target_t *t)
+{
+    std::lock_guard<std::mutex> lock(s_jpegdec_mutex);
+#if CONFIG_JPEG_DECODE_BANDS
+    if (s_threads > 1) {
+        JPEGBANDS bands;
+        if (JPEG_findBands((uint8_t *)src, len, s_threads, &bands) > 1) {
+            return JPEG_decodeBands(&bands, s_threads, _jpegdec_band, t) ? ESP_OK : ESP_FAIL;
+        }
+    }
+#endif
+    return _jpegdec_decode_band(src, len, t, NULL, 0);
+}
+
+//TJpgDec
+
+static size_t _tjpgd_read(void *arg, size_t index, uint8_t *buf, size_t len)
+{
+    const jpg_target_t *t = (const jpg_target_t *)arg;
+    if (buf) {
+        memcpy(buf, t->input + index, len);
+    }
+    return len;
+}
+
+// data is a w x h block of R, G, B pixels
+static bool _tjpgd_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    const jpg_target_t *t = (const jpg_target_t *)arg;
+    if (!data || x >= t->width) {
+        return true;
+    }
+    size_t in_w = w;
+    if (x + w > t->width) {
+        w = t->width - x;
+    }
+    jpg_output_t type = t->out->type;
+    for (int iy = 0; iy < h && y + iy < t->height; iy++) {
+        const uint8_t *s = data + iy * in_w * 3;
+        if (!row_wanted(t, y + iy)) {
+            continue;
+        }
+        uint8_t *o = t->out->buf + (y + iy) * t->stride + x * BYTES_PER_PIXEL[type];
+        if (type == JPG_OUTPUT_RGB888) {
+            for (int ix = 0; ix < w; ix++, s += 3) {
+                *o++ = s[2];
+                *o++ = s[1];
+                *o++ = s[0];
+            }
+        } else if (type == JPG_OUTPUT_RGB565) {
+            for (int ix = 0; ix < w; ix++, s += 3) {
+                uint16_t c = ((s[0] & 0xF8) << 8) | ((s[1] & 0xFC) << 3) | (s[2] >> 3);
+                *o++ = c & 0xFF;
+                *o++ = c >> 8;
+            }
+        } else {
+            for (int ix = 0; ix < w; ix++, s += 3) {
+                *o++ = (77 * s[0] + 150 * s[1] + 29 * s[2] + 128) >> 8;
+            }
+        }
+    }
+    return true;
+}
+
+static esp_err_t _tjpgd_decode(const uint8_t *src, size_t len, jpg_target_t *t)
+{
+    t->input = src;
+    return esp_jpg_decode(len, t->out->scale, _tjpgd_read, _tjpgd_write, t);
+}
+
+esp_err_t jpg_decoder_decode(jpg_decoder_t decoder, const uint8_t *src, size_t len, const jpg_decode_output_t *out)
+{
+    if (!out || !out->buf || !jpg_decoder_supports(decoder, out->type, out->scale)) {
+        return out && out->buf ? ESP_ERR_NOT_SUPPORTED : ESP_ERR_INVALID_ARG;
+    }
+    uint16_t width = 0;
+    uint16_t height = 0;
+    if (!jpg_get_size(src, len, &width, &height)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    jpg_target_t t;
+    t.out = out;
+    t.width = width >> out->scale;
+    t.height = height >> out->scale;
+    t.stride = out->stride ? out->stride : t.width * BYTES_PER_PIXEL[out->type];
+    t.input = NULL;
+    if (!t.width || !t.height || t.stride < t.width * BYTES_PER_PIXEL[out->type] ||
+        (t.height - 1) * t.stride + t.width * BYTES_PER_PIXEL[out->type] > out->buf_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (decoder == JPG_DECODER_JPEGDEC) {
+        return _jpegdec_decode(src, len, &t);
+    }
+    return _tjpgd_decode(src, len, &t);
+}
+
+esp_err_t jpg_decode(const uint8_t *src, size_t len, const jpg_decode_output_t *out)
+{
+    if (!out || out->type >= JPG_OUTPUT_MAX || out->scale > JPG_SCALE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return jpg_decoder_decode(s_selected[out->type][out->scale], src, len, out);
+}
+
+void jpg_decoder_set_threads(int threads)
+{
+    std::lock_guard<std::mutex> lock(s_jpegdec_mutex);
+    s_threads = threads < 1 ? 1 : threads > JPG_DECODER_MAX_THREADS ? JPG_DECODER_MAX_THREADS : threads;
+    // Free the decoders of threads no longer used
+    for (int i = s_threads; i < JPG_DECODER_MAX_THREADS; i++) {
+        if (s_jpegdec[i]) {
+            s_jpegdec[i]->~JPEGDEC();
+            heap_caps_free(s_jpegdec[i]);
+            s_jpegdec[i] = NULL;
+        }
+    }
+}
+
+esp_err_t jpg_decoder_select(jpg_output_t type, jpg_scale_t scale, jpg_decoder_t decoder)
+{
+    if (!jpg_decoder_supports(decoder, type, scale)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    s_selected[type][scale] = decoder;
+    return ESP_OK;
+}
+
+jpg_decoder_t jpg_decoder_get_selected(jpg_output_t type, jpg_scale_t scale)
+{
+    return s_selected[type][scale];
+}
+
+esp_err_t jpg_decoder_calibrate(const uint8_t *src, size_t len, uint8_t *work, size_t work_size,
+                                int iterations, jpg_decoder_timings_t *timings)
+{
+    uint16_t width = 0;
+    uint16_t height = 0;
+    if (!jpg_get_size(src, len, &width, &height)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timings) {
+        memset(timings, 0, sizeof(*timings));
+    }
+    for (int type = 0; type < JPG_OUTPUT_MAX; type++) {
+        for (int scale = 0; scale <= JPG_SCALE_MAX; scale++) {
+            jpg_decode_output_t out = {};
+            out.type = (jpg_output_t)type;
+            out.scale = (jpg_scale_t)scale;
+            out.buf = work;
+            out.buf_size = work_size;
+            uint32_t best_us = UINT32_MAX;
+            jpg_decoder_t best = s_selected[type][scale];
+            for (int decoder = 0; decoder < JPG_DECODER_MAX; decoder++) {
+                if (!jpg_decoder_supports((jpg_decoder_t)decoder, out.type, out.scale)) {
+                    continue;
+                }
+                uint32_t min_us = UINT32_MAX;
+                for (int i = 0; i < iterations; i++) {
+                    int64_t start = esp_timer_get_time();
+                    if (jpg_decoder_decode((jpg_decoder_t)decoder, src, len, &out) != ESP_OK) {
+                        min_us = UINT32_MAX;
+                        break;
+                    }
+                    uint32_t us = esp_timer_get_time() - start;
+                    if (us < min_us) {
+                        min_us = us;
+                    }
+                }
+                if (min_us == UINT32_MAX) {
+                    continue;
+                }
+                if (timings) {
+                    timings->us[type][scale][decoder] = min_us ? min_us : 1;
+                }
+                if (min_us < best_us) {
+                    best_us = min_us;
+                    best = (jpg_decoder_t)decoder;
+                }
+            }
+            s_selected[type][scale] = best;
+            ESP_LOGD(TAG, "output %d scale %d: decoder %d, %u us", type, scale, best, (unsigned)best_us);
+        }
+    }
+    return ESP_OK;
+}
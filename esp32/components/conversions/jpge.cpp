@@ -39,7 +39,7 @@ namespace jpge {
     static inline void jpge_free(void *p) { free(p); }
 
     // Various JPEG enums and tables.
-    enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_APP0 = 0xE0 };
+    enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_DRI = 0xDD, M_APP0 = 0xE0, M_RST0 = 0xD0 };
     enum { DC_LUM_CODES = 12, AC_LUM_CODES = 256, DC_CHROMA_CODES = 12, AC_CHROMA_CODES = 256, MAX_HUFF_SYMBOLS = 257, MAX_HUFF_CODESIZE = 32 };
 
     static const uint8 s_zag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
@@ -111,6 +111,32 @@ namespace jpge {
         }
     }
 
+    // YUV422 from the camera is Y0, U, Y1, V with video levels (Y 16-235, U and V
+    // 16-240); JFIF uses the full range. Y_SCALE = 255/219, C_SCALE = 255/224 in 16.16.
+    const int Y_SCALE = 76309, C_SCALE = 74606;
+
+    static inline uint8 expand_y(int y) {
+        return clamp(((y - 16) * Y_SCALE + 32768) >> 16);
+    }
+
+    static inline uint8 expand_c(int c) {
+        return clamp(128 + (((c - 128) * C_SCALE + 32768) >> 16));
+    }
+
+    static void YUYV_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst += 6, pSrc += 4, num_pixels -= 2) {
+            const uint8 cb = expand_c(pSrc[1]), cr = expand_c(pSrc[3]);
+            pDst[0] = expand_y(pSrc[0]); pDst[1] = cb; pDst[2] = cr;
+            pDst[3] = expand_y(pSrc[2]); pDst[4] = cb; pDst[5] = cr;
+        }
+    }
+
+    static void YUYV_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst++, pSrc += 2, num_pixels--) {
+            pDst[0] = expand_y(pSrc[0]);
+        }
+    }
+
     // Forward DCT - DCT derived from jfdctint.
     enum { CONST_BITS = 13, ROW_BITS = 2 };
 #define DCT_DESCALE(x, n) (((x) + (((int32)1) << ((n) - 1))) >> (n))
@@ -321,6 +347,24 @@ namespace jpge {
         emit_byte(0);
     }
 
+    void jpeg_encoder::emit_dri()
+    {
+        emit_marker(M_DRI);
+        emit_word(4);
+        emit_word(m_params.m_restart_mcu_rows * m_mcus_per_row);
+    }
+
+    // Pad to a byte with 1 bits, then start a new interval: the DC
+    // predictions restart from 0
+    void jpeg_encoder::emit_restart()
+    {
+        put_bits(0x7F, 7);
+        m_bit_buffer = 0;
+        m_bits_in = 0;
+        emit_marker(M_RST0 + ((m_mcu_rows_done / m_params.m_restart_mcu_rows - 1) & 7));
+        memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+    }
+
     void jpeg_encoder::load_block_8_8_grey(int x)
     {
         uint8 *pSrc;
@@ -521,11 +565,15 @@ namespace jpge {
         if (m_num_components == 1) {
             if (m_image_bpp == 3)
                 RGB_to_Y(pDst, Psrc, m_image_x);
+            else if (m_image_bpp == 2)
+                YUYV_to_Y(pDst, Psrc, m_image_x);
             else
                 memcpy(pDst, Psrc, m_image_x);
         } else {
             if (m_image_bpp == 3)
                 RGB_to_YCC(pDst, Psrc, m_image_x);
+            else if (m_image_bpp == 2)
+                YUYV_to_YCC(pDst, Psrc, m_image_x);
             else
                 Y_to_YCC(pDst, Psrc, m_image_x);
         }
@@ -547,6 +595,11 @@ namespace jpge {
         {
             process_mcu_row();
             m_mcu_y_ofs = 0;
+            // No marker after the last row
+            if (m_params.m_restart_mcu_rows && ++m_mcu_rows_done % m_params.m_restart_mcu_rows == 0 &&
+                m_mcu_rows_done * m_mcu_y < m_image_y) {
+                emit_restart();
+            }
         }
     }
 
@@ -611,6 +664,9 @@ namespace jpge {
         m_image_bpl_xlt  = m_image_x * m_num_components;
         m_image_bpl_mcu  = m_image_x_mcu * m_num_components;
         m_mcus_per_row   = m_image_x_mcu / m_mcu_x;
+        if (m_params.m_restart_mcu_rows * m_mcus_per_row > 0xFFFF) { // DRI holds 16 bits
+            return false;
+        }
 
         if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(m_image_bpl_mcu * m_mcu_y))) == NULL) {
             return false;
@@ -643,6 +699,7 @@ namespace jpge {
         m_bit_buffer = 0;
         m_bits_in = 0;
         m_mcu_y_ofs = 0;
+        m_mcu_rows_done = 0;
         m_pass_num = 2;
         memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
 
@@ -652,6 +709,9 @@ namespace jpge {
         emit_dqt();
         emit_sof();
         emit_dhts();
+        if (m_params.m_restart_mcu_rows) {
+            emit_dri();
+        }
         emit_sos();
 
         return m_all_stream_writes_succeeded;
@@ -696,7 +756,8 @@ namespace jpge {
     bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
     {
         deinit();
-        if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check())) return false;
+        if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 2) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check())) return false;
+        if ((src_channels == 2) && (width & 1)) return false; // whole YUYV pixel pairs
         m_pStream = pStream;
         m_params = comp_params;
         return jpg_open(width, height, src_channels);
@@ -18,7 +18,7 @@ namespace jpge
 
     // JPEG compression parameters structure.
     struct params {
-            inline params() : m_quality(85), m_subsampling(H2V2) { }
+            inline params() : m_quality(85), m_subsampling(H2V2), m_restart_mcu_rows(0) { }
 
             inline bool check() const {
                 if ((m_quality < 1) || (m_quality > 100)) {
@@ -27,6 +27,9 @@ namespace jpge
                 if ((uint)m_subsampling > (uint)H2V2) {
                     return false;
                 }
+                if (m_restart_mcu_rows < 0) {
+                    return false;
+                }
                 return true;
             }
 
@@ -39,6 +42,10 @@ namespace jpge
             // 2 = H2V1 subsampling (YCbCr 2x1x1, 4 blocks per MCU)
             // 3 = H2V2 subsampling (YCbCr 4x1x1, 6 blocks per MCU-- very common)
             subsampling_t m_subsampling;
+
+            // Rows of MCUs between restart markers, 0 for none. The image can then
+            // be decoded in horizontal bands that start at a marker.
+            int m_restart_mcu_rows;
     };
     
     // Output stream abstract class - used by the jpeg_encoder class to write to the output stream.
@@ -60,12 +67,14 @@ namespace jpge
             // pStream: The stream object to use for writing compressed data.
             // params - Compression parameters structure, defined above.
             // width, height  - Image dimensions.
-            // channels - May be 1, or 3. 1 indicates grayscale, 3 indicates RGB source data.
+            // channels - May be 1, 2 or 3. 1 indicates grayscale, 2 YUV422 (Y0, U, Y1, V with video levels,
+            //            as cameras send it; width must be even), 3 indicates RGB source data.
             // Returns false on out of memory or if a stream write fails.
             bool init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params = params());
 
             // Call this method with each source scanline.
-            // width * src_channels bytes per scanline is expected (RGB or Y format).
+            // width * src_channels bytes per scanline is expected (RGB, YUYV or Y format).
+            // Only one MCU row (8 or 16 lines) is buffered, so scanlines can be passed on as they are captured.
             // You must call with NULL after all scanlines are processed to finish compression.
             // Returns false on out of memory or if a stream write fails.
             bool process_scanline(const void* pScanline);
@@ -88,6 +97,7 @@ namespace jpge
             int m_image_x_mcu, m_image_y_mcu;
             int m_image_bpl_xlt, m_image_bpl_mcu;
             int m_mcus_per_row;
+            int m_mcu_rows_done;
             int m_mcu_x, m_mcu_y;
             uint8 *m_mcu_lines[16];
             uint8 m_mcu_y_ofs;
@@ -118,6 +128,8 @@ namespace jpge
             void emit_dht(uint8 *bits, uint8 *val, int index, bool ac_flag);
             void emit_dhts();
             void emit_sos();
+            void emit_dri();
+            void emit_restart();
 
             void compute_quant_table(int32 *dst, const int16 *src);
             void load_quantized_coefficients(int component_num);
@@ -18,10 +18,25 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
+/**
+ * @brief Convert one pixel with the lookup table; the reference for the line converters
+ */
 void yuv2rgb(uint8_t y, uint8_t u, uint8_t v, uint8_t *r, uint8_t *g, uint8_t *b);
 
+/**
+ * @brief Convert a line of YUV422 (Y0, U, Y1, V) pixels
+ *
+ * The results are the same as yuv2rgb() per pixel, computed in fixed point
+ * once per pixel pair for the chroma terms. width must be even.
+ */
+void yuv422_to_rgb888(const uint8_t *src, uint8_t *dst, size_t width);    // R, G, B
+void yuv422_to_bgr888(const uint8_t *src, uint8_t *dst, size_t width);    // B, G, R, like fmt2rgb888()
+void yuv422_to_rgb565(const uint8_t *src, uint8_t *dst, size_t width);    // big endian, like the camera
+void yuv422_to_gray(const uint8_t *src, uint8_t *dst, size_t width);      // the Y samples
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,13 +13,13 @@
 // limitations under the License.
 #include <stddef.h>
 #include <string.h>
+#include <new>
 #include "esp_attr.h"
 #include "soc/efuse_reg.h"
 #include "esp_heap_caps.h"
 #include "esp_camera.h"
 #include "img_converters.h"
 #include "jpge.h"
-#include "yuv.h"
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
@@ -43,14 +43,11 @@ static void *_malloc(size_t size)
     return NULL;
 }
 
-static IRAM_ATTR void convert_line_format(uint8_t * src, pixformat_t format, uint8_t * dst, size_t width, size_t in_channels, size_t line)
+static IRAM_ATTR void convert_line_format(const uint8_t * src, pixformat_t format, uint8_t * dst, size_t width)
 {
     int i=0, o=0, l=0;
-    if(format == PIXFORMAT_GRAYSCALE) {
-        memcpy(dst, src + line * width, width);
-    } else if(format == PIXFORMAT_RGB888) {
+    if(format == PIXFORMAT_RGB888) {
         l = width * 3;
-        src += l * line;
         for(i=0; i<l; i+=3) {
             dst[o++] = src[i+2];
             dst[o++] = src[i+1];
@@ -58,44 +55,74 @@ static IRAM_ATTR void convert_line_format(uint8_t * src, pixformat_t format, uin
         }
     } else if(format == PIXFORMAT_RGB565) {
         l = width * 2;
-        src += l * line;
         for(i=0; i<l; i+=2) {
             dst[o++] = src[i] & 0xF8;
             dst[o++] = (src[i] & 0x07) << 5 | (src[i+1] & 0xE0) >> 3;
             dst[o++] = (src[i+1] & 0x1F) << 3;
         }
-    } else if(format == PIXFORMAT_YUV422) {
-        uint8_t y0, y1, u, v;
-        uint8_t r, g, b;
-        l = width * 2;
-        src += l * line;
-        for(i=0; i<l; i+=4) {
-            y0 = src[i];
-            u = src[i+1];
-            y1 = src[i+2];
-            v = src[i+3];
-
-            yuv2rgb(y0, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
-
-            yuv2rgb(y1, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
-        }
     }
 }
 
-bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpge::output_stream *dst_stream)
+class callback_stream : public jpge::output_stream {
+protected:
+    jpg_out_cb ocb;
+    void * oarg;
+    size_t index;
+
+public:
+    callback_stream(jpg_out_cb cb, void * arg) : ocb(cb), oarg(arg), index(0) { }
+    virtual ~callback_stream() { }
+    virtual bool put_buf(const void* data, int len)
+    {
+        index += ocb(oarg, index, data, len);
+        return true;
+    }
+    virtual jpge::uint get_size() const
+    {
+        return index;
+    }
+};
+
+struct jpg_encoder_session_t {
+    callback_stream stream;
+    jpge::jpeg_encoder encoder;
+    pixformat_t format;
+    size_t line_len;            // source bytes per line
+    uint16_t width;
+    uint16_t height;
+    uint16_t lines;             // lines encoded so far
+    uint8_t *line;              // RGB line for jpge, NULL for the formats it takes as they are
+
+    jpg_encoder_session_t(jpg_out_cb cb, void * arg) : stream(cb, arg) { }
+};
+
+jpg_encoder_session_t *jpg_encoder_start(uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpg_out_cb cb, void * arg)
 {
     int num_channels = 3;
+    size_t bytes_per_pixel = 3;
+    bool convert = false;
     jpge::subsampling_t subsampling = jpge::H2V2;
 
-    if(format == PIXFORMAT_GRAYSCALE) {
+    switch(format) {
+    case PIXFORMAT_GRAYSCALE:
         num_channels = 1;
+        bytes_per_pixel = 1;
         subsampling = jpge::Y_ONLY;
+        break;
+    case PIXFORMAT_YUV422:
+        num_channels = 2;
+        bytes_per_pixel = 2;
+        break;
+    case PIXFORMAT_RGB565:
+        bytes_per_pixel = 2;
+        convert = true;
+        break;
+    case PIXFORMAT_RGB888:
+        convert = true;
+        break;
+    default:
+        ESP_LOGE(TAG, "Format %d not supported", format);
+        return NULL;
     }
 
     if(!quality) {
@@ -108,61 +135,85 @@ bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t fo
     comp_params.m_subsampling = subsampling;
     comp_params.m_quality = quality;
 
-    jpge::jpeg_encoder dst_image;
-
-    if (!dst_image.init(dst_stream, width, height, num_channels, comp_params)) {
+    void *mem = _malloc(sizeof(jpg_encoder_session_t));
+    if(!mem) {
+        ESP_LOGE(TAG, "JPG session malloc failed");
+        return NULL;
+    }
+    jpg_encoder_session_t *session = new (mem) jpg_encoder_session_t(cb, arg);
+    session->format = format;
+    session->line_len = width * bytes_per_pixel;
+    session->width = width;
+    session->height = height;
+    session->lines = 0;
+    session->line = NULL;
+
+    if (!session->encoder.init(&session->stream, width, height, num_channels, comp_params)) {
         ESP_LOGE(TAG, "JPG encoder init failed");
-        return false;
+        jpg_encoder_end(session);
+        return NULL;
+    }
+    if(convert) {
+        session->line = (uint8_t*)_malloc(width * 3);
+        if(!session->line) {
+            ESP_LOGE(TAG, "Scan line malloc failed");
+            jpg_encoder_end(session);
+            return NULL;
+        }
     }
+    return session;
+}
 
-    uint8_t* line = (uint8_t*)_malloc(width * num_channels);
-    if(!line) {
-        ESP_LOGE(TAG, "Scan line malloc failed");
+bool jpg_encoder_write(jpg_encoder_session_t *session, const uint8_t *src, size_t lines)
+{
+    if(lines > (size_t)(session->height - session->lines)) {
+        ESP_LOGE(TAG, "JPG %u lines past the end", (unsigned) lines);
         return false;
     }
-
-    for (int i = 0; i < height; i++) {
-        convert_line_format(src, format, line, width, num_channels, i);
-        if (!dst_image.process_scanline(line)) {
-            ESP_LOGE(TAG, "JPG process line %u failed", i);
-            free(line);
+    for(size_t i = 0; i < lines; i++, src += session->line_len) {
+        const uint8_t *scanline = src;
+        if(session->line) {
+            convert_line_format(src, session->format, session->line, session->width);
+            scanline = session->line;
+        }
+        if (!session->encoder.process_scanline(scanline)) {
+            ESP_LOGE(TAG, "JPG process line %u failed", session->lines);
             return false;
         }
+        session->lines++;
     }
-    free(line);
+    return true;
+}
 
-    if (!dst_image.process_scanline(NULL)) {
+bool jpg_encoder_end(jpg_encoder_session_t *session)
+{
+    bool ok = session->lines == session->height;
+    if(ok && !session->encoder.process_scanline(NULL)) {
         ESP_LOGE(TAG, "JPG image finish failed");
-        return false;
+        ok = false;
     }
-    dst_image.deinit();
-    return true;
+    free(session->line);
+    session->~jpg_encoder_session_t();
+    free(session);
+    return ok;
 }
 
-class callback_stream : public jpge::output_stream {
-protected:
-    jpg_out_cb ocb;
-    void * oarg;
-    size_t index;
-
-public:
-    callback_stream(jpg_out_cb cb, void * arg) : ocb(cb), oarg(arg), index(0) { }
-    virtual ~callback_stream() { }
-    virtual bool put_buf(const void* data, int len)
-    {
-        index += ocb(oarg, index, data, len);
-        return true;
+bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpg_out_cb cb, void * arg)
+{
+    jpg_encoder_session_t *session = jpg_encoder_start(width, height, format, quality, cb, arg);
+    if(!session) {
+        return false;
     }
-    virtual size_t get_size() const
-    {
-        return index;
+    if(!jpg_encoder_write(session, src, height)) {
+        jpg_encoder_end(session);
+        return false;
     }
-};
+    return jpg_encoder_end(session);
+}
 
 bool fmt2jpg_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpg_out_cb cb, void * arg)
 {
-    callback_stream dst_stream(cb, arg);
-    return convert_image(src, width, height, format, quality, &dst_stream);
+    return convert_image(src, width, height, format, quality, cb, arg);
 }
 
 bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg)
@@ -172,38 +223,28 @@ bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg)
 
 
 
-class memory_stream : public jpge::output_stream {
-protected:
-    uint8_t *out_buf;
-    size_t max_len, index;
-
-public:
-    memory_stream(void *pBuf, uint buf_size) : out_buf(static_cast<uint8_t*>(pBuf)), max_len(buf_size), index(0) { }
-
-    virtual ~memory_stream() { }
+typedef struct {
+    uint8_t *buf;
+    size_t max_len;
+    size_t len;
+} memory_out_t;
 
-    virtual bool put_buf(const void* pBuf, int len)
-    {
-        if (!pBuf) {
-            //end of image
-            return true;
-        }
-        if ((size_t)len > (max_len - index)) {
-            //ESP_LOGW(TAG, "JPG output overflow: %d bytes (%d,%d,%d)", len - (max_len - index), len, index, max_len);
-            len = max_len - index;
-        }
-        if (len) {
-            memcpy(out_buf + index, pBuf, len);
-            index += len;
-        }
-        return true;
+static size_t memory_write(void * arg, size_t index, const void* data, size_t len)
+{
+    memory_out_t *mem = (memory_out_t *)arg;
+    if (!data) {
+        //end of image
+        return 0;
     }
-
-    virtual size_t get_size() const
-    {
-        return index;
+    if (len > (mem->max_len - index)) {
+        len = mem->max_len - index;
     }
-};
+    if (len) {
+        memcpy(mem->buf + index, data, len);
+        mem->len = index + len;
+    }
+    return len;
+}
 
 bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
 {
@@ -217,15 +258,14 @@ bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixf
         ESP_LOGE(TAG, "JPG buffer malloc failed");
         return false;
     }
-    memory_stream dst_stream(jpg_buf, jpg_buf_len);
-
-    if(!convert_image(src, width, height, format, quality, &dst_stream)) {
+    memory_out_t mem = { jpg_buf, (size_t)jpg_buf_len, 0 };
+    if(!convert_image(src, width, height, format, quality, memory_write, &mem)) {
         free(jpg_buf);
         return false;
     }
 
     *out = jpg_buf;
-    *out_len = dst_stream.get_size();
+    *out_len = mem.len;
     return true;
 }
 
@@ -296,3 +296,87 @@ void IRAM_ATTR yuv2rgb(uint8_t y, uint8_t u, uint8_t v, uint8_t *r, uint8_t *g,
     *g = YUYV_CONSTRAIN(gi);
     *b = YUYV_CONSTRAIN(bi);
 }
+
+// The table columns are trunc(k * (x - c)) with c = 16 for Y and 128 for U
+// and V; the same products in 14-bit fixed point, truncated toward zero,
+// reproduce every entry.
+#define YUV_SHIFT   14
+#define YUV_Y       19070
+#define YUV_VR      26150
+#define YUV_VG      (-6408)
+#define YUV_UG      (-13316)
+#define YUV_UB      33062
+
+static inline int yuv_term(int k, int x)
+{
+    int t = k * x;
+    return (t + ((t >> 31) & ((1 << YUV_SHIFT) - 1))) >> YUV_SHIFT;
+}
+
+static inline uint32_t yuv_sat(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+typedef struct {
+    uint8_t r0, g0, b0, r1, g1, b1;
+} yuv_pair;
+
+// src is Y0, U, Y1, V; the U and V terms are shared by both pixels
+static inline void yuv_convert_pair(const uint8_t *src, yuv_pair *p)
+{
+    const int u = src[1] - 128;
+    const int v = src[3] - 128;
+    const int r = yuv_term(YUV_VR, v);
+    const int g = yuv_term(YUV_UG, u) + yuv_term(YUV_VG, v);
+    const int b = yuv_term(YUV_UB, u);
+    const int y0 = yuv_term(YUV_Y, src[0] - 16);
+    const int y1 = yuv_term(YUV_Y, src[2] - 16);
+    p->r0 = yuv_sat(y0 + r);
+    p->g0 = yuv_sat(y0 + g);
+    p->b0 = yuv_sat(y0 + b);
+    p->r1 = yuv_sat(y1 + r);
+    p->g1 = yuv_sat(y1 + g);
+    p->b1 = yuv_sat(y1 + b);
+}
+
+// Byte stores: the ESP32 has no unaligned word access
+void IRAM_ATTR yuv422_to_rgb888(const uint8_t *src, uint8_t *dst, size_t width)
+{
+    yuv_pair p;
+    for (size_t i = 0; i < width; i += 2, src += 4, dst += 6) {
+        yuv_convert_pair(src, &p);
+        dst[0] = p.r0; dst[1] = p.g0; dst[2] = p.b0;
+        dst[3] = p.r1; dst[4] = p.g1; dst[5] = p.b1;
+    }
+}
+
+void IRAM_ATTR yuv422_to_bgr888(const uint8_t *src, uint8_t *dst, size_t width)
+{
+    yuv_pair p;
+    for (size_t i = 0; i < width; i += 2, src += 4, dst += 6) {
+        yuv_convert_pair(src, &p);
+        dst[0] = p.b0; dst[1] = p.g0; dst[2] = p.r0;
+        dst[3] = p.b1; dst[4] = p.g1; dst[5] = p.r1;
+    }
+}
+
+void IRAM_ATTR yuv422_to_rgb565(const uint8_t *src, uint8_t *dst, size_t width)
+{
+    yuv_pair p;
+    for (size_t i = 0; i < width; i += 2, src += 4, dst += 4) {
+        yuv_convert_pair(src, &p);
+        // high byte first
+        dst[0] = (p.r0 & 0xF8) | p.g0 >> 5;
+        dst[1] = (p.g0 & 0x1C) << 3 | p.b0 >> 3;
+        dst[2] = (p.r1 & 0xF8) | p.g1 >> 5;
+        dst[3] = (p.g1 & 0x1C) << 3 | p.b1 >> 3;
+    }
+}
+
+void IRAM_ATTR yuv422_to_gray(const uint8_t *src, uint8_t *dst, size_t width)
+{
+    for (size_t i = 0; i < width; i++) {
+        dst[i] = src[2 * i];
+    }
+}
@@ -18,6 +18,7 @@
 #include "esp_heap_caps.h"
 #include "ll_cam.h"
 #include "cam_hal.h"
+#include "jpeg_marker.h"
 
 #if (ESP_IDF_VERSION_MAJOR == 3) && (ESP_IDF_VERSION_MINOR == 3)
 #include "rom/ets_sys.h"
@@ -39,37 +40,26 @@
 #define CAM_TASK_STACK             (2*1024)
 #endif
 
+#ifdef CONFIG_CAMERA_JPEG_MAX_RETRIES
+#define CAM_JPEG_MAX_RETRIES       CONFIG_CAMERA_JPEG_MAX_RETRIES
+#else
+#define CAM_JPEG_MAX_RETRIES       3
+#endif
+
+#define CAM_EVENT_SLOTS            32   // bits in cam_obj_t.event_bits
+
 static const char *TAG = "cam_hal";
 static cam_obj_t *cam_obj = NULL;
 
-static const uint32_t JPEG_SOI_MARKER = 0xFFD8FF;  // written in little-endian for esp32
 static const uint16_t JPEG_EOI_MARKER = 0xD9FF;  // written in little-endian for esp32
 
 static int cam_verify_jpeg_soi(const uint8_t *inbuf, uint32_t length)
 {
-    for (uint32_t i = 0; i < length; i++) {
-        if (memcmp(&inbuf[i], &JPEG_SOI_MARKER, 3) == 0) {
-            //ESP_LOGW(TAG, "SOI: %d", (int) i);
-            return i;
-        }
-    }
-    ESP_LOGW(TAG, "NO-SOI");
-    return -1;
-}
-
-static int cam_verify_jpeg_eoi(const uint8_t *inbuf, uint32_t length)
-{
-    int offset = -1;
-    uint8_t *dptr = (uint8_t *)inbuf + length - 2;
-    while (dptr > inbuf) {
-        if (memcmp(dptr, &JPEG_EOI_MARKER, 2) == 0) {
-            offset = dptr - inbuf;
-            //ESP_LOGW(TAG, "EOI: %d", length - (offset + 2));
-            return offset;
-        }
-        dptr--;
+    int offset = jpeg_find_soi(inbuf, length);
+    if (offset < 0) {
+        ESP_LOGW(TAG, "NO-SOI");
     }
-    return -1;
+    return offset;
 }
 
 static bool cam_get_next_frame(int * frame_pos)
@@ -96,18 +86,114 @@ static bool cam_start_frame(int * frame_pos)
             uint64_t us = (uint64_t)esp_timer_get_time();
             cam_obj->frames[*frame_pos].fb.timestamp.tv_sec = us / 1000000UL;
             cam_obj->frames[*frame_pos].fb.timestamp.tv_usec = us % 1000000UL;
+            cam_obj->frames[*frame_pos].fb.seq = cam_obj->frame_seq++;
             return true;
         }
     }
     return false;
 }
 
+// Events are recorded in a bitmap instead of a queue and cam_task is
+// woken with a task notification, so one wakeup drains all events that
+// arrived while it was busy. Only EOF events are limited by the number
+// of DMA half-buffers: VSYNC carries no data and cannot be overrun.
 void IRAM_ATTR ll_cam_send_event(cam_obj_t *cam, cam_event_t cam_event, BaseType_t * HPTaskAwoken)
 {
-    if (xQueueSendFromISR(cam->event_queue, (void *)&cam_event, HPTaskAwoken) != pdTRUE) {
+    bool overflow;
+    portENTER_CRITICAL_ISR(&cam->event_lock);
+    uint32_t head = cam->event_head;
+    overflow = head - __atomic_load_n(&cam->event_tail, __ATOMIC_ACQUIRE) >= CAM_EVENT_SLOTS;
+    if (cam_event == CAM_IN_SUC_EOF_EVENT) {
+        overflow = overflow || cam->eof_posted - __atomic_load_n(&cam->eof_taken, __ATOMIC_ACQUIRE) >= cam->eof_limit;
+    }
+    if (!overflow) {
+        if (cam_event == CAM_VSYNC_EVENT) {
+            cam->event_bits |= 1U << (head % CAM_EVENT_SLOTS);
+        } else {
+            cam->event_bits &= ~(1U << (head % CAM_EVENT_SLOTS));
+            cam->eof_posted++;
+        }
+        __atomic_store_n(&cam->event_head, head + 1, __ATOMIC_RELEASE);
+    } else {
+        // the ISRs of both cores may overflow at once
+        cam->drop_stats.event_overflow++;
+    }
+    portEXIT_CRITICAL_ISR(&cam->event_lock);
+
+    if (overflow) {
         ll_cam_stop(cam);
         cam->state = CAM_STATE_IDLE;
         ESP_CAMERA_ETS_PRINTF(DRAM_STR("cam_hal: EV-%s-OVF\r\n"), cam_event==CAM_IN_SUC_EOF_EVENT ? DRAM_STR("EOF") : DRAM_STR("VSYNC"));
+    } else if (cam->task_handle) {
+        vTaskNotifyGiveFromISR(cam->task_handle, HPTaskAwoken);
+    }
+}
+
+// Take the oldest event posted by the ISRs, sleeping until there is one.
+// Returns false when cam_task is asked to exit.
+static bool cam_wait_event(cam_event_t *cam_event)
+{
+    uint32_t tail = cam_obj->event_tail;
+    while (__atomic_load_n(&cam_obj->event_head, __ATOMIC_ACQUIRE) == tail) {
+        if (__atomic_load_n(&cam_obj->task_stop, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    if (__atomic_load_n(&cam_obj->task_stop, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    *cam_event = (cam_obj->event_bits >> (tail % CAM_EVENT_SLOTS)) & 1 ? CAM_VSYNC_EVENT : CAM_IN_SUC_EOF_EVENT;
+    if (*cam_event == CAM_IN_SUC_EOF_EVENT) {
+        __atomic_store_n(&cam_obj->eof_taken, cam_obj->eof_taken + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&cam_obj->event_tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Discard pending events
+static void cam_reset_events(void)
+{
+    portENTER_CRITICAL(&cam_obj->event_lock);
+    cam_obj->event_tail = cam_obj->event_head;
+    cam_obj->eof_taken = cam_obj->eof_posted;
+    portEXIT_CRITICAL(&cam_obj->event_lock);
+}
+
+// Append DMA half-buffer cnt to the frame. In JPEG mode the EOI search
+// is extended over the new data while it is still in cache, so that
+// cam_take() does not have to scan the whole frame.
+static void cam_copy_half_buffer(cam_frame_t *frame, int cnt)
+{
+    camera_fb_t *fb = &frame->fb;
+    size_t from = fb->len;
+    fb->len += ll_cam_memcpy(cam_obj,
+        &fb->buf[fb->len],
+        &cam_obj->dma_buffer[(cnt % cam_obj->dma_half_buffer_cnt) * cam_obj->dma_half_buffer_size],
+        cam_obj->dma_half_buffer_size);
+    if (cam_obj->jpeg_mode) {
+        frame->jpeg_eoi = jpeg_update_eoi(fb->buf, from, fb->len, frame->jpeg_eoi);
+    }
+}
+
+// Pass the lines of a raw frame completed since *lines on to the lines callback
+static void cam_send_lines(camera_fb_t *fb, size_t *lines)
+{
+    portENTER_CRITICAL(&cam_obj->event_lock);
+    camera_lines_cb_t cb = cam_obj->lines_cb;
+    void *arg = cam_obj->lines_arg;
+    portEXIT_CRITICAL(&cam_obj->event_lock);
+    if (!cb) {
+        return;
+    }
+    size_t line_len = cam_obj->width * cam_obj->fb_bytes_per_pixel;
+    size_t done = fb->len / line_len;
+    if (done > cam_obj->height) {
+        done = cam_obj->height;
+    }
+    if (done > *lines) {
+        cb(arg, fb, &fb->buf[*lines * line_len], *lines, done - *lines);
+        *lines = done;
     }
 }
 
@@ -115,14 +201,14 @@ void IRAM_ATTR ll_cam_send_event(cam_obj_t *cam, cam_event_t cam_event, BaseType
 static void cam_task(void *arg)
 {
     int cnt = 0;
+    size_t lines = 0;
     int frame_pos = 0;
     cam_obj->state = CAM_STATE_IDLE;
     cam_event_t cam_event = 0;
 
-    xQueueReset(cam_obj->event_queue);
+    cam_reset_events();
 
-    while (1) {
-        xQueueReceive(cam_obj->event_queue, (void *)&cam_event, portMAX_DELAY);
+    while (cam_wait_event(&cam_event)) {
         DBG_PIN_SET(1);
         switch (cam_obj->state) {
 
@@ -131,9 +217,11 @@ static void cam_task(void *arg)
                     //DBG_PIN_SET(1);
                     if(cam_start_frame(&frame_pos)){
                         cam_obj->frames[frame_pos].fb.len = 0;
+                        cam_obj->frames[frame_pos].jpeg_eoi = -1;
                         cam_obj->state = CAM_STATE_READ_BUF;
                     }
                     cnt = 0;
+                    lines = 0;
                 }
             }
             break;
@@ -146,17 +234,19 @@ static void cam_task(void *arg)
                     if(!cam_obj->psram_mode){
                         if (cam_obj->fb_size < (frame_buffer_event->len + pixels_per_dma)) {
                             ESP_LOGW(TAG, "FB-OVF");
+                            cam_obj->drop_stats.fb_overflow++;
                             ll_cam_stop(cam_obj);
                             DBG_PIN_SET(0);
                             continue;
                         }
-                        frame_buffer_event->len += ll_cam_memcpy(cam_obj,
-                            &frame_buffer_event->buf[frame_buffer_event->len],
-                            &cam_obj->dma_buffer[(cnt % cam_obj->dma_half_buffer_cnt) * cam_obj->dma_half_buffer_size],
-                            cam_obj->dma_half_buffer_size);
+                        cam_copy_half_buffer(&cam_obj->frames[frame_pos], cnt);
+                        if (!cam_obj->jpeg_mode) {
+                            cam_send_lines(frame_buffer_event, &lines);
+                        }
                     }
                     //Check for JPEG SOI in the first buffer. stop if not found
                     if (cam_obj->jpeg_mode && cnt == 0 && cam_verify_jpeg_soi(frame_buffer_event->buf, frame_buffer_event->len) != 0) {
+                        cam_obj->drop_stats.no_soi++;
                         ll_cam_stop(cam_obj);
                         cam_obj->state = CAM_STATE_IDLE;
                     }
@@ -171,12 +261,10 @@ static void cam_task(void *arg)
                             if (!cam_obj->psram_mode) {
                                 if (cam_obj->fb_size < (frame_buffer_event->len + pixels_per_dma)) {
                                     ESP_LOGW(TAG, "FB-OVF");
+                                    cam_obj->drop_stats.fb_overflow++;
                                     cnt--;
                                 } else {
-                                    frame_buffer_event->len += ll_cam_memcpy(cam_obj,
-                                        &frame_buffer_event->buf[frame_buffer_event->len],
-                                        &cam_obj->dma_buffer[(cnt % cam_obj->dma_half_buffer_cnt) * cam_obj->dma_half_buffer_size],
-                                        cam_obj->dma_half_buffer_size);
+                                    cam_copy_half_buffer(&cam_obj->frames[frame_pos], cnt);
                                 }
                             }
                             cnt++;
@@ -184,6 +272,10 @@ static void cam_task(void *arg)
 
                         cam_obj->frames[frame_pos].en = 0;
 
+                        uint64_t start_us = frame_buffer_event->timestamp.tv_sec * 1000000ULL + frame_buffer_event->timestamp.tv_usec;
+                        frame_buffer_event->capture_us = (uint64_t)esp_timer_get_time() - start_us;
+                        frame_buffer_event->half_buffers = cnt;
+
                         if (cam_obj->psram_mode) {
                             if (cam_obj->jpeg_mode) {
                                 frame_buffer_event->len = cnt * cam_obj->dma_half_buffer_size;
@@ -197,21 +289,29 @@ static void cam_task(void *arg)
                             }
                         }
                         //send frame
-                        if(!cam_obj->frames[frame_pos].en && xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) != pdTRUE) {
-                            //pop frame buffer from the queue
-                            camera_fb_t * fb2 = NULL;
-                            if(xQueueReceive(cam_obj->frame_buffer_queue, &fb2, 0) == pdTRUE) {
-                                //push the new frame to the end of the queue
-                                if (xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) != pdTRUE) {
+                        if (!cam_obj->frames[frame_pos].en) {
+                            if (xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) == pdTRUE) {
+                                cam_obj->drop_stats.frames++;
+                            } else {
+                                //pop frame buffer from the queue
+                                camera_fb_t * fb2 = NULL;
+                                if(xQueueReceive(cam_obj->frame_buffer_queue, &fb2, 0) == pdTRUE) {
+                                    //push the new frame to the end of the queue
+                                    if (xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) != pdTRUE) {
+                                        cam_obj->frames[frame_pos].en = 1;
+                                        cam_obj->drop_stats.fbq_send++;
+                                        ESP_LOGE(TAG, "FBQ-SND");
+                                    } else {
+                                        cam_obj->drop_stats.frames++;
+                                    }
+                                    //free the popped buffer
+                                    cam_give(fb2);
+                                } else {
+                                    //queue is full and we could not pop a frame from it
                                     cam_obj->frames[frame_pos].en = 1;
-                                    ESP_LOGE(TAG, "FBQ-SND");
+                                    cam_obj->drop_stats.fbq_receive++;
+                                    ESP_LOGE(TAG, "FBQ-RCV");
                                 }
-                                //free the popped buffer
-                                cam_give(fb2);
-                            } else {
-                                //queue is full and we could not pop a frame from it
-                                cam_obj->frames[frame_pos].en = 1;
-                                ESP_LOGE(TAG, "FBQ-RCV");
                             }
                         }
                     }
@@ -220,14 +320,19 @@ static void cam_task(void *arg)
                         cam_obj->state = CAM_STATE_IDLE;
                     } else {
                         cam_obj->frames[frame_pos].fb.len = 0;
+                        cam_obj->frames[frame_pos].jpeg_eoi = -1;
                     }
                     cnt = 0;
+                    lines = 0;
                 }
             }
             break;
         }
         DBG_PIN_SET(0);
     }
+    // Nothing of the driver is touched past this point
+    xSemaphoreGive(cam_obj->task_stopped);
+    vTaskDelete(NULL);
 }
 
 static lldesc_t * allocate_dma_descriptors(uint32_t count, uint16_t size, uint8_t * buffer)
@@ -249,7 +354,8 @@ static lldesc_t * allocate_dma_descriptors(uint32_t count, uint16_t size, uint8_
     return dma;
 }
 
-static esp_err_t cam_dma_config(const camera_config_t *config)
+// Work out the DMA geometry for the current format and size
+static esp_err_t cam_dma_sizes(void)
 {
     bool ret = ll_cam_dma_sizes(cam_obj);
     if (0 == ret) {
@@ -263,6 +369,51 @@ static esp_err_t cam_dma_config(const camera_config_t *config)
              (int) cam_obj->dma_buffer_size, (int) cam_obj->dma_half_buffer_size, (int) cam_obj->dma_node_buffer_size,
              (int) cam_obj->dma_node_cnt, (int) cam_obj->frame_copy_cnt);
 
+    // A half-buffer must be copied before DMA comes back around to it
+    cam_obj->eof_limit = cam_obj->dma_half_buffer_cnt - 1;
+    if (cam_obj->eof_limit == 0) {
+        cam_obj->eof_limit = 1;
+    }
+    if (cam_obj->eof_limit > CAM_EVENT_SLOTS) {
+        cam_obj->eof_limit = CAM_EVENT_SLOTS;
+    }
+    return ESP_OK;
+}
+
+// Allocate the DMA buffer that frames are copied out of (not used in PSRAM mode)
+static esp_err_t cam_dma_alloc(void)
+{
+    cam_obj->dma_buffer = (uint8_t *)heap_caps_malloc(cam_obj->dma_buffer_size * sizeof(uint8_t), MALLOC_CAP_DMA);
+    if(NULL == cam_obj->dma_buffer) {
+        ESP_LOGE(TAG,"%s(%d): DMA buffer %d Byte malloc failed, the current largest free block:%d Byte", __FUNCTION__, __LINE__,
+                 (int) cam_obj->dma_buffer_size, (int) heap_caps_get_largest_free_block(MALLOC_CAP_DMA));
+        return ESP_FAIL;
+    }
+
+    cam_obj->dma = allocate_dma_descriptors(cam_obj->dma_node_cnt, cam_obj->dma_node_buffer_size, cam_obj->dma_buffer);
+    CAM_CHECK(cam_obj->dma != NULL, "dma malloc failed", ESP_FAIL);
+    return ESP_OK;
+}
+
+static void cam_dma_free(void)
+{
+    if (cam_obj->dma) {
+        free(cam_obj->dma);
+        cam_obj->dma = NULL;
+    }
+    if (cam_obj->dma_buffer) {
+        free(cam_obj->dma_buffer);
+        cam_obj->dma_buffer = NULL;
+    }
+}
+
+static esp_err_t cam_dma_config(const camera_config_t *config)
+{
+    esp_err_t err = cam_dma_sizes();
+    if (err != ESP_OK) {
+        return err;
+    }
+
     cam_obj->dma_buffer = NULL;
     cam_obj->dma = NULL;
 
@@ -280,6 +431,7 @@ static esp_err_t cam_dma_config(const camera_config_t *config)
 
     /* Allocate memory for frame buffer */
     size_t alloc_size = fb_size * sizeof(uint8_t) + dma_align;
+    cam_obj->fb_alloc_size = fb_size;
     uint32_t _caps = MALLOC_CAP_8BIT;
     if (CAMERA_FB_IN_DRAM == config->fb_location) {
         _caps |= MALLOC_CAP_INTERNAL;
@@ -311,20 +463,58 @@ static esp_err_t cam_dma_config(const camera_config_t *config)
     }
 
     if (!cam_obj->psram_mode) {
-        cam_obj->dma_buffer = (uint8_t *)heap_caps_malloc(cam_obj->dma_buffer_size * sizeof(uint8_t), MALLOC_CAP_DMA);
-        if(NULL == cam_obj->dma_buffer) {
-            ESP_LOGE(TAG,"%s(%d): DMA buffer %d Byte malloc failed, the current largest free block:%d Byte", __FUNCTION__, __LINE__,
-                     (int) cam_obj->dma_buffer_size, (int) heap_caps_get_largest_free_block(MALLOC_CAP_DMA));
-            return ESP_FAIL;
-        }
+        return cam_dma_alloc();
+    }
 
-        cam_obj->dma = allocate_dma_descriptors(cam_obj->dma_node_cnt, cam_obj->dma_node_buffer_size, cam_obj->dma_buffer);
-        CAM_CHECK(cam_obj->dma != NULL, "dma malloc failed", ESP_FAIL);
+    return ESP_OK;
+}
+
+// Set the frame size, and the received and stored bytes per frame that follow from it
+static void cam_set_size(uint16_t width, uint16_t height)
+{
+    cam_obj->width = width;
+    cam_obj->height = height;
+
+    if(cam_obj->jpeg_mode){
+        cam_obj->recv_size = cam_obj->width * cam_obj->height / 5;
+        cam_obj->fb_size = cam_obj->recv_size;
+    } else {
+        cam_obj->recv_size = cam_obj->width * cam_obj->height * cam_obj->in_bytes_per_pixel;
+        cam_obj->fb_size = cam_obj->width * cam_obj->height * cam_obj->fb_bytes_per_pixel;
     }
+}
 
+static esp_err_t cam_create_task(void)
+{
+    if (!cam_obj->task_stopped) {
+        cam_obj->task_stopped = xSemaphoreCreateBinary();
+        CAM_CHECK(cam_obj->task_stopped != NULL, "task semaphore create failed", ESP_ERR_NO_MEM);
+    }
+    cam_obj->task_stop = false;
+#if CONFIG_CAMERA_CORE0
+    xTaskCreatePinnedToCore(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 0);
+#elif CONFIG_CAMERA_CORE1
+    xTaskCreatePinnedToCore(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 1);
+#else
+    xTaskCreate(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle);
+#endif
+    CAM_CHECK(cam_obj->task_handle != NULL, "cam_task create failed", ESP_ERR_NO_MEM);
     return ESP_OK;
 }
 
+// Ask cam_task to exit and wait until it has stopped using the DMA buffer,
+// the frames and event_lock, which may be on the other core
+static void cam_stop_task(void)
+{
+    if (!cam_obj->task_handle) {
+        return;
+    }
+    __atomic_store_n(&cam_obj->task_stop, true, __ATOMIC_RELEASE);
+    xTaskNotifyGive(cam_obj->task_handle);
+    xSemaphoreTake(cam_obj->task_stopped, portMAX_DELAY);
+    cam_obj->task_handle = NULL;
+}
+
 esp_err_t cam_init(const camera_config_t *config)
 {
     CAM_CHECK(NULL != config, "config pointer is invalid", ESP_ERR_INVALID_ARG);
@@ -333,6 +523,7 @@ esp_err_t cam_init(const camera_config_t *config)
     cam_obj = (cam_obj_t *)heap_caps_calloc(1, sizeof(cam_obj_t), MALLOC_CAP_DMA);
     CAM_CHECK(NULL != cam_obj, "lcd_cam object malloc error", ESP_ERR_NO_MEM);
 
+    portMUX_INITIALIZE(&cam_obj->event_lock);
     cam_obj->swap_data = 0;
     cam_obj->vsync_pin = config->pin_vsync;
     cam_obj->vsync_invert = true;
@@ -363,6 +554,7 @@ esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint
 
     ret = ll_cam_set_sample_mode(cam_obj, (pixformat_t)config->pixel_format, config->xclk_freq_hz, sensor_pid);
 
+    cam_obj->pix_format = (pixformat_t)config->pixel_format;
     cam_obj->jpeg_mode = config->pixel_format == PIXFORMAT_JPEG;
 #if CONFIG_IDF_TARGET_ESP32
     cam_obj->psram_mode = false;
@@ -370,27 +562,11 @@ esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint
     cam_obj->psram_mode = (config->xclk_freq_hz == 16000000);
 #endif
     cam_obj->frame_cnt = config->fb_count;
-    cam_obj->width = resolution[frame_size].width;
-    cam_obj->height = resolution[frame_size].height;
-
-    if(cam_obj->jpeg_mode){
-        cam_obj->recv_size = cam_obj->width * cam_obj->height / 5;
-        cam_obj->fb_size = cam_obj->recv_size;
-    } else {
-        cam_obj->recv_size = cam_obj->width * cam_obj->height * cam_obj->in_bytes_per_pixel;
-        cam_obj->fb_size = cam_obj->width * cam_obj->height * cam_obj->fb_bytes_per_pixel;
-    }
+    cam_set_size(resolution[frame_size].width, resolution[frame_size].height);
 
     ret = cam_dma_config(config);
     CAM_CHECK_GOTO(ret == ESP_OK, "cam_dma_config failed", err);
 
-    size_t queue_size = cam_obj->dma_half_buffer_cnt - 1;
-    if (queue_size == 0) {
-        queue_size = 1;
-    }
-    cam_obj->event_queue = xQueueCreate(queue_size, sizeof(cam_event_t));
-    CAM_CHECK_GOTO(cam_obj->event_queue != NULL, "event_queue create failed", err);
-
     size_t frame_buffer_queue_len = cam_obj->frame_cnt;
     if (config->grab_mode == CAMERA_GRAB_LATEST && cam_obj->frame_cnt > 1) {
         frame_buffer_queue_len = cam_obj->frame_cnt - 1;
@@ -401,14 +577,8 @@ esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint
     ret = ll_cam_init_isr(cam_obj);
     CAM_CHECK_GOTO(ret == ESP_OK, "cam intr alloc failed", err);
 
-
-#if CONFIG_CAMERA_CORE0
-    xTaskCreatePinnedToCore(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 0);
-#elif CONFIG_CAMERA_CORE1
-    xTaskCreatePinnedToCore(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 1);
-#else
-    xTaskCreate(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle);
-#endif
+    ret = cam_create_task();
+    CAM_CHECK_GOTO(ret == ESP_OK, "cam_task create failed", err);
 
     ESP_LOGI(TAG, "cam config ok");
     return ESP_OK;
@@ -418,6 +588,64 @@ err:
     return ESP_FAIL;
 }
 
+// Set up the sampling, frame size and DMA buffer for a format, with capture and cam_task stopped
+static esp_err_t cam_apply_format(pixformat_t pix_format, uint16_t width, uint16_t height, uint32_t xclk_freq_hz, uint16_t sensor_pid)
+{
+    esp_err_t ret = ll_cam_set_sample_mode(cam_obj, pix_format, xclk_freq_hz, sensor_pid);
+    CAM_CHECK(ret == ESP_OK, "ll_cam_set_sample_mode failed", ret);
+    cam_obj->pix_format = pix_format;
+    cam_obj->jpeg_mode = pix_format == PIXFORMAT_JPEG;
+    cam_set_size(width, height);
+
+    cam_dma_free();
+    ret = cam_dma_sizes();
+    CAM_CHECK(ret == ESP_OK, "cam_dma_sizes failed", ret);
+    ret = cam_dma_alloc();
+    CAM_CHECK(ret == ESP_OK, "cam_dma_alloc failed", ret);
+    return ESP_OK;
+}
+
+esp_err_t cam_reconfigure(pixformat_t pix_format, uint16_t width, uint16_t height, uint32_t xclk_freq_hz, uint16_t sensor_pid)
+{
+    CAM_CHECK(NULL != cam_obj, "camera is not initialized", ESP_ERR_INVALID_STATE);
+    // In PSRAM mode the DMA descriptors point into the frame buffers and are sized for them
+    CAM_CHECK(!cam_obj->psram_mode, "not supported in PSRAM DMA mode", ESP_ERR_NOT_SUPPORTED);
+    CAM_CHECK(pix_format == PIXFORMAT_JPEG || pix_format == PIXFORMAT_GRAYSCALE ||
+              pix_format == PIXFORMAT_YUV422 || pix_format == PIXFORMAT_RGB565,
+              "unsupported pixel format", ESP_ERR_NOT_SUPPORTED);
+    bool jpeg_mode = pix_format == PIXFORMAT_JPEG;
+    size_t fb_size = jpeg_mode ? width * height / 5 : width * height * (pix_format == PIXFORMAT_GRAYSCALE ? 1 : 2);
+    CAM_CHECK(fb_size <= cam_obj->fb_alloc_size, "frame does not fit the frame buffers", ESP_ERR_INVALID_SIZE);
+
+    pixformat_t old_format = cam_obj->pix_format;
+    uint16_t old_width = cam_obj->width;
+    uint16_t old_height = cam_obj->height;
+
+    // Stop capture and cam_task, whose state belongs to the old format
+    cam_stop();
+    cam_stop_task();
+    // Frames of the old format that were not taken are dropped
+    xQueueReset(cam_obj->frame_buffer_queue);
+    cam_give_all();
+
+    esp_err_t ret = cam_apply_format(pix_format, width, height, xclk_freq_hz, sensor_pid);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "cam reconfigure failed, restoring format %d, %ux%u", (int) old_format, (unsigned) old_width, (unsigned) old_height);
+        if (cam_apply_format(old_format, old_width, old_height, xclk_freq_hz, sensor_pid) != ESP_OK) {
+            ESP_LOGE(TAG, "cannot restore the previous format, capture stopped");
+            return ret;
+        }
+    }
+
+    esp_err_t task_ret = cam_create_task();
+    CAM_CHECK(task_ret == ESP_OK, "cam_task create failed, capture stopped", task_ret);
+    cam_start();
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "cam reconfigured to format %d, %ux%u", (int) pix_format, (unsigned) width, (unsigned) height);
+    }
+    return ret;
+}
+
 esp_err_t cam_deinit(void)
 {
     if (!cam_obj) {
@@ -425,11 +653,9 @@ esp_err_t cam_deinit(void)
     }
 
     cam_stop();
-    if (cam_obj->task_handle) {
-        vTaskDelete(cam_obj->task_handle);
-    }
-    if (cam_obj->event_queue) {
-        vQueueDelete(cam_obj->event_queue);
+    cam_stop_task();
+    if (cam_obj->task_stopped) {
+        vSemaphoreDelete(cam_obj->task_stopped);
     }
     if (cam_obj->frame_buffer_queue) {
         vQueueDelete(cam_obj->frame_buffer_queue);
@@ -437,12 +663,7 @@ esp_err_t cam_deinit(void)
 
     ll_cam_deinit(cam_obj);
 
-    if (cam_obj->dma) {
-        free(cam_obj->dma);
-    }
-    if (cam_obj->dma_buffer) {
-        free(cam_obj->dma_buffer);
-    }
+    cam_dma_free();
     if (cam_obj->frames) {
         for (int x = 0; x < cam_obj->frame_cnt; x++) {
             free(cam_obj->frames[x].fb.buf - cam_obj->frames[x].fb_offset);
@@ -471,48 +692,72 @@ void cam_start(void)
 
 camera_fb_t *cam_take(TickType_t timeout)
 {
-    camera_fb_t *dma_buffer = NULL;
     TickType_t start = xTaskGetTickCount();
-    xQueueReceive(cam_obj->frame_buffer_queue, (void *)&dma_buffer, timeout);
+    TickType_t remaining = timeout;
+    for (int retries = 0; ; retries++) {
+        camera_fb_t *dma_buffer = NULL;
+        xQueueReceive(cam_obj->frame_buffer_queue, (void *)&dma_buffer, remaining);
 #if CONFIG_IDF_TARGET_ESP32S3
-    // Currently (22.01.2024) there is a bug in ESP-IDF v5.2, that causes
-    // GDMA to fall into a strange state if it is running while WiFi STA is connecting.
-    // This code tries to reset GDMA if frame is not received, to try and help with
-    // this case. It is possible to have some side effects too, though none come to mind
-    if (!dma_buffer) {
-        ll_cam_dma_reset(cam_obj);
-        xQueueReceive(cam_obj->frame_buffer_queue, (void *)&dma_buffer, timeout);
-    }
-#endif
-    if (dma_buffer) {
-        if(cam_obj->jpeg_mode){
-            // find the end marker for JPEG. Data after that can be discarded
-            int offset_e = cam_verify_jpeg_eoi(dma_buffer->buf, dma_buffer->len);
-            if (offset_e >= 0) {
-                // adjust buffer length
-                dma_buffer->len = offset_e + sizeof(JPEG_EOI_MARKER);
-                return dma_buffer;
-            } else {
-                ESP_LOGW(TAG, "NO-EOI");
-                cam_give(dma_buffer);
-                TickType_t ticks_spent = xTaskGetTickCount() - start;
-                if (ticks_spent >= timeout) {
-                    return NULL; /* We are out of time */
-                }
-                return cam_take(timeout - ticks_spent);//recurse!!!!
-            }
-        } else if(cam_obj->psram_mode && cam_obj->in_bytes_per_pixel != cam_obj->fb_bytes_per_pixel){
-            //currently this is used only for YUV to GRAYSCALE
-            dma_buffer->len = ll_cam_memcpy(cam_obj, dma_buffer->buf, dma_buffer->buf, dma_buffer->len);
+        // Currently (22.01.2024) there is a bug in ESP-IDF v5.2, that causes
+        // GDMA to fall into a strange state if it is running while WiFi STA is connecting.
+        // This code tries to reset GDMA if frame is not received, to try and help with
+        // this case. It is possible to have some side effects too, though none come to mind
+        if (!dma_buffer) {
+            ll_cam_dma_reset(cam_obj);
+            xQueueReceive(cam_obj->frame_buffer_queue, (void *)&dma_buffer, remaining);
         }
-        return dma_buffer;
-    } else {
-        ESP_LOGW(TAG, "Failed to get the frame on time!");
+#endif
+        if (!dma_buffer) {
+            ESP_LOGW(TAG, "Failed to get the frame on time!");
 // #if CONFIG_IDF_TARGET_ESP32S3
-//         ll_cam_dma_print_state(cam_obj);
+//             ll_cam_dma_print_state(cam_obj);
 // #endif
+            return NULL;
+        }
+        if (!cam_obj->jpeg_mode) {
+            if (cam_obj->psram_mode && cam_obj->in_bytes_per_pixel != cam_obj->fb_bytes_per_pixel) {
+                //currently this is used only for YUV to GRAYSCALE
+                dma_buffer->len = ll_cam_memcpy(cam_obj, dma_buffer->buf, dma_buffer->buf, dma_buffer->len);
+            }
+            return dma_buffer;
+        }
+        // find the end marker for JPEG. Data after that can be discarded.
+        // Frames copied from DMA buffers have it tracked as they arrive
+        // (fb is the first member of cam_frame_t)
+        int offset_e = cam_obj->psram_mode ?
+            jpeg_find_eoi(dma_buffer->buf, dma_buffer->len) :
+            ((cam_frame_t *)dma_buffer)->jpeg_eoi;
+        if (offset_e >= 0) {
+            // adjust buffer length
+            dma_buffer->len = offset_e + sizeof(JPEG_EOI_MARKER);
+            return dma_buffer;
+        }
+        ESP_LOGW(TAG, "NO-EOI");
+        cam_obj->drop_stats.no_eoi++;
+        cam_give(dma_buffer);
+        TickType_t ticks_spent = xTaskGetTickCount() - start;
+        if (ticks_spent >= timeout) {
+            return NULL; /* We are out of time */
+        }
+        if (retries >= CAM_JPEG_MAX_RETRIES) {
+            ESP_LOGW(TAG, "NO-EOI in %d frames", retries + 1);
+            return NULL;
+        }
+        remaining = timeout - ticks_spent;
     }
-    return NULL;
+}
+
+void cam_get_drop_stats(camera_drop_stats_t *stats)
+{
+    *stats = cam_obj->drop_stats;
+}
+
+void cam_set_lines_callback(camera_lines_cb_t cb, void *arg)
+{
+    portENTER_CRITICAL(&cam_obj->event_lock);
+    cam_obj->lines_cb = cb;
+    cam_obj->lines_arg = arg;
+    portEXIT_CRITICAL(&cam_obj->event_lock);
 }
 
 void cam_give(camera_fb_t *dma_buffer)
@@ -81,6 +81,15 @@ static const char *TAG = "camera";
 typedef struct {
     sensor_t sensor;
     camera_fb_t fb;
+    // Raw frame size set by esp_camera_set_capture_format(), 0 to use the framesize
+    uint16_t raw_width;
+    uint16_t raw_height;
+    // Exposure and gain as last read, see esp_camera_set_exposure_interval()
+    TickType_t exposure_interval;   // 0 to not read them
+    TickType_t exposure_read_at;
+    bool exposure_read;
+    uint16_t aec;
+    uint16_t agc;
 } camera_state_t;
 
 static const char *CAMERA_SENSOR_NVS_KEY = "sensor";
@@ -358,6 +367,39 @@ esp_err_t esp_camera_deinit()
 
 #define FB_GET_TIMEOUT (4000 / portTICK_PERIOD_MS)
 
+// Snapshot of the exposure and gain, for sensors whose registers are known.
+// This is a few blocking SCCB reads, done in the caller's task rather than
+// in cam_task, and at most once per exposure_interval.
+static void camera_read_exposure(sensor_t *s)
+{
+    int aec = 0;
+    int agc = 0;
+    switch (s->id.PID) {
+    case OV2640_PID: {
+        // Sensor bank: AEC[15:10] in REG45, AEC[9:2] in AEC, AEC[1:0] in REG04
+        int reg45 = s->get_reg(s, 0x145, 0x3F);
+        int reg10 = s->get_reg(s, 0x110, 0xFF);
+        int reg04 = s->get_reg(s, 0x104, 0x03);
+        if (reg45 >= 0 && reg10 >= 0 && reg04 >= 0) {
+            aec = (reg45 << 10) | (reg10 << 2) | reg04;
+        }
+        agc = s->get_reg(s, 0x100, 0xFF);
+        break;
+    }
+    case OV3660_PID:
+    case OV5640_PID:
+        // Exposure {0x3500[3:0], 0x3501, 0x3502} in 1/16 lines, gain {0x350A[1:0], 0x350B}
+        aec = s->get_reg(s, 0x3500, 0xFFFFF);
+        aec = aec > 0 ? aec >> 4 : 0;
+        agc = s->get_reg(s, 0x350A, 0x3FF);
+        break;
+    default:
+        break;
+    }
+    s_state->aec = aec > 0 ? aec : 0;
+    s_state->agc = agc > 0 ? agc : 0;
+}
+
 camera_fb_t *esp_camera_fb_get()
 {
     if (s_state == NULL) {
@@ -366,9 +408,24 @@ camera_fb_t *esp_camera_fb_get()
     camera_fb_t *fb = cam_take(FB_GET_TIMEOUT);
     //set the frame properties
     if (fb) {
-        fb->width = resolution[s_state->sensor.status.framesize].width;
-        fb->height = resolution[s_state->sensor.status.framesize].height;
+        if (s_state->raw_width) {
+            fb->width = s_state->raw_width;
+            fb->height = s_state->raw_height;
+        } else {
+            fb->width = resolution[s_state->sensor.status.framesize].width;
+            fb->height = resolution[s_state->sensor.status.framesize].height;
+        }
         fb->format = s_state->sensor.pixformat;
+        if (s_state->exposure_interval) {
+            TickType_t now = xTaskGetTickCount();
+            if (!s_state->exposure_read || now - s_state->exposure_read_at >= s_state->exposure_interval) {
+                camera_read_exposure(&s_state->sensor);
+                s_state->exposure_read_at = now;
+                s_state->exposure_read = true;
+            }
+        }
+        fb->aec = s_state->aec;
+        fb->agc = s_state->agc;
     }
     return fb;
 }
@@ -484,3 +541,51 @@ void esp_camera_return_all(void) {
     cam_give_all();
 }
 
+esp_err_t esp_camera_set_capture_format(pixformat_t format, uint16_t width, uint16_t height)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = cam_reconfigure(format, width, height, s_state->sensor.xclk_freq_hz, s_state->sensor.id.PID);
+    if (err == ESP_OK) {
+        s_state->sensor.pixformat = format;
+        bool raw = format != PIXFORMAT_JPEG;
+        s_state->raw_width = raw ? width : 0;
+        s_state->raw_height = raw ? height : 0;
+    }
+    return err;
+}
+
+esp_err_t esp_camera_set_exposure_interval(uint32_t interval_ms)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    TickType_t ticks = pdMS_TO_TICKS(interval_ms);
+    s_state->exposure_interval = interval_ms && !ticks ? 1 : ticks;
+    s_state->exposure_read = false;
+    if (!interval_ms) {
+        s_state->aec = 0;
+        s_state->agc = 0;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_set_lines_callback(camera_lines_cb_t cb, void *arg)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    cam_set_lines_callback(cb, arg);
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_get_drop_stats(camera_drop_stats_t *stats)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    cam_get_drop_stats(stats);
+    return ESP_OK;
+}
+
@@ -167,8 +167,37 @@ typedef struct {
     size_t height;              /*!< Height of the buffer in pixels */
     pixformat_t format;         /*!< Format of the pixel data */
     struct timeval timestamp;   /*!< Timestamp since boot of the first DMA buffer of the frame */
+    uint32_t seq;               /*!< Frame number, counting every frame started since init, so gaps show dropped frames */
+    uint32_t capture_us;        /*!< Time from VSYNC at the start of the frame to the end of the frame */
+    uint16_t half_buffers;      /*!< Number of DMA half-buffers the frame took */
+    uint16_t aec;               /*!< Exposure in lines as last read from the sensor, see esp_camera_set_exposure_interval(); 0 if not read or not supported */
+    uint16_t agc;               /*!< Gain register value as last read from the sensor; 0 if not read or not supported */
 } camera_fb_t;
 
+/**
+ * @brief Counters of frames dropped by the driver, by reason, and of frames delivered
+ */
+typedef struct {
+    uint32_t no_soi;            /*!< JPEG frames not starting with an SOI marker */
+    uint32_t no_eoi;            /*!< JPEG frames without an EOI marker */
+    uint32_t fb_overflow;       /*!< Frames larger than the frame buffer */
+    uint32_t fbq_send;          /*!< Frames that could not be queued */
+    uint32_t fbq_receive;       /*!< Frames dropped because the full queue could not be drained */
+    uint32_t event_overflow;    /*!< DMA/VSYNC events lost because the event queue was full */
+    uint32_t frames;            /*!< Frames passed to the frame buffer queue, for comparison */
+} camera_drop_stats_t;
+
+/**
+ * @brief Called with the lines of a raw frame as they are captured
+ *
+ * @param arg   Pointer given to esp_camera_set_lines_callback()
+ * @param fb    The frame being captured; its len covers the lines so far
+ * @param lines The new lines, packed in the frame format
+ * @param first Index of the first new line, 0 at the start of a frame
+ * @param count Number of new lines
+ */
+typedef void (*camera_lines_cb_t)(void *arg, const camera_fb_t *fb, const uint8_t *lines, size_t first, size_t count);
+
 #define ESP_ERR_CAMERA_BASE 0x20000
 #define ESP_ERR_CAMERA_NOT_DETECTED             (ESP_ERR_CAMERA_BASE + 1)
 #define ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE (ESP_ERR_CAMERA_BASE + 2)
@@ -242,6 +271,75 @@ esp_err_t esp_camera_load_from_nvs(const char *key);
  */
 void esp_camera_return_all(void);
 
+/**
+ * @brief Get the number of frames dropped since initialization, by reason
+ *
+ * @param stats Filled in with the counters
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ */
+esp_err_t esp_camera_get_drop_stats(camera_drop_stats_t *stats);
+
+/**
+ * @brief Switch the driver to another pixel format and frame size without reinitializing it
+ *
+ * The sensor must already have been set up to deliver the new format and
+ * size, e.g. with set_pixformat() and set_framesize() or set_res_raw().
+ * Frames not yet taken are dropped. The frames must fit in the frame
+ * buffers allocated by esp_camera_init(), and all of them must have been
+ * returned. Frames of formats other than JPEG report width x height.
+ *
+ * @param format Pixel format
+ * @param width Frame width in pixels
+ * @param height Frame height in pixels
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ *      - ESP_ERR_INVALID_SIZE if the frames would not fit in the frame buffers
+ *      - ESP_ERR_NOT_SUPPORTED for unsupported formats, or when DMA goes straight to PSRAM
+ *      - ESP_FAIL if capture could not be set up at the new size; it goes on in the previous format
+ */
+esp_err_t esp_camera_set_capture_format(pixformat_t format, uint16_t width, uint16_t height);
+
+/**
+ * @brief Read the sensor's exposure and gain into the frames' aec and agc fields
+ *
+ * The registers are read over SCCB by esp_camera_fb_get(), which blocks
+ * for a few transfers, so they are read at most once per interval and the
+ * frames in between carry the last reading. Off by default, when aec and
+ * agc are 0.
+ *
+ * @param interval_ms Time between readings, 0 to stop reading
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ */
+esp_err_t esp_camera_set_exposure_interval(uint32_t interval_ms);
+
+/**
+ * @brief Get the lines of raw frames as each DMA half-buffer is copied
+ *
+ * Lets a consumer such as jpg_encoder_write() work through a frame while
+ * it is captured, from lines still in cache. The callback runs in the
+ * camera task: if it takes longer than the DMA takes to fill a
+ * half-buffer, frames are dropped and counted as event_overflow, so pass
+ * the work on to another task or lower the XCLK frequency. A frame whose
+ * lines stop short of its height was dropped. Not called for JPEG frames
+ * or when DMA goes straight to PSRAM.
+ *
+ * @param cb    Callback, NULL to stop
+ * @param arg   Pointer passed to the callback
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ */
+esp_err_t esp_camera_set_lines_callback(camera_lines_cb_t cb, void *arg);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,96 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "jpeg_marker.h"
+
+// Markers are found by their second byte (D8 for SOI, D9 for EOI):
+// it is as rare as 0xFF in entropy coded data, and unlike 0xFF it also
+// lets the 0x00 or 0xFF padding after the image be skipped a word at a
+// time. Only words containing it are looked at byte by byte.
+
+static inline uint32_t load_aligned_word(const uint8_t *p)
+{
+    uint32_t w;
+    memcpy(&w, __builtin_assume_aligned(p, 4), sizeof(w));
+    return w;
+}
+
+// Nonzero if any byte of w equals the byte replicated in pattern
+static inline uint32_t word_has_byte(uint32_t w, uint32_t pattern)
+{
+    w ^= pattern;
+    return (w - 0x01010101U) & ~w & 0x80808080U;
+}
+
+static inline int is_aligned(const uint8_t *p)
+{
+    return ((uintptr_t)p & 3) == 0;
+}
+
+int jpeg_find_soi(const uint8_t *buf, size_t len)
+{
+    if (len < 3) {
+        return -1;
+    }
+    // i is the position of D8; candidates are buf[1..len - 1)
+    size_t i = 1;
+    const size_t end = len - 1;
+    while (i < end) {
+        if (is_aligned(buf + i)) {
+            while (i + 4 <= end && !word_has_byte(load_aligned_word(buf + i), 0xD8D8D8D8U)) {
+                i += 4;
+            }
+            if (i >= end) {
+                break;
+            }
+        }
+        if (buf[i] == 0xD8 && buf[i - 1] == 0xFF && buf[i + 1] == 0xFF) {
+            return i - 1;
+        }
+        i++;
+    }
+    return -1;
+}
+
+int jpeg_find_eoi(const uint8_t *buf, size_t len)
+{
+    // Candidates for D9 are buf[1..i), scanned from the end
+    size_t i = len;
+    while (i > 1) {
+        if (is_aligned(buf + i)) {
+            while (i >= 5 && !word_has_byte(load_aligned_word(buf + i - 4), 0xD9D9D9D9U)) {
+                i -= 4;
+            }
+            if (i <= 1) {
+                break;
+            }
+        }
+        i--;
+        if (buf[i] == 0xD9 && buf[i - 1] == 0xFF) {
+            return i - 1;
+        }
+    }
+    return -1;
+}
+
+int jpeg_update_eoi(const uint8_t *buf, size_t from, size_t len, int eoi)
+{
+    const size_t start = from ? from - 1 : 0;
+    if (len <= start) {
+        return eoi;
+    }
+    int offset = jpeg_find_eoi(buf + start, len - start);
+    return offset >= 0 ? (int)start + offset : eoi;
+}
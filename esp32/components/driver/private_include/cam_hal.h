@@ -47,6 +47,23 @@ esp_err_t cam_init(const camera_config_t *config);
 
 esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint16_t sensor_pid);
 
+/**
+ * @brief Switch the capture format and size while running
+ *
+ * Capture and cam_task are stopped, frames not yet taken are dropped, the
+ * DMA buffer is reallocated for the new format and capture restarts. The
+ * frame buffers allocated by cam_config() are kept, so the new frames must
+ * fit in them. All frame buffers must have been returned.
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_ERR_INVALID_SIZE The frames would not fit in the frame buffers
+ *     - ESP_ERR_NOT_SUPPORTED PSRAM DMA mode, or an unsupported format
+ *     - ESP_FAIL No DMA geometry or memory for the new size; capture goes on in the
+ *       previous format, unless that could not be set up again either
+ */
+esp_err_t cam_reconfigure(pixformat_t pix_format, uint16_t width, uint16_t height, uint32_t xclk_freq_hz, uint16_t sensor_pid);
+
 void cam_stop(void);
 
 void cam_start(void);
@@ -57,6 +74,10 @@ void cam_give(camera_fb_t *dma_buffer);
 
 void cam_give_all(void);
 
+void cam_get_drop_stats(camera_drop_stats_t *stats);
+
+void cam_set_lines_callback(camera_lines_cb_t cb, void *arg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,53 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Find the first JPEG SOI marker (FF D8 FF)
+ *
+ * Aligned 32-bit words are tested for a marker byte before any exact match.
+ *
+ * @return Offset of the marker, or -1 if there is none
+ */
+int jpeg_find_soi(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Find the last JPEG EOI marker (FF D9), scanning backwards
+ *
+ * @return Offset of the marker, or -1 if there is none
+ */
+int jpeg_find_eoi(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Extend an EOI search as data is appended to a frame
+ *
+ * buf[0..from) has already been searched and its last EOI is at eoi
+ * (or -1). Only buf[from - 1..len) is scanned, so a marker split
+ * across the boundary is still found.
+ *
+ * @return Offset of the last EOI marker in buf[0..len), or -1
+ */
+int jpeg_update_eoi(const uint8_t *buf, size_t from, size_t len, int eoi);
+
+#ifdef __cplusplus
+}
+#endif
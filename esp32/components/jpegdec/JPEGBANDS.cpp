@@ -0,0 +1,305 @@
+//
+// Band-parallel decoding for JPEGDEC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+//
+#include "JPEGBANDS.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#else
+#include <thread>
+#endif
+
+#define BE16(p) (((p)[0] << 8) | (p)[1])
+
+int JPEG_findBands(uint8_t *pData, int iDataSize, int iMaxBands, JPEGBANDS *pBands)
+{
+    int iPos, iLen, iHeightOffset = 0, iHeaderSize = 0, iRestart = 0;
+    int iWidth = 0, iHeight = 0, iMCUWidth = 8, iMCUHeight = 8;
+
+    memset(pBands, 0, sizeof(JPEGBANDS));
+    if (iDataSize < 4 || BE16(pData) != 0xffd8)
+        return 0;
+    // Walk the segments up to the start of scan
+    iPos = 2;
+    while (!iHeaderSize)
+    {
+        if (iPos + 4 > iDataSize || pData[iPos] != 0xff)
+            return 0;
+        if (pData[iPos+1] == 0xff) // fill byte
+        {
+            iPos++;
+            continue;
+        }
+        iLen = BE16(&pData[iPos+2]);
+        if (iPos + 2 + iLen > iDataSize)
+            return 0;
+        switch (pData[iPos+1])
+        {
+            case 0xc0: // baseline
+            case 0xc1: // extended sequential, Huffman coded
+            {
+                int i, iComponents = pData[iPos+9];
+                iHeightOffset = iPos + 5;
+                iHeight = BE16(&pData[iPos+5]);
+                iWidth = BE16(&pData[iPos+7]);
+                if (iComponents > 1) // interleaved: the MCU covers the largest sampling factors
+                {
+                    for (i = 0; i < iComponents && 10 + 3*i + 1 < iLen + 2; i++)
+                    {
+                        uint8_t ucSampling = pData[iPos + 10 + 3*i + 1];
+                        if ((ucSampling >> 4) * 8 > iMCUWidth)
+                            iMCUWidth = (ucSampling >> 4) * 8;
+                        if ((ucSampling & 0xf) * 8 > iMCUHeight)
+                            iMCUHeight = (ucSampling & 0xf) * 8;
+                    }
+                }
+                break;
+            }
+            case 0xc2: case 0xc3: case 0xc5: case 0xc6: case 0xc7:
+            case 0xc9: case 0xca: case 0xcb: case 0xcd: case 0xce: case 0xcf:
+                return 0; // progressive, lossless or arithmetic coded
+            case 0xdd: // define restart interval
+                iRestart = BE16(&pData[iPos+4]);
+                break;
+            case 0xda: // start of scan
+                iHeaderSize = iPos + 2 + iLen;
+                break;
+        }
+        iPos += 2 + iLen;
+    }
+    if (!iHeightOffset || iWidth == 0 || iHeight == 0)
+        return 0;
+
+    pBands->iWidth = iWidth;
+    pBands->iHeight = iHeight;
+    pBands->iMCUHeight = iMCUHeight;
+    pBands->iRestartInterval = iRestart;
+    const int iMCUsPerRow = (iWidth + iMCUWidth - 1) / iMCUWidth;
+    const int iMCURows = (iHeight + iMCUHeight - 1) / iMCUHeight;
+    if (iMaxBands > JPEG_MAX_BANDS)
+        iMaxBands = JPEG_MAX_BANDS;
+    if (iMaxBands > iMCURows)
+        iMaxBands = iMCURows;
+    if (!iRestart)
+        iMaxBands = 1;
+
+    // Cut at the first restart marker on an MCU row boundary at or past each
+    // band's share of the rows. Markers are the only 0xff bytes not followed
+    // by a stuffed 0 in the entropy coded data.
+    int iBand = 0, iRestarts = 0, iTarget = iMCURows / iMaxBands;
+    pBands->band[0].iStart = iHeaderSize;
+    iPos = iHeaderSize;
+    while (iBand + 1 < iMaxBands)
+    {
+        const uint8_t *p = (const uint8_t *)memchr(&pData[iPos], 0xff, iDataSize - iPos);
+        if (!p || p + 1 >= &pData[iDataSize])
+            break;
+        iPos = (int)(p - pData);
+        const uint8_t ucMarker = pData[iPos+1];
+        if (ucMarker == 0xff) // fill byte
+        {
+            iPos++;
+            continue;
+        }
+        if (ucMarker == 0xd9) // end of image
+            break;
+        if (ucMarker >= 0xd0 && ucMarker <= 0xd7)
+        {
+            const int iMCUs = ++iRestarts * iRestart;
+            const int iRow = iMCUs / iMCUsPerRow;
+            if (iMCUs % iMCUsPerRow == 0 && iRow >= iTarget && iRow < iMCURows)
+            {
+                pBands->band[iBand].iEnd = iPos;
+                iBand++;
+                pBands->band[iBand].iY = iRow * iMCUHeight;
+                pBands->band[iBand].iStart = iPos + 2;
+                iTarget = (iBand + 1) * iMCURows / iMaxBands;
+            }
+        }
+        iPos += 2;
+    }
+    pBands->band[iBand].iEnd = iDataSize;
+    pBands->iBands = iBand + 1;
+    for (int i = 0; i < pBands->iBands; i++)
+    {
+        JPEGBAND *pBand = &pBands->band[i];
+        pBand->iHeight = (i + 1 < pBands->iBands ? pBands->band[i+1].iY : iHeight) - pBand->iY;
+        pBand->pData = pData;
+        pBand->iHeaderSize = iHeaderSize;
+        pBand->iHeightOffset = iHeightOffset;
+    }
+    return pBands->iBands;
+} /* JPEG_findBands() */
+
+//
+// A band reads as a file of its own: the image header with the band's
+// height, then the band's entropy coded data
+//
+static void *bandOpen(const char *szFilename, int32_t *pFileSize)
+{
+    const JPEGBAND *pBand = (const JPEGBAND *)szFilename;
+    *pFileSize = pBand->iHeaderSize + pBand->iEnd - pBand->iStart;
+    return (void *)pBand;
+} /* bandOpen() */
+
+static void bandClose(void *pHandle)
+{
+} /* bandClose() */
+
+static int32_t bandRead(JPEGFILE *pFile, uint8_t *pBuf, int32_t iLen)
+{
+    const JPEGBAND *pBand = (const JPEGBAND *)pFile->fHandle;
+    int32_t iBytesRead = 0;
+
+    if (iLen > pFile->iSize - pFile->iPos)
+        iLen = pFile->iSize - pFile->iPos;
+    if (iLen <= 0)
+        return 0;
+    if (pFile->iPos < pBand->iHeaderSize)
+    {
+        int32_t iCount = pBand->iHeaderSize - pFile->iPos;
+        if (iCount > iLen)
+            iCount = iLen;
+        memcpy(pBuf, &pBand->pData[pFile->iPos], iCount);
+        for (int i = 0; i < 2; i++)
+        {
+            const int iOffset = pBand->iHeightOffset + i - pFile->iPos;
+            if (iOffset >= 0 && iOffset < iCount)
+                pBuf[iOffset] = (uint8_t)(i ? pBand->iHeight : pBand->iHeight >> 8);
+        }
+        pFile->iPos += iCount;
+        pBuf += iCount;
+        iLen -= iCount;
+        iBytesRead = iCount;
+    }
+    if (iLen > 0)
+    {
+        memcpy(pBuf, &pBand->pData[pBand->iStart + pFile->iPos - pBand->iHeaderSize], iLen);
+        pFile->iPos += iLen;
+        iBytesRead += iLen;
+    }
+    return iBytesRead;
+} /* bandRead() */
+
+static int32_t bandSeek(JPEGFILE *pFile, int32_t iPosition)
+{
+    if (iPosition < 0)
+        iPosition = 0;
+    else if (iPosition >= pFile->iSize)
+        iPosition = pFile->iSize - 1;
+    pFile->iPos = iPosition;
+    return iPosition;
+} /* bandSeek() */
+
+int JPEG_openBand(JPEGDEC *pJPEG, const JPEGBAND *pBand, JPEG_DRAW_CALLBACK *pfnDraw)
+{
+    return pJPEG->open((const char *)pBand, bandOpen, bandClose, bandRead, bandSeek, pfnDraw);
+} /* JPEG_openBand() */
+
+//
+// Every iStep-th band, starting at iFirst
+//
+typedef struct band_worker_tag
+{
+    const JPEGBANDS *pBands;
+    int iFirst, iStep; // iFirst is also the worker index
+    JPEG_BAND_CALLBACK *pfnBand;
+    void *pUser;
+    int iResult;
+#ifdef ESP_PLATFORM
+    SemaphoreHandle_t done;
+#endif
+} BANDWORKER;
+
+static void runWorker(BANDWORKER *pWorker)
+{
+    pWorker->iResult = 1;
+    for (int i = pWorker->iFirst; i < pWorker->pBands->iBands; i += pWorker->iStep)
+        pWorker->iResult &= (*pWorker->pfnBand)(&pWorker->pBands->band[i], pWorker->iFirst, pWorker->pUser) ? 1 : 0;
+} /* runWorker() */
+
+#ifdef ESP_PLATFORM
+static void workerTask(void *pArg)
+{
+    BANDWORKER *pWorker = (BANDWORKER *)pArg;
+    runWorker(pWorker);
+    xSemaphoreGive(pWorker->done);
+    vTaskDelete(NULL);
+} /* workerTask() */
+#endif
+
+int JPEG_decodeBands(const JPEGBANDS *pBands, int iThreads, JPEG_BAND_CALLBACK *pfnBand, void *pUser)
+{
+    BANDWORKER workers[JPEG_MAX_BANDS];
+    int i, iResult = 1;
+
+    if (iThreads > pBands->iBands)
+        iThreads = pBands->iBands;
+    if (iThreads < 1)
+        iThreads = 1;
+    for (i = 0; i < iThreads; i++)
+    {
+        workers[i].pBands = pBands;
+        workers[i].iFirst = i;
+        workers[i].iStep = iThreads;
+        workers[i].pfnBand = pfnBand;
+        workers[i].pUser = pUser;
+    }
+#ifdef ESP_PLATFORM
+    SemaphoreHandle_t done = iThreads > 1 ? xSemaphoreCreateCounting(JPEG_MAX_BANDS, 0) : NULL;
+    int iStarted = 0;
+    if (done)
+    {
+        // Start with the other core, so two threads use both
+        for (i = 1; i < iThreads; i++)
+        {
+            workers[i].done = done;
+            if (xTaskCreatePinnedToCore(workerTask, "jpeg_band", JPEG_BAND_STACK_SIZE, &workers[i],
+                                        uxTaskPriorityGet(NULL), NULL,
+                                        (xPortGetCoreID() + i) % portNUM_PROCESSORS) != pdPASS)
+                break;
+            iStarted++;
+        }
+    }
+    // Bands of workers that could not be started run here
+    runWorker(&workers[0]);
+    iResult &= workers[0].iResult;
+    for (i = iStarted + 1; i < iThreads; i++)
+    {
+        runWorker(&workers[i]);
+        iResult &= workers[i].iResult;
+    }
+    for (i = 1; i <= iStarted; i++)
+    {
+        xSemaphoreTake(done, portMAX_DELAY);
+        iResult &= workers[i].iResult;
+    }
+    if (done)
+        vSemaphoreDelete(done);
+#else
+    std::thread threads[JPEG_MAX_BANDS];
+    for (i = 1; i < iThreads; i++)
+        threads[i] = std::thread(runWorker, &workers[i]);
+    runWorker(&workers[0]);
+    iResult &= workers[0].iResult;
+    for (i = 1; i < iThreads; i++)
+    {
+        threads[i].join();
+        iResult &= workers[i].iResult;
+    }
+#endif
+    return iResult;
+} /* JPEG_decodeBands() */
@@ -27,6 +27,7 @@ JPEG_STATIC int JPEGInit(JPEGIMAGE *pJPEG);
 JPEG_STATIC int JPEGParseInfo(JPEGIMAGE *pPage, int bExtractThumb);
 JPEG_STATIC void JPEGGetMoreData(JPEGIMAGE *pPage);
 JPEG_STATIC int DecodeJPEG(JPEGIMAGE *pImage);
+JPEG_STATIC int DecodeJPEGLumaDC(JPEGIMAGE *pJPEG, uint8_t *pDest, int iPitch, const uint8_t *pRowMask);
 
 // Include the C code which does the actual work
 #include "jpeg.inl"
@@ -39,6 +40,11 @@ void JPEGDEC::setPixelType(int iType)
         _jpeg.iError = JPEG_INVALID_PARAMETER;
 } /* setPixelType() */
 
+void JPEGDEC::setUserPointer(void *p)
+{
+    _jpeg.pUser = p;
+} /* setUserPointer() */
+
 void JPEGDEC::setMaxOutputSize(int iMaxMCUs)
 {
     if (iMaxMCUs < 1)
@@ -197,3 +203,19 @@ int JPEGDEC::decodeDither(uint8_t *pDither, int iOptions)
     _jpeg.pDitherBuffer = pDither;
     return DecodeJPEG(&_jpeg);
 }
+
+//
+// Decode the DC terms of the luma channel into an 8-bit image
+// of (width/8) x (height/8) pixels, iPitch bytes per line (0 = packed).
+// If pRowMask is not NULL, only lines with a nonzero mask byte are written
+// and decoding stops after the last such line.
+// The draw callback is not used.
+// returns:
+// 1 = good result
+// 0 = error
+//
+int JPEGDEC::decodeLumaDC(uint8_t *pDest, int iPitch, const uint8_t *pRowMask)
+{
+    _jpeg.iOptions = JPEG_SCALE_EIGHTH | JPEG_LUMA_ONLY;
+    return DecodeJPEGLumaDC(&_jpeg, pDest, iPitch, pRowMask);
+} /* decodeLumaDC() */
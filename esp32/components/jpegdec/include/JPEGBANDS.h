@@ -0,0 +1,78 @@
+//
+// Band-parallel decoding for JPEGDEC
+//
+// A baseline JPEG image with restart markers (a DRI segment) can be cut at
+// any marker that falls on the start of an MCU row: the DC predictions start
+// over there, so each band decodes on its own. JPEG_findBands() finds the
+// cut points in one scan for the markers, JPEG_openBand() opens one band
+// with a JPEGDEC instance as if it were a whole image, and
+// JPEG_decodeBands() runs a callback for every band on several threads -
+// FreeRTOS tasks spread over both cores on the ESP32, std::thread elsewhere.
+//
+// Images without restart markers are a single band.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+//
+#ifndef __JPEGBANDS__
+#define __JPEGBANDS__
+
+#include "JPEGDEC.h"
+
+#define JPEG_MAX_BANDS 8
+
+// Stack of each worker task on the ESP32; the callback should keep the
+// JPEGDEC instance on the heap
+#ifndef JPEG_BAND_STACK_SIZE
+#define JPEG_BAND_STACK_SIZE 4096
+#endif
+
+typedef struct jpeg_band_tag
+{
+    int iY, iHeight; // rows of the full size image in this band
+    uint8_t *pData; // the whole JPEG image
+    int iHeaderSize; // bytes from SOI to the end of the SOS segment
+    int iHeightOffset; // of the height in the SOF segment, replaced by iHeight
+    int iStart, iEnd; // entropy coded data of the band, without the markers around it
+} JPEGBAND;
+
+typedef struct jpeg_bands_tag
+{
+    int iWidth, iHeight; // image size
+    int iMCUHeight; // rows per MCU, 8 or 16
+    int iRestartInterval; // MCUs, 0 without restart markers
+    int iBands;
+    JPEGBAND band[JPEG_MAX_BANDS];
+} JPEGBANDS;
+
+// Called for each band by JPEG_decodeBands() with the index of the worker
+// running it, 0 to iThreads - 1; calls with the same index never overlap,
+// so the callback can keep a JPEGDEC instance per worker. Returns 1 on
+// success.
+typedef int (JPEG_BAND_CALLBACK)(const JPEGBAND *pBand, int iWorker, void *pUser);
+
+// Split the image into up to iMaxBands bands of about the same height.
+// Returns the number of bands, 1 if the image cannot be split, or 0 if it
+// is not a baseline JPEG image.
+int JPEG_findBands(uint8_t *pData, int iDataSize, int iMaxBands, JPEGBANDS *pBands);
+
+#ifdef __cplusplus
+// Open one band with pJPEG. Decode it with y set to pBand->iY >> scale so
+// the draw callback gets image coordinates; decodeLumaDC() writes from the
+// start of the band, row pBand->iY / 8 of the output.
+int JPEG_openBand(JPEGDEC *pJPEG, const JPEGBAND *pBand, JPEG_DRAW_CALLBACK *pfnDraw);
+#endif
+
+// Run pfnBand for every band on up to iThreads threads, the calling one
+// included. Returns 1 if every call succeeded.
+int JPEG_decodeBands(const JPEGBANDS *pBands, int iThreads, JPEG_BAND_CALLBACK *pfnBand, void *pUser);
+
+#endif // __JPEGBANDS__
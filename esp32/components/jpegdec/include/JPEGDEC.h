@@ -110,6 +110,7 @@ typedef struct jpeg_draw_tag
     int iWidth, iHeight; // size of this MCU
     int iBpp; // bit depth of the pixels (8 or 16)
     uint16_t *pPixels; // 16-bit pixels
+    void *pUser; // set with setUserPointer()
 } JPEGDRAW;
 
 // Callback function prototypes
@@ -177,6 +178,7 @@ typedef struct jpeg_image_tag
     int iVLCSize; // current quantity of data in the VLC buffer
     int iResInterval, iResCount; // restart interval
     int iMaxMCUs; // max MCUs of pixels per JPEGDraw call
+    void *pUser; // passed to the draw callback
     JPEG_READ_CALLBACK *pfnRead;
     JPEG_SEEK_CALLBACK *pfnSeek;
     JPEG_DRAW_CALLBACK *pfnDraw;
@@ -214,6 +216,7 @@ class JPEGDEC
     void close();
     int decode(int x, int y, int iOptions);
     int decodeDither(uint8_t *pDither, int iOptions);
+    int decodeLumaDC(uint8_t *pDest, int iPitch, const uint8_t *pRowMask = NULL); // (width/8) x (height/8) bytes, DC terms only; optional per-line mask
     int getOrientation();
     int getWidth();
     int getHeight();
@@ -225,6 +228,7 @@ class JPEGDEC
     int getLastError();
     void setPixelType(int iType); // defaults to little endian
     void setMaxOutputSize(int iMaxMCUs);
+    void setUserPointer(void *p); // after open(), which clears it
 
   private:
     JPEGIMAGE _jpeg;
@@ -237,6 +241,7 @@ int JPEG_getWidth(JPEGIMAGE *pJPEG);
 int JPEG_getHeight(JPEGIMAGE *pJPEG);
 int JPEG_decode(JPEGIMAGE *pJPEG, int x, int y, int iOptions);
 int JPEG_decodeDither(JPEGIMAGE *pJPEG, uint8_t *pDither, int iOptions);
+int JPEG_decodeLumaDC(JPEGIMAGE *pJPEG, uint8_t *pDest, int iPitch, const uint8_t *pRowMask);
 void JPEG_close(JPEGIMAGE *pJPEG);
 int JPEG_getLastError(JPEGIMAGE *pJPEG);
 int JPEG_getOrientation(JPEGIMAGE *pJPEG);
@@ -31,6 +31,7 @@ static int JPEGInit(JPEGIMAGE *pJPEG);
 static int JPEGParseInfo(JPEGIMAGE *pPage, int bExtractThumb);
 static void JPEGGetMoreData(JPEGIMAGE *pPage);
 static int DecodeJPEG(JPEGIMAGE *pImage);
+static int DecodeJPEGLumaDC(JPEGIMAGE *pJPEG, uint8_t *pDest, int iPitch, const uint8_t *pRowMask);
 static int32_t readRAM(JPEGFILE *pFile, uint8_t *pBuf, int32_t iLen);
 static int32_t seekMem(JPEGFILE *pFile, int32_t iPosition);
 #if defined (__MACH__) || defined( __LINUX__ ) || defined( __MCUXPRESSO )
@@ -586,6 +587,11 @@ int JPEG_decodeDither(JPEGIMAGE *pJPEG, uint8_t *pDither, int iOptions)
     return DecodeJPEG(pJPEG);
 } /* JPEG_decodeDither() */
 
+int JPEG_decodeLumaDC(JPEGIMAGE *pJPEG, uint8_t *pDest, int iPitch, const uint8_t *pRowMask)
+{
+    return DecodeJPEGLumaDC(pJPEG, pDest, iPitch, pRowMask);
+} /* JPEG_decodeLumaDC() */
+
 void JPEG_close(JPEGIMAGE *pJPEG)
 {
     if (pJPEG->pfnClose)
@@ -3185,6 +3191,7 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
     uint8_t c;
     int iMCUCount, xoff, iPitch, bThumbnail = 0;
     int bContinue = 1; // early exit if the DRAW callback wants to stop
+    int bLumaOnly = 0; // skip the chroma IDCT (grayscale output only)
     uint32_t l, *pl;
     unsigned char cDCTable0, cACTable0, cDCTable1, cACTable1, cDCTable2, cACTable2;
     JPEGDRAW jd;
@@ -3201,6 +3208,16 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
         if (!JPEGParseInfo(pJPEG, 1)) // parse the embedded thumbnail file header
             return 0; // something went wrong
     }
+    // Luma only output needs no color conversion, so it requires 8-bit grayscale pixels
+    if (pJPEG->iOptions & JPEG_LUMA_ONLY)
+    {
+        if (pJPEG->ucPixelType != EIGHT_BIT_GRAYSCALE)
+        {
+            pJPEG->iError = JPEG_INVALID_PARAMETER;
+            return 0;
+        }
+        bLumaOnly = 1;
+    }
     // Fast downscaling options
     if (pJPEG->iOptions & JPEG_SCALE_HALF)
         iScaleShift = 1;
@@ -3313,6 +3330,7 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
         jd.pPixels = (uint16_t *)pJPEG->pDitherBuffer;
     else
         jd.pPixels = pJPEG->usPixels;
+    jd.pUser = pJPEG->pUser;
     jd.iHeight = mcuCY;
     jd.y = pJPEG->iYOffset;
     for (y = 0; y < cy && bContinue && iErr == 0; y++, jd.y += mcuCY)
@@ -3394,7 +3412,9 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
                 pJPEG->ucACTable = cACTable1;
                 pJPEG->ucDCTable = cDCTable1;
                 iErr |= JPEGDecodeMCU(pJPEG, iCr, &iDCPred1);
-                if (pJPEG->ucMaxACCol == 0 || bThumbnail) // no AC components, save some time
+                if (bLumaOnly) // chroma only decoded to keep the bitstream in sync
+                    ;
+                else if (pJPEG->ucMaxACCol == 0 || bThumbnail) // no AC components, save some time
                 {
                     c = ucRangeTable[((iDCPred1 * iQuant2) >> 5) & 0x3ff];
                     l = c | ((uint32_t) c << 8) | ((uint32_t) c << 16) | ((uint32_t) c << 24);
@@ -3411,7 +3431,9 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
                 pJPEG->ucACTable = cACTable2;
                 pJPEG->ucDCTable = cDCTable2;
                 iErr |= JPEGDecodeMCU(pJPEG, iCb, &iDCPred2);
-                if (pJPEG->ucMaxACCol == 0 || bThumbnail) // no AC components, save some time
+                if (bLumaOnly)
+                    ;
+                else if (pJPEG->ucMaxACCol == 0 || bThumbnail) // no AC components, save some time
                 {
                     c = ucRangeTable[((iDCPred2 * iQuant3) >> 5) & 0x3ff];
                     l = c | ((uint32_t) c << 8) | ((uint32_t) c << 16) | ((uint32_t) c << 24);
@@ -3486,3 +3508,226 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
         pJPEG->iError = JPEG_DECODE_ERROR;
     return (iErr == 0);
 } /* DecodeJPEG() */
+//
+// Decode only the DC coefficient of the current DCT block
+// The AC codes are parsed just far enough to skip over them
+//
+static int JPEGDecodeMCUDC(JPEGIMAGE *pJPEG, int *iDCPredictor)
+{
+    uint32_t ulCode, ulTemp;
+    signed char cCoeff;
+    unsigned short *pFast;
+    unsigned char ucHuff, *pucFast;
+    uint32_t usHuff;
+    uint32_t ulBitOff, ulBits; // local copies to allow compiler to use register vars
+    uint8_t *pBuf;
+    int iCoeff;
+
+    ulBitOff = pJPEG->bb.ulBitOff;
+    ulBits = pJPEG->bb.ulBits;
+    pBuf = pJPEG->bb.pBuf;
+
+    if (ulBitOff > (REGISTER_WIDTH-17)) // need to get more data
+    {
+        pBuf += (ulBitOff >> 3);
+        ulBitOff &= 7;
+        ulBits = MOTOLONG(pBuf);
+    }
+    // get the DC component (same as JPEGDecodeMCU)
+    pucFast = &pJPEG->ucHuffDC[pJPEG->ucDCTable * DC_TABLE_SIZE];
+    ulCode = (ulBits >> (REGISTER_WIDTH - 12 - ulBitOff)) & 0xfff;
+    if (ulCode >= 0xf80) // it's a long code
+        ulCode = (ulCode & 0xff);
+    else
+        ulCode >>= 6;
+    ucHuff = pucFast[ulCode];
+    cCoeff = (signed char)pucFast[ulCode+512];
+    if (ucHuff == 0) // invalid code
+        return -1;
+    ulBitOff += (ucHuff >> 4);
+    ucHuff &= 0xf;
+    if (ucHuff)
+    {
+        if (cCoeff)
+        {
+            (*iDCPredictor) += cCoeff;
+        }
+        else
+        {
+            if (ulBitOff > (REGISTER_WIDTH - 17))
+            {
+                pBuf += (ulBitOff >> 3);
+                ulBitOff &= 7;
+                ulBits = MOTOLONG(pBuf);
+            }
+            ulCode = ulBits << ulBitOff;
+            ulTemp = ~(uint32_t)(((int32_t)ulCode)>>31);
+            ulCode >>= (REGISTER_WIDTH - ucHuff);
+            ulCode -= ulTemp>>(REGISTER_WIDTH-ucHuff);
+            ulBitOff += ucHuff;
+            (*iDCPredictor) += (int)ulCode;
+        }
+    }
+    // Skip the 63 AC coefficients: only the code lengths and run lengths matter
+    pFast = &pJPEG->usHuffAC[pJPEG->ucACTable * HUFF11SIZE];
+    for (iCoeff = 1; iCoeff < 64; iCoeff++)
+    {
+        if (ulBitOff > (REGISTER_WIDTH - 17))
+        {
+            pBuf += (ulBitOff >> 3);
+            ulBitOff &= 7;
+            ulBits = MOTOLONG(pBuf);
+        }
+        ulCode = (ulBits >> (REGISTER_WIDTH - 16 - ulBitOff)) & 0xffff;
+        if (pJPEG->b11Bit) // 11-bit "slow" tables used
+        {
+            if (ulCode >= 0xf000)
+                ulCode = (ulCode & 0x1fff);
+            else
+                ulCode >>= 4;
+        }
+        else
+        {
+            if (ulCode >= 0xfc00)
+                ulCode = (ulCode & 0x7ff);
+            else
+                ulCode >>= 6;
+        }
+        usHuff = pFast[ulCode];
+        if (usHuff == 0) // invalid code
+            return -1;
+        ulBitOff += (usHuff >> 8); // add length
+        usHuff &= 0xff;
+        if (usHuff == 0) // EOB
+            break;
+        iCoeff += (usHuff >> 4); // skip the zero run (RRRR)
+        ulBitOff += (usHuff & 0xf); // and the extra bits (SSSS)
+    }
+    pJPEG->bb.pBuf = pBuf;
+    pJPEG->iVLCOff = (int)(pBuf - pJPEG->ucFileBuf);
+    pJPEG->bb.ulBitOff = ulBitOff;
+    pJPEG->bb.ulBits = ulBits;
+    return 0;
+} /* JPEGDecodeMCUDC() */
+//
+// Decode the DC coefficients of the luma blocks into a (width/8) x (height/8)
+// 8-bit grayscale image, iPitch bytes per line (0 = packed). No draw callback is used.
+// Produces the same pixels as JPEG_SCALE_EIGHTH with EIGHT_BIT_GRAYSCALE output.
+// If pRowMask is given it has one byte per output line; lines where it is 0 are
+// not written, and decoding stops after the MCU row holding the last wanted line
+// (earlier rows must still be entropy decoded to keep the DC predictors right).
+//
+static int DecodeJPEGLumaDC(JPEGIMAGE *pJPEG, uint8_t *pDest, int iPitch, const uint8_t *pRowMask)
+{
+    int cx, cy, x, y, i, iErr;
+    int iOutCX, iOutCY, iBlocksX, iBlocksY, iLumBlocks, iChromaBlocks;
+    signed int iDCPred0, iDCPred1, iDCPred2;
+    int iQuant1;
+    unsigned char cDCTable0, cACTable0, cDCTable1, cACTable1, cDCTable2, cACTable2;
+
+    if (pDest == NULL)
+    {
+        pJPEG->iError = JPEG_INVALID_PARAMETER;
+        return 0;
+    }
+    JPEGFixQuantD(pJPEG);
+    pJPEG->bb.ulBits = MOTOLONG(&pJPEG->ucFileBuf[0]); // preload first 4 bytes
+    pJPEG->bb.pBuf = pJPEG->ucFileBuf;
+    pJPEG->bb.ulBitOff = 0;
+
+    cDCTable0 = pJPEG->JPCI[0].dc_tbl_no;
+    cACTable0 = pJPEG->JPCI[0].ac_tbl_no;
+    cDCTable1 = pJPEG->JPCI[1].dc_tbl_no;
+    cACTable1 = pJPEG->JPCI[1].ac_tbl_no;
+    cDCTable2 = pJPEG->JPCI[2].dc_tbl_no;
+    cACTable2 = pJPEG->JPCI[2].ac_tbl_no;
+    iDCPred0 = iDCPred1 = iDCPred2 = 0;
+
+    switch (pJPEG->ucSubSample)
+    {
+        case 0x00:
+        case 0x01:
+        case 0x11:
+            iBlocksX = iBlocksY = 1;
+            break;
+        case 0x12:
+            iBlocksX = 1;
+            iBlocksY = 2;
+            break;
+        case 0x21:
+            iBlocksX = 2;
+            iBlocksY = 1;
+            break;
+        case 0x22:
+            iBlocksX = iBlocksY = 2;
+            break;
+        default:
+            pJPEG->iError = JPEG_UNSUPPORTED_FEATURE;
+            return 0;
+    }
+    iLumBlocks = iBlocksX * iBlocksY;
+    iChromaBlocks = (pJPEG->ucSubSample && pJPEG->ucNumComponents == 3) ? 2 : 0;
+    cx = (pJPEG->iWidth + iBlocksX*8 - 1) / (iBlocksX*8); // number of MCUs
+    cy = (pJPEG->iHeight + iBlocksY*8 - 1) / (iBlocksY*8);
+    iOutCX = pJPEG->iWidth >> 3;
+    iOutCY = pJPEG->iHeight >> 3;
+    if (iPitch == 0)
+        iPitch = iOutCX;
+    else if (iPitch < iOutCX)
+    {
+        pJPEG->iError = JPEG_INVALID_PARAMETER;
+        return 0;
+    }
+    if (pRowMask)
+    {
+        for (i = iOutCY - 1; i >= 0 && !pRowMask[i]; i--)
+            ;
+        cy = (i + iBlocksY) / iBlocksY; // MCU rows up to and including line i
+    }
+    iQuant1 = pJPEG->sQuantTable[pJPEG->JPCI[0].quant_tbl_no*DCTSIZE];
+    iErr = 0;
+    pJPEG->iResCount = pJPEG->iResInterval;
+    for (y = 0; y < cy && iErr == 0; y++)
+    {
+        for (x = 0; x < cx && iErr == 0; x++)
+        {
+            pJPEG->ucACTable = cACTable0;
+            pJPEG->ucDCTable = cDCTable0;
+            // luma blocks are stored left to right, top to bottom
+            for (i = 0; i < iLumBlocks; i++)
+            {
+                int iX = x * iBlocksX + (i % iBlocksX);
+                int iY = y * iBlocksY + (i / iBlocksX);
+                iErr |= JPEGDecodeMCUDC(pJPEG, &iDCPred0);
+                if (iX < iOutCX && iY < iOutCY && (!pRowMask || pRowMask[iY]))
+                    pDest[iY * iPitch + iX] = ucRangeTable[((iDCPred0 * iQuant1) >> 5) & 0x3ff];
+            }
+            if (iChromaBlocks)
+            {
+                pJPEG->ucACTable = cACTable1;
+                pJPEG->ucDCTable = cDCTable1;
+                iErr |= JPEGDecodeMCUDC(pJPEG, &iDCPred1);
+                pJPEG->ucACTable = cACTable2;
+                pJPEG->ucDCTable = cDCTable2;
+                iErr |= JPEGDecodeMCUDC(pJPEG, &iDCPred2);
+            }
+            if (pJPEG->iResInterval)
+            {
+                if (--pJPEG->iResCount == 0)
+                {
+                    pJPEG->iResCount = pJPEG->iResInterval;
+                    iDCPred0 = iDCPred1 = iDCPred2 = 0; // reset DC predictors
+                    if (pJPEG->bb.ulBitOff & 7) // need to start at the next even byte
+                    {
+                        pJPEG->bb.ulBitOff += (8 - (pJPEG->bb.ulBitOff & 7));
+                    }
+                }
+            }
+            if (pJPEG->iVLCOff >= FILE_HIGHWATER)
+                JPEGGetMoreData(pJPEG); // need more 'filtered' VLC data
+        } // for x
+    } // for y
+    if (iErr != 0)
+        pJPEG->iError = JPEG_DECODE_ERROR;
+    return (iErr == 0);
+} /* DecodeJPEGLumaDC() */
@@ -31,6 +31,7 @@ static inline int gpio_ll_get_level(gpio_dev_t *hw, int gpio_num)
 }
 #endif
 #include "ll_cam.h"
+#include "ll_cam_dma.h"
 #include "xclk.h"
 #include "cam_hal.h"
 
@@ -53,16 +54,6 @@ static const char *TAG = "esp32 ll_cam";
 #define I2S_ISR_ENABLE(i) {I2S0.int_clr.i = 1;I2S0.int_ena.i = 1;}
 #define I2S_ISR_DISABLE(i) {I2S0.int_ena.i = 0;I2S0.int_clr.i = 1;}
 
-typedef union {
-    struct {
-        uint32_t sample2:8;
-        uint32_t unused2:8;
-        uint32_t sample1:8;
-        uint32_t unused1:8;
-    };
-    uint32_t val;
-} dma_elem_t;
-
 typedef enum {
     /* camera sends byte sequence: s1, s2, s3, s4, ...
      * fifo receives: 00 s1 00 s2, 00 s2 00 s3, 00 s3 00 s4, ...
@@ -99,19 +90,7 @@ static size_t ll_cam_bytes_per_sample(i2s_sampling_mode_t mode)
 
 static size_t IRAM_ATTR ll_cam_dma_filter_jpeg(uint8_t* dst, const uint8_t* src, size_t len)
 {
-    const dma_elem_t* dma_el = (const dma_elem_t*)src;
-    size_t elements = len / sizeof(dma_elem_t);
-    size_t end = elements / 4;
-    // manually unrolling 4 iterations of the loop here
-    for (size_t i = 0; i < end; ++i) {
-        dst[0] = dma_el[0].sample1;
-        dst[1] = dma_el[1].sample1;
-        dst[2] = dma_el[2].sample1;
-        dst[3] = dma_el[3].sample1;
-        dma_el += 4;
-        dst += 4;
-    }
-    return elements;
+    return ll_cam_dma_samples(dst, src, len);
 }
 
 static size_t IRAM_ATTR ll_cam_dma_filter_grayscale(uint8_t* dst, const uint8_t* src, size_t len)
@@ -468,8 +447,11 @@ bool ll_cam_dma_sizes(cam_obj_t *cam)
 {
     cam->dma_bytes_per_item = ll_cam_bytes_per_sample(sampling_mode);
     if (cam->jpeg_mode) {
-        cam->dma_half_buffer_cnt = 8;
-        cam->dma_node_buffer_size = 2048;
+        // Nodes close to the 4095 byte descriptor limit (and a multiple of
+        // four elements) halve the number of EOF events and copies per
+        // frame for the same 32 KB of DMA memory
+        cam->dma_half_buffer_cnt = 4;
+        cam->dma_node_buffer_size = 4080;
         cam->dma_half_buffer_size = cam->dma_node_buffer_size * 2;
         cam->dma_buffer_size = cam->dma_half_buffer_cnt * cam->dma_half_buffer_size;
     } else {
@@ -0,0 +1,87 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief One 32-bit word of the I2S DMA buffer, holding up to two camera bytes
+ */
+typedef union {
+    struct {
+        uint32_t sample2:8;
+        uint32_t unused2:8;
+        uint32_t sample1:8;
+        uint32_t unused1:8;
+    };
+    uint32_t val;
+} dma_elem_t;
+
+/**
+ * @brief Copy sample1 of each DMA element, one byte store at a time
+ *
+ * @return Number of elements, len / 4; whole groups of four are copied
+ */
+static inline __attribute__((always_inline)) size_t ll_cam_dma_samples_bytes(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    const dma_elem_t *dma_el = (const dma_elem_t *)src;
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t end = elements / 4;
+    // manually unrolling 4 iterations of the loop here
+    for (size_t i = 0; i < end; ++i) {
+        dst[0] = dma_el[0].sample1;
+        dst[1] = dma_el[1].sample1;
+        dst[2] = dma_el[2].sample1;
+        dst[3] = dma_el[3].sample1;
+        dma_el += 4;
+        dst += 4;
+    }
+    return elements;
+}
+
+/**
+ * @brief Copy sample1 of each DMA element like ll_cam_dma_samples_bytes()
+ *
+ * The frame buffer is usually in PSRAM, where one 32-bit store is much
+ * cheaper than four byte stores, so four samples are packed per word when
+ * dst is word aligned.
+ */
+static inline __attribute__((always_inline)) size_t ll_cam_dma_samples(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    if (((uintptr_t)dst & 3) != 0) {
+        return ll_cam_dma_samples_bytes(dst, src, len);
+    }
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t end = elements / 4;
+    uint32_t *dst_word = (uint32_t *)dst;
+    const uint32_t *el = (const uint32_t *)src;
+    for (size_t i = 0; i < end; ++i) {
+        dst_word[i] = ((el[0] >> 16) & 0x000000FF) |
+                      ((el[1] >> 8)  & 0x0000FF00) |
+                      ( el[2]        & 0x00FF0000) |
+                      ((el[3] << 8)  & 0xFF000000);
+        el += 4;
+    }
+    return elements;
+}
+
+#ifdef __cplusplus
+}
+#endif
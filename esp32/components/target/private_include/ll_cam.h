@@ -88,6 +88,8 @@ typedef enum {
 typedef struct {
     camera_fb_t fb;
     uint8_t en;
+    //for JPEG mode: offset of the last EOI marker copied so far, or -1
+    int jpeg_eoi;
     //for RGB/YUV modes
     lldesc_t *dma;
     size_t fb_offset;
@@ -108,9 +110,19 @@ typedef struct {
 
     cam_frame_t *frames;
 
-    QueueHandle_t event_queue;
+    //events from the ISRs to cam_task, oldest first: bit (n % 32) of
+    //event_bits is set if event n is VSYNC and clear if it is EOF
+    portMUX_TYPE event_lock;    //serializes the ISRs, which may run on different cores
+    uint32_t event_bits;
+    uint32_t event_head;        //written by the ISRs
+    uint32_t event_tail;        //written by cam_task
+    uint32_t eof_posted;        //written by the ISRs
+    uint32_t eof_taken;         //written by cam_task
+    uint32_t eof_limit;         //EOF events that may be pending before the DMA buffer is overrun
     QueueHandle_t frame_buffer_queue;
     TaskHandle_t task_handle;
+    bool task_stop;                     //set to ask cam_task to exit
+    SemaphoreHandle_t task_stopped;     //given by cam_task once it no longer touches the driver
     intr_handle_t cam_intr_handle;
 
     uint8_t dma_num;//ESP32-S3
@@ -119,6 +131,7 @@ typedef struct {
     gdma_channel_handle_t dma_channel_handle;//ESP32-S3
 #endif
 
+    pixformat_t pix_format;
     uint8_t jpeg_mode;
     uint8_t vsync_pin;
     uint8_t vsync_invert;
@@ -139,8 +152,17 @@ typedef struct {
     uint8_t fb_bytes_per_pixel;
 #endif
     uint32_t fb_size;
+    uint32_t fb_alloc_size;     //bytes allocated for each frame buffer
 
     cam_state_t state;
+
+    //raw lines consumer, see esp_camera_set_lines_callback(); set under event_lock
+    camera_lines_cb_t lines_cb;
+    void *lines_arg;
+
+    //each counter is only written from one context (ISR, cam_task or cam_take)
+    camera_drop_stats_t drop_stats;
+    uint32_t frame_seq;
 } cam_obj_t;
 
 
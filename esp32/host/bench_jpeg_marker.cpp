@@ -0,0 +1,177 @@
+// Compares the word-at-a-time JPEG marker scan in
+// components/driver/jpeg_marker.c against the earlier byte-wise
+// memcmp scan from cam_hal.c, on synthetic frames of various sizes.
+// Every result is checked against the earlier scan, including the
+// incremental EOI search fed one DMA half-buffer at a time.
+//
+//   bench_jpeg_marker [iterations]
+
+#include "jpeg_marker.h"
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Bounds tightened so short buffers and a marker at offset 0 are handled
+namespace legacy
+{
+
+static const uint32_t JPEG_SOI_MARKER = 0xFFD8FF;
+static const uint16_t JPEG_EOI_MARKER = 0xD9FF;
+
+int find_soi(const uint8_t* inbuf, uint32_t length)
+{
+    for (uint32_t i = 0; i + 3 <= length; i++)
+        if (memcmp(&inbuf[i], &JPEG_SOI_MARKER, 3) == 0)
+            return i;
+    return -1;
+}
+
+int find_eoi(const uint8_t* inbuf, uint32_t length)
+{
+    if (length < 2)
+        return -1;
+    const uint8_t* dptr = inbuf + length - 2;
+    while (dptr >= inbuf)
+    {
+        if (memcmp(dptr, &JPEG_EOI_MARKER, 2) == 0)
+            return dptr - inbuf;
+        dptr--;
+    }
+    return -1;
+}
+
+} // namespace legacy
+
+// Half-buffer size used by cam_hal for JPEG at the default settings
+constexpr const size_t HALF_BUFFER_SIZE = 2048;
+
+/// A frame as it lands in the frame buffer: SOI and header, entropy
+/// coded data with stuffed 0xFF bytes and restart markers, EOI, then
+/// padding_size bytes clocked in after the image, rounded up to a whole
+/// number of half-buffers.
+static std::vector<uint8_t> make_frame(size_t jpeg_size, size_t padding_size, uint8_t padding,
+                                       std::mt19937& rng)
+{
+    std::vector<uint8_t> frame = { 0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10 };
+    std::uniform_int_distribution<int> byte(0, 255);
+    int restart = 0;
+    while (frame.size() < jpeg_size - 2)
+    {
+        const uint8_t b = byte(rng);
+        frame.push_back(b);
+        if (b == 0xFF)
+            frame.push_back(0x00);
+        if (frame.size() % 1024 == 0)
+        {
+            frame.push_back(0xFF);
+            frame.push_back(0xD0 + (restart++ & 7));
+        }
+    }
+    frame.push_back(0xFF);
+    frame.push_back(0xD9);
+    const size_t total = (frame.size() + padding_size + HALF_BUFFER_SIZE - 1)/HALF_BUFFER_SIZE*HALF_BUFFER_SIZE;
+    frame.resize(total, padding);
+    return frame;
+}
+
+static int track_eoi(const uint8_t* buf, size_t len, size_t step)
+{
+    int eoi = -1;
+    for (size_t from = 0; from < len; from += step)
+        eoi = jpeg_update_eoi(buf, from, from + step < len ? from + step : len, eoi);
+    return eoi;
+}
+
+template<typename F>
+static double time_us(int iterations, F f)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        f();
+    const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count()/iterations;
+}
+
+static volatile int sink;
+
+int main(int argc, char** argv)
+{
+    const int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    std::mt19937 rng(1);
+    int failed = 0;
+
+    // Edge cases: markers at either end, split markers, nothing at all
+    const std::vector<std::vector<uint8_t>> edge_cases = {
+        {},
+        { 0xFF },
+        { 0xFF, 0xD9 },
+        { 0xFF, 0xD8, 0xFF },
+        { 0x00, 0xFF, 0xD8 },
+        { 0xFF, 0xFF, 0xD8, 0xFF, 0xD9, 0xFF },
+        { 0x00, 0x00, 0x00, 0xFF, 0xD9, 0x00, 0x00, 0x00, 0x00, 0xFF },
+        std::vector<uint8_t>(37, 0xFF),
+        std::vector<uint8_t>(37, 0x00),
+    };
+    for (size_t c = 0; c < edge_cases.size(); ++c)
+        for (size_t shift = 0; shift < 4; ++shift)
+        {
+            // Place the data at every alignment
+            std::vector<uint8_t> buf(edge_cases[c].size() + 4);
+            memcpy(buf.data() + shift, edge_cases[c].data(), edge_cases[c].size());
+            const uint8_t* p = buf.data() + shift;
+            const size_t len = edge_cases[c].size();
+            for (size_t step = 1; step <= 5; ++step)
+                if (jpeg_find_soi(p, len) != legacy::find_soi(p, len) ||
+                    jpeg_find_eoi(p, len) != legacy::find_eoi(p, len) ||
+                    track_eoi(p, len, step) != legacy::find_eoi(p, len))
+                {
+                    fprintf(stderr, "Edge case %zu shift %zu step %zu differs\n", c, shift, step);
+                    ++failed;
+                }
+        }
+
+    printf("%8s %8s %7s %12s %12s %12s %12s %12s\n",
+           "frame", "padding", "value", "soi old us", "soi new us", "eoi old us", "eoi new us", "tracked us");
+    for (size_t size : { 8*1024, 24*1024, 64*1024, 160*1024, 384*1024 })
+        for (size_t padding_size : { size_t(0), size/2 })
+        for (uint8_t padding : { 0x00, 0xFF })
+        {
+            auto frame = make_frame(size, padding_size, padding, rng);
+            const uint8_t* buf = frame.data();
+            const size_t len = frame.size();
+            const int expected_eoi = legacy::find_eoi(buf, len);
+            if (jpeg_find_soi(buf, len) != 0 ||
+                jpeg_find_eoi(buf, len) != expected_eoi ||
+                track_eoi(buf, len, HALF_BUFFER_SIZE) != expected_eoi ||
+                track_eoi(buf, len, 1001) != expected_eoi)
+            {
+                fprintf(stderr, "Frame of %zu bytes differs\n", size);
+                ++failed;
+            }
+            // A frame that does not start with SOI is scanned to the end
+            frame[0] = 0;
+            const double soi_old = time_us(iterations, [&] { sink = legacy::find_soi(buf, len); });
+            const double soi_new = time_us(iterations, [&] { sink = jpeg_find_soi(buf, len); });
+            if (jpeg_find_soi(buf, len) != legacy::find_soi(buf, len))
+            {
+                fprintf(stderr, "Frame of %zu bytes without SOI differs\n", size);
+                ++failed;
+            }
+            const double eoi_old = time_us(iterations, [&] { sink = legacy::find_eoi(buf, len); });
+            const double eoi_new = time_us(iterations, [&] { sink = jpeg_find_eoi(buf, len); });
+            const double tracked = time_us(iterations, [&] { sink = track_eoi(buf, len, HALF_BUFFER_SIZE); });
+            printf("%8zu %8zu %7s %12.2f %12.2f %12.2f %12.2f %12.2f\n",
+                   len, len - size, padding ? "0xff" : "0x00", soi_old, soi_new, eoi_old, eoi_new, tracked);
+        }
+
+    if (failed)
+    {
+        fprintf(stderr, "FAILED: %d mismatches\n", failed);
+        return 1;
+    }
+    return 0;
+}
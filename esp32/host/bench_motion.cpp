@@ -0,0 +1,189 @@
+// Compares the motion downsampler in main/motion.cpp against the
+// earlier JPEGDEC draw callback based paths.
+
+#include "defs.h"
+#include "motion.h"
+
+#include "JPEGDEC.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+char config_s3_access_key[40];
+char config_s3_secret_key[40];
+char config_gateway_token[80];
+int8_t config_instance_number = 0;
+int config_keepalive_secs = DEFAULT_KEEPALIVE_SECS;
+int config_pixel_threshold = DEFAULT_PIXEL_THRESHOLD;
+int config_percent_threshold = DEFAULT_PERCENT_THRESHOLD;
+int config_noise_sigmas = DEFAULT_NOISE_SIGMAS;
+int config_background_shift = DEFAULT_BACKGROUND_SHIFT;
+bool config_active = true;
+bool config_continuous = false;
+bool config_burst_upload = DEFAULT_BURST_UPLOAD;
+int config_target_fps = DEFAULT_TARGET_FPS;
+int config_target_frame_kb = DEFAULT_TARGET_FRAME_KB;
+bool config_dual_resolution = DEFAULT_DUAL_RESOLUTION;
+bool config_raw_motion = DEFAULT_RAW_MOTION;
+
+void downsample(const camera_fb_t* fb, uint8_t* buf);
+
+namespace legacy
+{
+
+constexpr const int FACTOR = 8;
+constexpr const int BUFSIZE_X = FRAMESIZE_X/FACTOR;
+constexpr const int BUFSIZE_Y = FRAMESIZE_Y/FACTOR;
+constexpr const int X_FACTOR = 4;
+constexpr const int BUFFER_BYTESIZE = BUFSIZE_X/X_FACTOR * BUFSIZE_Y;
+
+static uint8_t* draw_cb_buf = nullptr;
+
+int draw_cb(JPEGDRAW* draw)
+{
+    uint8_t* p = draw_cb_buf + draw->y * BUFSIZE_X / X_FACTOR;
+    int i = 0;
+    while (i < draw->iWidth)
+    {
+        int sum = 0;
+        for (int j = 0; j < X_FACTOR; ++j)
+        {
+            uint16_t pixel = draw->pPixels[i + j];
+            uint16_t red = ((pixel & 0xF800)>>11);
+            uint16_t green = ((pixel & 0x07E0)>>5);
+            uint16_t blue = (pixel & 0x001F);
+            uint16_t grayscale = 8*((0.2126 * red) + (0.7152 * green / 2.0) + (0.0722 * blue));
+            sum += grayscale;
+        }
+        *p++ = sum/X_FACTOR;
+        i += X_FACTOR;
+    }
+    return 1;
+}
+
+void downsample(const camera_fb_t* fb, uint8_t* buf)
+{
+    draw_cb_buf = buf;
+    JPEGDEC decoder;
+    decoder.openRAM(fb->buf, fb->len, draw_cb);
+    decoder.decode(0, 0, JPEG_SCALE_EIGHTH);
+}
+
+} // namespace legacy
+
+namespace luma
+{
+
+using legacy::BUFSIZE_X;
+using legacy::BUFSIZE_Y;
+using legacy::X_FACTOR;
+
+static uint8_t* draw_cb_buf = nullptr;
+
+int draw_cb(JPEGDRAW* draw)
+{
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(draw->pPixels);
+    const int out_width = draw->iWidth/X_FACTOR;
+    for (int row = 0; row < draw->iHeight; ++row)
+    {
+        const int y = draw->y + row;
+        if (y >= BUFSIZE_Y)
+            break;
+        const uint8_t* src = pixels + row * draw->iWidth;
+        uint8_t* p = draw_cb_buf + y * BUFSIZE_X / X_FACTOR + draw->x / X_FACTOR;
+        for (int i = 0; i < out_width; ++i)
+        {
+            *p++ = (src[0] + src[1] + src[2] + src[3]) >> 2;
+            src += X_FACTOR;
+        }
+    }
+    return 1;
+}
+
+void downsample(const camera_fb_t* fb, uint8_t* buf)
+{
+    draw_cb_buf = buf;
+    JPEGDEC decoder;
+    decoder.openRAM(fb->buf, fb->len, draw_cb);
+    decoder.setPixelType(EIGHT_BIT_GRAYSCALE);
+    decoder.decode(0, 0, JPEG_SCALE_EIGHTH | JPEG_LUMA_ONLY);
+}
+
+} // namespace luma
+
+static std::vector<uint8_t> read_file(const std::string& path)
+{
+    std::vector<uint8_t> data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+    return data;
+}
+
+template<typename F>
+static double time_per_frame_us(F&& f, int iterations)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        f();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+}
+
+int main(int argc, char** argv)
+{
+    const int iterations = argc > 1 ? atoi(argv[1]) : 500;
+    const char* pictures[] = { "testimg.jpeg", "test_inside.jpeg", "test_outside.jpeg" };
+
+    static uint8_t buf[legacy::BUFSIZE_X * legacy::BUFSIZE_Y];
+    static uint8_t ref[legacy::BUFSIZE_X * legacy::BUFSIZE_Y];
+    printf("%-20s %12s %12s %12s %8s\n", "image", "rgb565 us", "luma us", "dc us", "speedup");
+    for (auto name : pictures)
+    {
+        auto data = read_file(std::string(PICTURES_DIR) + "/" + name);
+        if (data.empty())
+        {
+            fprintf(stderr, "Cannot read %s\n", name);
+            return 1;
+        }
+        camera_fb_t fb = {};
+        fb.buf = data.data();
+        fb.len = data.size();
+        fb.format = PIXFORMAT_JPEG;
+
+        // The DC-only decoder must match the 1/8 scale luma output exactly
+        memset(ref, 0, sizeof(ref));
+        memset(buf, 0, sizeof(buf));
+        luma::downsample(&fb, ref);
+        downsample(&fb, buf);
+        JPEGDEC info;
+        info.openRAM(fb.buf, fb.len, nullptr);
+        const int out_width = info.getWidth()/legacy::FACTOR/legacy::X_FACTOR;
+        const int out_height = info.getHeight()/legacy::FACTOR;
+        bool match = true;
+        for (int y = 0; y < out_height; ++y)
+        {
+            const int offset = y * legacy::BUFSIZE_X/legacy::X_FACTOR;
+            match = match && !memcmp(ref + offset, buf + offset, out_width);
+        }
+        if (!match)
+        {
+            fprintf(stderr, "%s: DC-only output differs from luma decode\n", name);
+            return 1;
+        }
+
+        const auto t_legacy = time_per_frame_us([&] { legacy::downsample(&fb, buf); }, iterations);
+        const auto t_luma = time_per_frame_us([&] { luma::downsample(&fb, buf); }, iterations);
+        const auto t_dc = time_per_frame_us([&] { downsample(&fb, buf); }, iterations);
+        printf("%-20s %12.1f %12.1f %12.1f %7.2fx\n", name, t_legacy, t_luma, t_dc, t_legacy/t_dc);
+    }
+    return 0;
+}
@@ -0,0 +1,468 @@
+// Throughput of the image pipeline on the host: JPEG decode (JPEGDEC and
+// TJpgDec), the motion downsampler, frame differencing, JPEG encode and
+// the pixel format conversions, on the test pictures and on synthetic
+// UXGA frames. Run after a change to catch performance regressions:
+//
+//   ./bench_pipeline [--filter=<substring>] [--min_time=<seconds>]
+//
+// With --min_time=0 each benchmark runs once, which only checks that
+// every stage still works. Decoding is timed for each backend behind
+// jpg_decoder.h, and the table at the end shows which backend
+// jpg_decoder_calibrate() picks for each output and scale. The bands/
+// benchmarks decode a frame with a restart marker after every MCU row on
+// 1, 2 and 4 threads, and a second table shows the speedup.
+
+#include "defs.h"
+#include "framediff.h"
+
+#include "img_converters.h"
+#include "jpg_decoder.h"
+#include "jpge.h"
+#include "yuv.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+char config_s3_access_key[40];
+char config_s3_secret_key[40];
+char config_gateway_token[80];
+int8_t config_instance_number = 0;
+int config_keepalive_secs = DEFAULT_KEEPALIVE_SECS;
+int config_pixel_threshold = DEFAULT_PIXEL_THRESHOLD;
+int config_percent_threshold = DEFAULT_PERCENT_THRESHOLD;
+int config_noise_sigmas = DEFAULT_NOISE_SIGMAS;
+int config_background_shift = DEFAULT_BACKGROUND_SHIFT;
+bool config_active = true;
+bool config_continuous = false;
+bool config_burst_upload = DEFAULT_BURST_UPLOAD;
+int config_target_fps = DEFAULT_TARGET_FPS;
+int config_target_frame_kb = DEFAULT_TARGET_FRAME_KB;
+bool config_dual_resolution = DEFAULT_DUAL_RESOLUTION;
+bool config_raw_motion = DEFAULT_RAW_MOTION;
+
+void downsample(const camera_fb_t* fb, uint8_t* buf);
+
+/// A frame in one of the formats the camera delivers
+struct Frame
+{
+    std::string name;
+    std::vector<uint8_t> data;
+    int width;
+    int height;
+    pixformat_t format;
+
+    camera_fb_t fb()
+    {
+        camera_fb_t fb = {};
+        fb.buf = data.data();
+        fb.len = data.size();
+        fb.width = width;
+        fb.height = height;
+        fb.format = format;
+        return fb;
+    }
+};
+
+struct Benchmark
+{
+    std::string name;
+    size_t bytes;                   ///< Input bytes per iteration
+    std::function<bool()> run;      ///< Return false on failure
+};
+
+static std::vector<uint8_t> read_file(const std::string& path)
+{
+    std::vector<uint8_t> data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+    return data;
+}
+
+/// Gray level of the synthetic scene: gradients, a few boxes and some texture
+static int scene(int x, int y)
+{
+    int v = 40 + x/16 + y/12 + ((x*7 + y*13) & 15);
+    if (x >= 320 && x < 704 && y >= 200 && y < 520)
+        v += 80;
+    if (x >= 1000 && x < 1200 && y >= 800 && y < 1000)
+        v -= 30;
+    return v;
+}
+
+static Frame make_yuv422(int width, int height)
+{
+    Frame frame { "uxga", std::vector<uint8_t>(width * height * 2), width, height, PIXFORMAT_YUV422 };
+    uint8_t* p = frame.data.data();
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; x += 2)
+        {
+            *p++ = scene(x, y);
+            *p++ = 128 + (x - width/2)/16;      // U
+            *p++ = scene(x + 1, y);
+            *p++ = 128 + (y - height/2)/16;     // V
+        }
+    return frame;
+}
+
+static Frame make_rgb565(int width, int height)
+{
+    Frame frame { "uxga", std::vector<uint8_t>(width * height * 2), width, height, PIXFORMAT_RGB565 };
+    uint8_t* p = frame.data.data();
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            const int v = scene(x, y);
+            const uint16_t pixel = ((v >> 3) << 11) | ((v >> 2) << 5) | (v >> 3);
+            // Big endian, as the sensor sends it
+            *p++ = pixel >> 8;
+            *p++ = pixel & 0xFF;
+        }
+    return frame;
+}
+
+static Frame make_grayscale(int width, int height)
+{
+    Frame frame { "uxga", std::vector<uint8_t>(width * height), width, height, PIXFORMAT_GRAYSCALE };
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            frame.data[y * width + x] = scene(x, y);
+    return frame;
+}
+
+/// fmt2jpg() cuts its output at 128 KB, which a UXGA frame can exceed
+static size_t append_jpeg(void* arg, size_t index, const void* data, size_t len)
+{
+    auto out = static_cast<std::vector<uint8_t>*>(arg);
+    if (data)
+        out->insert(out->end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + len);
+    return len;
+}
+
+static bool encode(Frame& frame, int quality, std::vector<uint8_t>& out)
+{
+    out.clear();
+    return fmt2jpg_cb(frame.data.data(), frame.data.size(), frame.width, frame.height, frame.format,
+                      quality, append_jpeg, &out);
+}
+
+class vector_stream : public jpge::output_stream
+{
+public:
+    std::vector<uint8_t>& data;
+
+    explicit vector_stream(std::vector<uint8_t>& out) : data(out) { data.clear(); }
+
+    bool put_buf(const void* buf, int len) override
+    {
+        if (buf)
+            data.insert(data.end(), static_cast<const uint8_t*>(buf), static_cast<const uint8_t*>(buf) + len);
+        return true;
+    }
+
+    jpge::uint get_size() const override
+    {
+        return data.size();
+    }
+};
+
+/// Encode with a restart marker after every MCU row, which fmt2jpg() does not write
+static bool encode_with_restarts(const std::vector<uint8_t>& rgb, int width, int height, int quality,
+                                 std::vector<uint8_t>& out)
+{
+    jpge::params params;
+    params.m_quality = quality;
+    params.m_restart_mcu_rows = 1;
+    vector_stream stream(out);
+    jpge::jpeg_encoder encoder;
+    if (!encoder.init(&stream, width, height, 3, params))
+        return false;
+    for (int y = 0; y < height; ++y)
+        if (!encoder.process_scanline(&rgb[y * width * 3]))
+            return false;
+    return encoder.process_scanline(nullptr);
+}
+
+/// The route YUV422 took before jpge read it: each line converted to RGB888 first
+static bool encode_yuv422_via_rgb888(const Frame& frame, int quality, std::vector<uint8_t>& out)
+{
+    jpge::params params;
+    params.m_quality = quality;
+    vector_stream stream(out);
+    jpge::jpeg_encoder encoder;
+    if (!encoder.init(&stream, frame.width, frame.height, 3, params))
+        return false;
+    std::vector<uint8_t> line(frame.width * 3);
+    for (int y = 0; y < frame.height; ++y)
+    {
+        yuv422_to_rgb888(&frame.data[y * frame.width * 2], line.data(), frame.width);
+        if (!encoder.process_scanline(line.data()))
+            return false;
+    }
+    return encoder.process_scanline(nullptr);
+}
+
+/// Feed an encoder session 16 lines at a time, as the camera delivers them
+static bool encode_in_bands(Frame& frame, int quality, std::vector<uint8_t>& out)
+{
+    out.clear();
+    jpg_encoder_session_t* session = jpg_encoder_start(frame.width, frame.height, frame.format, quality,
+                                                       append_jpeg, &out);
+    if (!session)
+        return false;
+    const size_t line_len = frame.data.size() / frame.height;
+    for (int y = 0; y < frame.height; y += 16)
+        if (!jpg_encoder_write(session, &frame.data[y * line_len], std::min(16, frame.height - y)))
+            break;
+    return jpg_encoder_end(session);
+}
+
+static const char* const DECODER_NAMES[JPG_DECODER_MAX] = { "jpegdec", "tjpgd" };
+static const char* const OUTPUT_NAMES[JPG_OUTPUT_MAX] = { "luma", "rgb565", "rgb888" };
+
+static bool decode(jpg_decoder_t decoder, Frame& jpeg, jpg_output_t type, jpg_scale_t scale,
+                   std::vector<uint8_t>& out)
+{
+    jpg_decode_output_t o = {};
+    o.type = type;
+    o.scale = scale;
+    o.buf = out.data();
+    o.buf_size = out.size();
+    return jpg_decoder_decode(decoder, jpeg.data.data(), jpeg.data.size(), &o) == ESP_OK;
+}
+
+/// Run f for at least min_time seconds and print a Google Benchmark style line
+static bool run_benchmark(const Benchmark& b, double min_time, double* us)
+{
+    using clock = std::chrono::steady_clock;
+    long iterations = 0;
+    const auto start = clock::now();
+    double elapsed = 0;
+    do
+    {
+        if (!b.run())
+        {
+            printf("%-40s FAILED\n", b.name.c_str());
+            return false;
+        }
+        ++iterations;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < min_time);
+    *us = elapsed*1e6/iterations;
+    printf("%-40s %12.1f %10ld %10.1f\n", b.name.c_str(), *us, iterations, b.bytes/ *us);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    std::string filter;
+    double min_time = 0.5;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strncmp(argv[i], "--filter=", 9))
+            filter = argv[i] + 9;
+        else if (!strncmp(argv[i], "--min_time=", 11))
+            min_time = atof(argv[i] + 11);
+        else
+        {
+            fprintf(stderr, "Usage: %s [--filter=<substring>] [--min_time=<seconds>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // JPEG inputs: the test pictures, plus the synthetic scene encoded at full size
+    std::vector<Frame> jpegs;
+    for (auto name : { "testimg.jpeg", "test_inside.jpeg", "test_outside.jpeg" })
+    {
+        auto data = read_file(std::string(PICTURES_DIR) + "/" + name);
+        uint16_t width = 0;
+        uint16_t height = 0;
+        if (data.empty() || !jpg_get_size(data.data(), data.size(), &width, &height))
+        {
+            fprintf(stderr, "Cannot read %s\n", name);
+            return 1;
+        }
+        std::string base = name;
+        jpegs.push_back({ base.substr(0, base.find('.')), data, width, height, PIXFORMAT_JPEG });
+    }
+    auto yuv = make_yuv422(FRAMESIZE_X, FRAMESIZE_Y);
+    auto rgb565 = make_rgb565(FRAMESIZE_X, FRAMESIZE_Y);
+    auto gray = make_grayscale(FRAMESIZE_X, FRAMESIZE_Y);
+    std::vector<uint8_t> encoded;
+    if (!encode(yuv, 80, encoded))
+    {
+        fprintf(stderr, "Cannot encode the synthetic frame\n");
+        return 1;
+    }
+    jpegs.push_back({ "uxga", encoded, FRAMESIZE_X, FRAMESIZE_Y, PIXFORMAT_JPEG });
+
+    std::vector<uint8_t> rgb(FRAMESIZE_X * FRAMESIZE_Y * 3);
+    Frame restarts { "uxga_rst", {}, FRAMESIZE_X, FRAMESIZE_Y, PIXFORMAT_JPEG };
+    if (!fmt2rgb888(yuv.data.data(), yuv.data.size(), yuv.format, rgb.data()) ||
+        !encode_with_restarts(rgb, FRAMESIZE_X, FRAMESIZE_Y, 80, restarts.data))
+    {
+        fprintf(stderr, "Cannot encode the synthetic frame with restart markers\n");
+        return 1;
+    }
+    alignas(FRAMEDIFF_ALIGNMENT) static uint8_t image[FRAMESIZE_X/8 * FRAMESIZE_Y/8];
+    alignas(FRAMEDIFF_ALIGNMENT) static uint8_t reference[FRAMESIZE_X/8 * FRAMESIZE_Y/8];
+    std::vector<uint8_t> gray_shifted(gray.data.size());
+    for (size_t i = 0; i < gray.data.size(); ++i)
+        gray_shifted[i] = gray.data[i] + (i % 7);
+
+    std::vector<Benchmark> benchmarks;
+    for (auto& jpeg : jpegs)
+    {
+        const size_t size = jpeg.data.size();
+        // Every backend and output; all scales for the full size frame only
+        const int max_scale = jpeg.width == FRAMESIZE_X ? JPG_SCALE_MAX : JPG_SCALE_NONE;
+        for (int scale = 0; scale <= max_scale; ++scale)
+            for (int type = 0; type < JPG_OUTPUT_MAX; ++type)
+                for (int decoder = 0; decoder < JPG_DECODER_MAX; ++decoder)
+                {
+                    if (!jpg_decoder_supports(jpg_decoder_t(decoder), jpg_output_t(type), jpg_scale_t(scale)))
+                        continue;
+                    benchmarks.push_back({ std::string("decode/") + DECODER_NAMES[decoder] + "_" +
+                                           OUTPUT_NAMES[type] + "/" + jpeg.name + "/" +
+                                           std::to_string(1 << scale), size,
+                                           [&jpeg, &rgb, decoder, type, scale] {
+                                               return decode(jpg_decoder_t(decoder), jpeg, jpg_output_t(type),
+                                                             jpg_scale_t(scale), rgb);
+                                           } });
+                }
+        benchmarks.push_back({ "downsample/" + jpeg.name, size,
+                               [&] { auto fb = jpeg.fb(); downsample(&fb, image); return true; } });
+    }
+    const int THREADS[] = { 1, 2, 4 };
+    for (int type = JPG_OUTPUT_LUMA; type <= JPG_OUTPUT_RGB565; ++type)
+        for (int threads : THREADS)
+            benchmarks.push_back({ std::string("bands/") + OUTPUT_NAMES[type] + "/" + restarts.name + "/" +
+                                   std::to_string(threads), restarts.data.size(),
+                                   [&restarts, &rgb, type, threads] {
+                                       jpg_decoder_set_threads(threads);
+                                       const bool ok = decode(JPG_DECODER_JPEGDEC, restarts, jpg_output_t(type),
+                                                              JPG_SCALE_NONE, rgb);
+                                       jpg_decoder_set_threads(1);
+                                       return ok;
+                                   } });
+    benchmarks.push_back({ "downsample/raw_gray", gray.data.size() / 16,
+                           [&] {
+                               // The raw motion frame size: a quarter of the full size each way
+                               static auto raw = make_grayscale(RAW_MOTION_WIDTH, RAW_MOTION_HEIGHT);
+                               auto fb = raw.fb();
+                               downsample(&fb, image);
+                               return true;
+                           } });
+    benchmarks.push_back({ "diff/scalar/motion_image", sizeof(image),
+                           [&] { return count_changed_pixels_scalar(image, reference, sizeof(image), 10) >= 0; } });
+    benchmarks.push_back({ "diff/swar/motion_image", sizeof(image),
+                           [&] { return count_changed_pixels_swar(image, reference, sizeof(image), 10) >= 0; } });
+    benchmarks.push_back({ "diff/scalar/uxga_gray", gray.data.size(),
+                           [&] { return count_changed_pixels_scalar(gray.data.data(), gray_shifted.data(),
+                                                                    gray.data.size(), 3) > 0; } });
+    benchmarks.push_back({ "diff/swar/uxga_gray", gray.data.size(),
+                           [&] { return count_changed_pixels_swar(gray.data.data(), gray_shifted.data(),
+                                                                  gray.data.size(), 3) > 0; } });
+    // The per pixel lookup table the YUV422 conversions used, against the line converters
+    benchmarks.push_back({ "yuv422/table_rgb888/uxga", yuv.data.size(),
+                           [&yuv, &rgb] {
+                               const uint8_t* src = yuv.data.data();
+                               uint8_t* dst = rgb.data();
+                               for (size_t i = 0; i < yuv.data.size(); i += 4, src += 4, dst += 6)
+                               {
+                                   yuv2rgb(src[0], src[1], src[3], &dst[0], &dst[1], &dst[2]);
+                                   yuv2rgb(src[2], src[1], src[3], &dst[3], &dst[4], &dst[5]);
+                               }
+                               return true;
+                           } });
+    benchmarks.push_back({ "yuv422/line_rgb888/uxga", yuv.data.size(),
+                           [&yuv, &rgb] { yuv422_to_rgb888(yuv.data.data(), rgb.data(), yuv.data.size()/2); return true; } });
+    benchmarks.push_back({ "yuv422/line_rgb565/uxga", yuv.data.size(),
+                           [&yuv, &rgb] { yuv422_to_rgb565(yuv.data.data(), rgb.data(), yuv.data.size()/2); return true; } });
+    benchmarks.push_back({ "yuv422/line_gray/uxga", yuv.data.size(),
+                           [&yuv, &rgb] { yuv422_to_gray(yuv.data.data(), rgb.data(), yuv.data.size()/2); return true; } });
+    benchmarks.push_back({ "encode/yuv422_via_rgb888/uxga", yuv.data.size(),
+                           [&yuv, &encoded] { return encode_yuv422_via_rgb888(yuv, 12, encoded); } });
+    benchmarks.push_back({ "encode/yuv422_bands16/uxga", yuv.data.size(),
+                           [&yuv, &encoded] { return encode_in_bands(yuv, 12, encoded); } });
+    for (auto frame : { &yuv, &rgb565, &gray })
+    {
+        const char* format = frame->format == PIXFORMAT_YUV422 ? "yuv422" :
+            frame->format == PIXFORMAT_RGB565 ? "rgb565" : "gray";
+        benchmarks.push_back({ std::string("encode/") + format + "/uxga", frame->data.size(),
+                               [frame, &encoded] { return encode(*frame, 12, encoded); } });
+        benchmarks.push_back({ std::string("convert/") + format + "_rgb888/uxga", frame->data.size(),
+                               [frame, &rgb] { return fmt2rgb888(frame->data.data(), frame->data.size(),
+                                                                 frame->format, rgb.data()); } });
+        benchmarks.push_back({ std::string("convert/") + format + "_bmp/uxga", frame->data.size(),
+                               [frame] {
+                                   uint8_t* out = nullptr;
+                                   size_t out_len = 0;
+                                   const bool ok = fmt2bmp(frame->data.data(), frame->data.size(),
+                                                           frame->width, frame->height, frame->format,
+                                                           &out, &out_len);
+                                   free(out);
+                                   return ok;
+                               } });
+    }
+
+    auto fb = jpegs.back().fb();
+    downsample(&fb, reference);
+
+    printf("%-40s %12s %10s %10s\n", "Benchmark", "Time (us)", "Iterations", "MB/s");
+    int failures = 0;
+    std::map<std::string, double> times;
+    for (auto& b : benchmarks)
+        if (filter.empty() || b.name.find(filter) != std::string::npos)
+            failures += !run_benchmark(b, min_time, &times[b.name]);
+
+    // Band-parallel decoding against one thread
+    if (filter.empty() || !strncmp(filter.c_str(), "bands", filter.size()))
+    {
+        printf("\n%-12s %8s %12s %8s\n", "Output", "Threads", "Time (us)", "Speedup");
+        for (int type = JPG_OUTPUT_LUMA; type <= JPG_OUTPUT_RGB565; ++type)
+        {
+            const std::string prefix = std::string("bands/") + OUTPUT_NAMES[type] + "/" + restarts.name + "/";
+            const double single = times[prefix + "1"];
+            for (int threads : THREADS)
+            {
+                const double us = times[prefix + std::to_string(threads)];
+                printf("%-12s %8d %12.1f %7.2fx\n", OUTPUT_NAMES[type], threads, us, us > 0 ? single/us : 0);
+            }
+        }
+    }
+
+    // The backend jpg_decode() would use for each output and scale, picked on the full size frame
+    if (filter.empty() || !strncmp(filter.c_str(), "decode", filter.size()))
+    {
+        jpg_decoder_timings_t timings;
+        if (jpg_decoder_calibrate(jpegs.back().data.data(), jpegs.back().data.size(), rgb.data(), rgb.size(),
+                                  min_time > 0 ? 5 : 1, &timings) != ESP_OK)
+        {
+            fprintf(stderr, "Calibration failed\n");
+            return 1;
+        }
+        printf("\n%-12s %6s %12s %12s  %s\n", "Output", "Scale", "jpegdec us", "tjpgd us", "Selected");
+        for (int type = 0; type < JPG_OUTPUT_MAX; ++type)
+            for (int scale = 0; scale <= JPG_SCALE_MAX; ++scale)
+            {
+                const auto us = timings.us[type][scale];
+                printf("%-12s %6d %12u %12u  %s\n", OUTPUT_NAMES[type], 1 << scale,
+                       (unsigned) us[JPG_DECODER_JPEGDEC], (unsigned) us[JPG_DECODER_TJPGD],
+                       DECODER_NAMES[jpg_decoder_get_selected(jpg_output_t(type), jpg_scale_t(scale))]);
+            }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,343 @@
+// Minimal esp_http_client over POSIX sockets, for running the upload code
+// on a host against a local S3 stand-in. Plain HTTP/1.1 with keep-alive;
+// only the subset of the API used by main/ is implemented.
+
+#include "esp_http_client.h"
+
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct esp_http_client
+{
+    std::string host;
+    int port = 80;
+    std::string path = "/";
+    esp_http_client_method_t method = HTTP_METHOD_GET;
+    std::vector<std::pair<std::string, std::string>> headers;
+    const char* post_data = nullptr;
+    int post_len = 0;
+    http_event_handle_cb event_handler = nullptr;
+    void* user_data = nullptr;
+
+    int fd = -1;
+    std::string rx;             // received but not yet consumed bytes
+    int status_code = 0;
+    int64_t content_length = 0;
+    int64_t body_remaining = 0;
+    bool keep_alive = true;
+};
+
+static void dispatch(esp_http_client_handle_t client, esp_http_client_event_id_t id,
+                     void* data = nullptr, int data_len = 0,
+                     char* key = nullptr, char* value = nullptr)
+{
+    if (!client->event_handler)
+        return;
+    esp_http_client_event_t evt = {};
+    evt.event_id = id;
+    evt.client = client;
+    evt.data = data;
+    evt.data_len = data_len;
+    evt.user_data = client->user_data;
+    evt.header_key = key;
+    evt.header_value = value;
+    client->event_handler(&evt);
+}
+
+static bool send_all(int fd, const char* data, size_t len)
+{
+    while (len)
+    {
+        const auto n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+/// Receive more data into client->rx. Return false on EOF or error.
+static bool receive(esp_http_client_handle_t client)
+{
+    char buf[4096];
+    const auto n = recv(client->fd, buf, sizeof(buf), 0);
+    if (n <= 0)
+        return false;
+    client->rx.append(buf, n);
+    return true;
+}
+
+static esp_err_t connect_if_needed(esp_http_client_handle_t client)
+{
+    if (client->fd >= 0)
+        return ESP_OK;
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    const auto port = std::to_string(client->port);
+    if (getaddrinfo(client->host.c_str(), port.c_str(), &hints, &res))
+        return ESP_ERR_HTTP_CONNECT;
+    for (auto ai = res; ai; ai = ai->ai_next)
+    {
+        const int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (!connect(fd, ai->ai_addr, ai->ai_addrlen))
+        {
+            client->fd = fd;
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(res);
+    if (client->fd < 0)
+        return ESP_ERR_HTTP_CONNECT;
+    client->rx.clear();
+    dispatch(client, HTTP_EVENT_ON_CONNECTED);
+    return ESP_OK;
+}
+
+static const char* method_name(esp_http_client_method_t method)
+{
+    switch (method)
+    {
+    case HTTP_METHOD_POST: return "POST";
+    case HTTP_METHOD_PUT: return "PUT";
+    case HTTP_METHOD_PATCH: return "PATCH";
+    case HTTP_METHOD_DELETE: return "DELETE";
+    case HTTP_METHOD_HEAD: return "HEAD";
+    default: return "GET";
+    }
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t* config)
+{
+    auto client = new esp_http_client;
+    if (config->url)
+        esp_http_client_set_url(client, config->url);
+    if (config->host)
+        client->host = config->host;
+    if (config->port)
+        client->port = config->port;
+    if (config->path)
+        client->path = config->path;
+    client->method = config->method;
+    client->event_handler = config->event_handler;
+    client->user_data = config->user_data;
+    return client;
+}
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char* url)
+{
+    std::string s(url);
+    const auto scheme = s.find("://");
+    if (scheme == std::string::npos)
+    {
+        // Relative URL: keep host and connection
+        client->path = s.empty() ? "/" : s;
+        return ESP_OK;
+    }
+    auto rest = s.substr(scheme + 3);
+    const auto slash = rest.find('/');
+    auto authority = rest.substr(0, slash);
+    client->path = slash == std::string::npos ? "/" : rest.substr(slash);
+    int port = s.compare(0, scheme, "https") ? 80 : 443;
+    const auto colon = authority.find(':');
+    if (colon != std::string::npos)
+    {
+        port = atoi(authority.c_str() + colon + 1);
+        authority.resize(colon);
+    }
+    if (authority != client->host || port != client->port)
+        esp_http_client_close(client);
+    client->host = authority;
+    client->port = port;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method)
+{
+    client->method = method;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char* key, const char* value)
+{
+    for (auto& h : client->headers)
+        if (!strcasecmp(h.first.c_str(), key))
+        {
+            h.second = value;
+            return ESP_OK;
+        }
+    client->headers.emplace_back(key, value);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char* key)
+{
+    auto& headers = client->headers;
+    headers.erase(std::remove_if(headers.begin(), headers.end(),
+                                 [key](const std::pair<std::string, std::string>& h)
+                                 { return !strcasecmp(h.first.c_str(), key); }),
+                  headers.end());
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char* data, int len)
+{
+    client->post_data = data;
+    client->post_len = len;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    auto err = connect_if_needed(client);
+    if (err != ESP_OK)
+        return err;
+    std::string req = std::string(method_name(client->method)) + " " + client->path + " HTTP/1.1\r\n";
+    req += "Host: " + client->host + "\r\n";
+    if (write_len >= 0)
+        req += "Content-Length: " + std::to_string(write_len) + "\r\n";
+    for (const auto& h : client->headers)
+        req += h.first + ": " + h.second + "\r\n";
+    req += "\r\n";
+    if (!send_all(client->fd, req.data(), req.size()))
+    {
+        esp_http_client_close(client);
+        return ESP_ERR_HTTP_WRITE_DATA;
+    }
+    dispatch(client, HTTP_EVENT_HEADER_SENT);
+    return ESP_OK;
+}
+
+int esp_http_client_write(esp_http_client_handle_t client, const char* buffer, int len)
+{
+    if (client->fd < 0 || !send_all(client->fd, buffer, len))
+        return -1;
+    return len;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    if (client->fd < 0)
+        return ESP_FAIL;
+    size_t end;
+    while ((end = client->rx.find("\r\n\r\n")) == std::string::npos)
+        if (!receive(client))
+        {
+            esp_http_client_close(client);
+            return ESP_FAIL;
+        }
+    const auto head = client->rx.substr(0, end);
+    client->rx.erase(0, end + 4);
+
+    client->status_code = 0;
+    client->content_length = 0;
+    client->keep_alive = true;
+    size_t pos = head.find("\r\n");
+    const auto status_line = head.substr(0, pos);
+    const auto sp = status_line.find(' ');
+    if (sp != std::string::npos)
+        client->status_code = atoi(status_line.c_str() + sp + 1);
+    if (status_line.compare(0, 8, "HTTP/1.0") == 0)
+        client->keep_alive = false;
+    while (pos != std::string::npos)
+    {
+        const auto start = pos + 2;
+        pos = head.find("\r\n", start);
+        auto line = head.substr(start, pos == std::string::npos ? std::string::npos : pos - start);
+        const auto colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+        auto key = line.substr(0, colon);
+        auto value = line.substr(line.find_first_not_of(' ', colon + 1));
+        if (!strcasecmp(key.c_str(), "Content-Length"))
+            client->content_length = atoll(value.c_str());
+        else if (!strcasecmp(key.c_str(), "Connection"))
+            client->keep_alive = strcasecmp(value.c_str(), "close") != 0;
+        dispatch(client, HTTP_EVENT_ON_HEADER, nullptr, 0, &key[0], &value[0]);
+    }
+    client->body_remaining = client->method == HTTP_METHOD_HEAD ? 0 : client->content_length;
+    return client->content_length;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char* buffer, int len)
+{
+    if (client->body_remaining <= 0)
+        return 0;
+    if (client->rx.empty() && !receive(client))
+    {
+        esp_http_client_close(client);
+        return -1;
+    }
+    int n = std::min<int64_t>({ (int64_t) len, (int64_t) client->rx.size(), client->body_remaining });
+    memcpy(buffer, client->rx.data(), n);
+    client->rx.erase(0, n);
+    client->body_remaining -= n;
+    return n;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client)
+{
+    auto err = esp_http_client_open(client, client->post_data ? client->post_len : 0);
+    if (err != ESP_OK)
+        return err;
+    if (client->post_len && esp_http_client_write(client, client->post_data, client->post_len) < 0)
+    {
+        esp_http_client_close(client);
+        return ESP_ERR_HTTP_WRITE_DATA;
+    }
+    if (esp_http_client_fetch_headers(client) < 0)
+        return ESP_ERR_HTTP_FETCH_HEADER;
+    char buf[1024];
+    int n;
+    while ((n = esp_http_client_read(client, buf, sizeof(buf))) > 0)
+        dispatch(client, HTTP_EVENT_ON_DATA, buf, n);
+    if (n < 0)
+        return ESP_FAIL;
+    dispatch(client, HTTP_EVENT_ON_FINISH);
+    if (!client->keep_alive)
+        esp_http_client_close(client);
+    return ESP_OK;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return client->status_code;
+}
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client)
+{
+    return client->content_length;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    if (client->fd >= 0)
+    {
+        close(client->fd);
+        client->fd = -1;
+        client->rx.clear();
+        dispatch(client, HTTP_EVENT_DISCONNECTED);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    esp_http_client_close(client);
+    delete client;
+    return ESP_OK;
+}
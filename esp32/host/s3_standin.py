@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""Local stand-in for the S3 (MinIO) server used by the host tests.
+
+Accepts PUT requests signed with AWS signature v2 over plain HTTP/1.1
+with keep-alive, and stores the objects in memory or in a directory.
+Stored objects can be read back with an unsigned GET, which also
+returns their x-amz-meta-* headers.
+
+  s3_standin.py [--port N] [--store DIR] [--close-every N] [--drop-every N]
+                [--run CMD ARGS...]
+
+--close-every N  answer every Nth request on a connection with
+                 'Connection: close' and close it
+--drop-every N   silently close the connection after every Nth request,
+                 like a server with a short idle timeout
+--run CMD        start the server on a free port, run CMD with
+                 S3_STANDIN_PORT set, and exit with its exit code
+"""
+
+import argparse
+import base64
+import hashlib
+import hmac
+import http.server
+import os
+import subprocess
+import sys
+import threading
+
+ACCESS_KEY = 'hostaccess'
+SECRET_KEY = 'hostsecretkey0123456789'
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def setup(self):
+        super().setup()
+        self.requests_on_connection = 0
+
+    def log_message(self, fmt, *args):
+        if self.server.verbose:
+            super().log_message(fmt, *args)
+
+    def read_body(self):
+        if self.headers.get('Transfer-Encoding', '').lower() == 'chunked':
+            body = b''
+            while True:
+                size = int(self.rfile.readline().split(b';')[0], 16)
+                chunk = self.rfile.read(size)
+                self.rfile.readline()
+                if size == 0:
+                    return body
+                body += chunk
+        return self.rfile.read(int(self.headers.get('Content-Length', 0)))
+
+    def signature_ok(self):
+        auth = self.headers.get('Authorization', '')
+        if not auth.startswith('AWS ' + ACCESS_KEY + ':'):
+            return False
+        amz = sorted((k.lower(), v.strip()) for k, v in self.headers.items()
+                     if k.lower().startswith('x-amz-'))
+        to_sign = '%s\n\n%s\n%s\n%s%s' % (self.command,
+                                         self.headers.get('Content-Type', ''),
+                                         self.headers.get('Date', ''),
+                                         ''.join('%s:%s\n' % h for h in amz),
+                                         self.path)
+        digest = hmac.new(SECRET_KEY.encode(), to_sign.encode(), hashlib.sha1).digest()
+        return auth.split(':', 1)[1] == base64.b64encode(digest).decode()
+
+    def do_GET(self):
+        body = self.server.objects.get(self.path)
+        self.send_response(200 if body is not None else 404)
+        for k, v in self.server.metadata.get(self.path, []):
+            self.send_header(k, v)
+        self.send_header('Content-Length', str(len(body or b'')))
+        self.end_headers()
+        if body:
+            self.wfile.write(body)
+
+    def do_PUT(self):
+        body = self.read_body()
+        self.requests_on_connection += 1
+        n = self.requests_on_connection
+        if not self.signature_ok():
+            status = 403
+        else:
+            status = 200
+            self.server.store(self.path, body)
+            self.server.metadata[self.path] = [
+                (k.lower(), v) for k, v in self.headers.items()
+                if k.lower().startswith('x-amz-meta-')]
+        close = self.server.close_every and n % self.server.close_every == 0
+        self.send_response(status)
+        self.send_header('Content-Length', '0')
+        if close:
+            self.send_header('Connection', 'close')
+            self.close_connection = True
+        self.end_headers()
+        if self.server.drop_every and n % self.server.drop_every == 0:
+            self.close_connection = True
+
+
+class Server(http.server.ThreadingHTTPServer):
+    daemon_threads = True
+
+    def __init__(self, port, args):
+        super().__init__(('127.0.0.1', port), Handler)
+        self.close_every = args.close_every
+        self.drop_every = args.drop_every
+        self.verbose = args.verbose
+        self.store_dir = args.store
+        self.objects = {}
+        self.metadata = {}
+
+    def store(self, path, body):
+        self.objects[path] = body
+        if self.store_dir:
+            name = os.path.join(self.store_dir, path.lstrip('/').replace('/', '_'))
+            with open(name, 'wb') as f:
+                f.write(body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Local S3 stand-in')
+    parser.add_argument('--port', type=int, default=0)
+    parser.add_argument('--store')
+    parser.add_argument('--close-every', type=int, default=0)
+    parser.add_argument('--drop-every', type=int, default=0)
+    parser.add_argument('--verbose', action='store_true')
+    parser.add_argument('--run', nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+
+    server = Server(args.port, args)
+    port = server.server_address[1]
+    if not args.run:
+        print('Listening on port %d' % port)
+        server.serve_forever()
+        return 0
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    env = dict(os.environ, S3_STANDIN_PORT=str(port),
+               S3_STANDIN_ACCESS_KEY=ACCESS_KEY, S3_STANDIN_SECRET_KEY=SECRET_KEY)
+    result = subprocess.run(args.run, env=env)
+    server.shutdown()
+    return result.returncode
+
+
+if __name__ == '__main__':
+    sys.exit(main())
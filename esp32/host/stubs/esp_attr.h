@@ -0,0 +1,8 @@
+#pragma once
+
+// Host build: no IRAM or DRAM placement
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_ATTR
+#define RTC_DATA_ATTR
@@ -0,0 +1,8 @@
+#pragma once
+
+// The IDF version the conversions are built against. Without ROM JPEG
+// support they use the software TJpgDec in components/target.
+
+#define ESP_IDF_VERSION_MAJOR 4
+#define ESP_IDF_VERSION_MINOR 4
+#define ESP_IDF_VERSION_PATCH 0
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string.h>
+
+#include "esp_err.h"
+
+typedef void* esp_tls_error_handle_t;
+
+static inline esp_err_t esp_tls_get_and_clear_last_error(esp_tls_error_handle_t h, int* esp_tls_code, int* esp_tls_flags)
+{
+    (void) h;
+    if (esp_tls_code)
+        *esp_tls_code = 0;
+    if (esp_tls_flags)
+        *esp_tls_flags = 0;
+    return ESP_OK;
+}
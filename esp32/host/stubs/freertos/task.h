@@ -0,0 +1,11 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+#include <time.h>
+
+static inline void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = { (time_t) (ticks / 1000), (long) (ticks % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
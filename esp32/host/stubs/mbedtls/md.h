@@ -0,0 +1,34 @@
+#pragma once
+
+// Host stand-in for the mbedtls message digest API, backed by OpenSSL
+
+#include <stddef.h>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+typedef enum {
+    MBEDTLS_MD_SHA1,
+    MBEDTLS_MD_SHA256,
+} mbedtls_md_type_t;
+
+typedef struct {
+    mbedtls_md_type_t type;
+} mbedtls_md_info_t;
+
+static inline const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t md_type)
+{
+    static const mbedtls_md_info_t sha1 = { MBEDTLS_MD_SHA1 };
+    static const mbedtls_md_info_t sha256 = { MBEDTLS_MD_SHA256 };
+    return md_type == MBEDTLS_MD_SHA1 ? &sha1 : &sha256;
+}
+
+static inline int mbedtls_md_hmac(const mbedtls_md_info_t* md_info,
+                                  const unsigned char* key, size_t keylen,
+                                  const unsigned char* input, size_t ilen,
+                                  unsigned char* output)
+{
+    unsigned int len = 0;
+    const EVP_MD* md = md_info->type == MBEDTLS_MD_SHA1 ? EVP_sha1() : EVP_sha256();
+    return HMAC(md, key, (int) keylen, input, ilen, output, &len) ? 0 : -1;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// Host build: no IDF target, no camera hardware
+
+#define CONFIG_IDF_TARGET_ESP32 0
+#define CONFIG_IDF_TARGET_ESP32S2 0
+#define CONFIG_IDF_TARGET_ESP32S3 0
+
+// Band decoding is only exercised on the host until a camera path sends
+// JPEG images with restart markers
+#define CONFIG_JPEG_DECODE_BANDS 1
@@ -0,0 +1,123 @@
+// Checks Background_model: per-cell noise raises that cell's threshold,
+// slow lighting drift is absorbed, real changes are still seen, and the
+// way the cells are cut into runs does not matter.
+
+#include "background.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+int main()
+{
+    const int cells = 1000;
+    const int min_threshold = 10;
+    const int sigmas = 3;
+    const int shift = 3;
+    const cell_run runs[] = { { 0, 500 }, { 500, 500 } };
+
+    // Cells below 100 are noisy (+-25), the rest are steady with +-2 noise
+    srand(1);
+    auto make_frame = [&](int brightness)
+    {
+        std::vector<uint8_t> frame(cells);
+        for (int i = 0; i < cells; ++i)
+        {
+            const int noise = i < 100 ? rand() % 51 - 25 : rand() % 5 - 2;
+            frame[i] = brightness + noise;
+        }
+        return frame;
+    };
+
+    Background_model model;
+    auto frame = make_frame(100);
+    model.reset(frame.data(), cells);
+    CHECK(model.size() == cells);
+
+    // Warm up: the noisy cells learn their noise level
+    for (int n = 0; n < 100; ++n)
+    {
+        frame = make_frame(100);
+        model.update(frame.data(), runs, 2, nullptr, min_threshold, sigmas, shift);
+    }
+    CHECK(model.get_deviation_x16(0) > 16*8);
+    CHECK(model.get_deviation_x16(500) < 16*3);
+
+    // With a fixed threshold the noisy cells keep triggering; with the model they do not
+    uint32_t fixed = 0, adaptive = 0;
+    Background_model fixed_model;
+    fixed_model.reset(frame.data(), cells);
+    for (int n = 0; n < 50; ++n)
+    {
+        frame = make_frame(100);
+        fixed += fixed_model.update(frame.data(), runs, 2, nullptr, min_threshold, 0, shift);
+        adaptive += model.update(frame.data(), runs, 2, nullptr, min_threshold, sigmas, shift);
+    }
+    printf("noisy cells changed: fixed threshold %u, adaptive %u\n", (unsigned) fixed, (unsigned) adaptive);
+    CHECK(fixed > 500);
+    CHECK(adaptive < fixed/10);
+
+    // Slow drift in brightness, one step per frame, is absorbed
+    uint32_t drift_changes = 0;
+    for (int n = 0; n < 60; ++n)
+    {
+        frame = make_frame(100 + n);
+        drift_changes += model.update(frame.data(), runs, 2, nullptr, min_threshold, sigmas, shift);
+    }
+    CHECK(drift_changes < 50);
+    // The average lags about 2^shift frames behind
+    CHECK(abs(model.get_mean(700) - (159 - (1 << shift))) <= 3);
+
+    // A real change in the steady cells is detected
+    frame = make_frame(160);
+    for (int i = 600; i < 700; ++i)
+        frame[i] = 250;
+    const auto changes = model.update(frame.data(), runs, 2, nullptr, min_threshold, sigmas, shift);
+    CHECK(changes >= 100 && changes < 120);
+
+    // Weights count per cell, and a weighted fixed threshold matches the vector kernel
+    Background_model a, b;
+    frame = make_frame(100);
+    a.reset(frame.data(), cells);
+    b.reset(frame.data(), cells);
+    std::vector<uint8_t> weights(cells, 1);
+    for (int i = 600; i < 700; ++i)
+        weights[i] = 5;
+    frame = make_frame(100);
+    for (int i = 600; i < 700; ++i)
+        frame[i] = 250;
+    const auto weighted = a.update(frame.data(), runs, 2, weights.data(), min_threshold, 0, shift);
+    const auto unweighted = b.update(frame.data(), runs, 2, nullptr, min_threshold, 0, shift);
+    CHECK(weighted == unweighted + 4*100);
+
+    // Runs that start and end anywhere give the same counts and the same
+    // model as one run over all cells
+    Background_model whole, split;
+    frame = make_frame(100);
+    whole.reset(frame.data(), cells);
+    split.reset(frame.data(), cells);
+    const cell_run one_run[] = { { 0, cells } };
+    const cell_run split_runs[] = { { 0, 3 }, { 3, 61 }, { 64, 1 }, { 65, 130 }, { 195, 805 } };
+    for (int n = 0; n < 20; ++n)
+    {
+        frame = make_frame(100 + (n % 4) * 10);
+        for (int sigma : { 0, sigmas })
+        {
+            const auto expected = whole.update(frame.data(), one_run, 1, weights.data(), min_threshold, sigma, shift);
+            CHECK(split.update(frame.data(), split_runs, 5, weights.data(), min_threshold, sigma, shift) == expected);
+        }
+    }
+    for (int i = 0; i < cells; ++i)
+        CHECK(split.get_mean(i) == whole.get_mean(i) && split.get_deviation_x16(i) == whole.get_deviation_x16(i));
+
+    if (failures)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
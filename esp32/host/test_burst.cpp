@@ -0,0 +1,151 @@
+// Packs frames into a Burst, uploads it as one object to the local S3
+// stand-in (run via s3_standin.py --run), reads it back and parses the
+// multipart stream to check every frame and its timestamp.
+
+#include "burst.h"
+#include "uploadclient.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+static std::string fetch_object(int port, const char* resource)
+{
+    esp_http_client_config_t config {
+        .host = "127.0.0.1",
+        .port = port,
+        .path = resource,
+        .transport_type = HTTP_TRANSPORT_OVER_TCP,
+    };
+    auto client = esp_http_client_init(&config);
+    std::string body;
+    if (esp_http_client_open(client, 0) == ESP_OK && esp_http_client_fetch_headers(client) >= 0)
+    {
+        char buf[4096];
+        int n;
+        while ((n = esp_http_client_read(client, buf, sizeof(buf))) > 0)
+            body.append(buf, n);
+    }
+    esp_http_client_cleanup(client);
+    return body;
+}
+
+int main()
+{
+    const char* port = getenv("S3_STANDIN_PORT");
+    const char* access_key = getenv("S3_STANDIN_ACCESS_KEY");
+    const char* secret_key = getenv("S3_STANDIN_SECRET_KEY");
+    if (!port || !access_key || !secret_key)
+    {
+        fprintf(stderr, "Run through s3_standin.py --run\n");
+        return 2;
+    }
+
+    // Frames of different sizes, the second one split as if wrapped in the ring
+    const int frame_count = 5;
+    std::vector<std::vector<unsigned char>> frames(frame_count);
+    const int64_t base_ms = 1700000000000LL;
+    Burst burst;
+    for (int i = 0; i < frame_count; ++i)
+    {
+        frames[i].resize(20000 + 3001*i);
+        for (size_t j = 0; j < frames[i].size(); ++j)
+            frames[i][j] = static_cast<unsigned char>(i + j*13);
+        const upload_segment segments[] = {
+            { frames[i].data(), i == 1 ? 777 : frames[i].size() },
+            { frames[i].data() + 777, i == 1 ? frames[i].size() - 777 : 0 },
+        };
+        // Odd frames carry camera metadata in their part header
+        char extra[64];
+        snprintf(extra, sizeof(extra), "X-Seq: %d\r\nX-AEC: %d\r\n", 100 + i, 10*i);
+        if (!burst.add(segments, 2, base_ms + 250*i + 7, "image/jpeg", i % 2 ? extra : nullptr))
+        {
+            fprintf(stderr, "Cannot add frame %d\n", i);
+            return 1;
+        }
+    }
+    size_t count;
+    auto segments = burst.get_segments(count);
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+        total += segments[i].size;
+    if (total != burst.get_size())
+    {
+        fprintf(stderr, "Size %zu does not match segments %zu\n", burst.get_size(), total);
+        return 1;
+    }
+
+    Upload_client client("127.0.0.1", atoi(port), HTTP_TRANSPORT_OVER_TCP, access_key, secret_key);
+    const time_t now = time(nullptr);
+    struct tm timeinfo;
+    gmtime_r(&now, &timeinfo);
+    const char* resource = "/hal9kcam/test-burst.mjpeg";
+
+    // A part header that does not fit is refused rather than truncated
+    {
+        Burst small;
+        const std::string long_headers = "X-Long: " + std::string(300, 'x') + "\r\n";
+        const upload_segment segment = { frames[0].data(), frames[0].size() };
+        if (small.add(&segment, 1, base_ms, "image/jpeg", long_headers.c_str()) || small.get_frame_count())
+        {
+            fprintf(stderr, "Oversized part header accepted\n");
+            return 1;
+        }
+    }
+    if (client.put(resource, segments, count, timeinfo, BURST_CONTENT_TYPE) != ESP_OK)
+    {
+        fprintf(stderr, "Upload failed, status %d\n", client.get_status_code());
+        return 1;
+    }
+    const auto body = fetch_object(atoi(port), resource);
+    if (body.size() != total)
+    {
+        fprintf(stderr, "Stored object is %zu bytes, expected %zu\n", body.size(), total);
+        return 1;
+    }
+
+    // Parse it back
+    const std::string delimiter = std::string("--") + BURST_BOUNDARY + "\r\n";
+    size_t pos = 0;
+    for (int i = 0; i < frame_count; ++i)
+    {
+        if (i)
+        {
+            if (body.compare(pos, 2, "\r\n"))
+                break;
+            pos += 2;
+        }
+        if (body.compare(pos, delimiter.size(), delimiter))
+            break;
+        pos += delimiter.size();
+        const auto header_end = body.find("\r\n\r\n", pos);
+        const auto header = body.substr(pos, header_end - pos);
+        pos = header_end + 4;
+        char expected_header[192];
+        int n = snprintf(expected_header, sizeof(expected_header),
+                         "Content-Type: image/jpeg\r\nContent-Length: %zu\r\nX-Timestamp: %lld.%03d",
+                         frames[i].size(), (long long) ((base_ms + 250*i + 7)/1000), (250*i + 7) % 1000);
+        if (i % 2)
+            snprintf(expected_header + n, sizeof(expected_header) - n,
+                     "\r\nX-Seq: %d\r\nX-AEC: %d", 100 + i, 10*i);
+        if (header != expected_header || body.compare(pos, frames[i].size(),
+                                                      std::string(frames[i].begin(), frames[i].end())))
+        {
+            fprintf(stderr, "Frame %d: bad part\n%s\n", i, header.c_str());
+            return 1;
+        }
+        pos += frames[i].size();
+    }
+    const auto trailer = std::string("\r\n--") + BURST_BOUNDARY + "--\r\n";
+    if (body.compare(pos, std::string::npos, trailer))
+    {
+        fprintf(stderr, "Bad multipart structure at offset %zu\n", pos);
+        return 1;
+    }
+    printf("OK: %d frames in one %zu byte object\n", frame_count, total);
+    return 0;
+}
@@ -0,0 +1,76 @@
+// Checks that the SWAR frame difference kernel (and the dispatcher used by
+// motion_detect) are bit-exact against the scalar loop, and times them.
+
+#include "framediff.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    int failures = 0;
+
+    // Every pair of byte values, at every threshold
+    std::vector<uint8_t> a(256*256), b(256*256);
+    for (int i = 0; i < 256*256; ++i)
+    {
+        a[i] = i & 0xFF;
+        b[i] = i >> 8;
+    }
+    for (int threshold = -1; threshold <= 256; ++threshold)
+    {
+        const int expected = count_changed_pixels_scalar(a.data(), b.data(), a.size(), threshold);
+        const int swar = count_changed_pixels_swar(a.data(), b.data(), a.size(), threshold);
+        const int dispatched = count_changed_pixels(a.data(), b.data(), a.size(), threshold);
+        if (swar != expected || dispatched != expected)
+        {
+            fprintf(stderr, "threshold %d: scalar %d swar %d dispatched %d\n",
+                    threshold, expected, swar, dispatched);
+            ++failures;
+        }
+    }
+
+    // Random data at unaligned offsets and odd lengths
+    srand(1);
+    std::vector<uint8_t> x(10000), y(10000);
+    for (size_t i = 0; i < x.size(); ++i)
+    {
+        x[i] = rand();
+        y[i] = rand() % 4 ? x[i] + rand() % 41 - 20 : rand();
+    }
+    for (int n = 0; n < 200; ++n)
+    {
+        const size_t offset = rand() % 16;
+        const size_t len = rand() % (x.size() - offset);
+        const int threshold = rand() % 64;
+        const int expected = count_changed_pixels_scalar(&x[offset], &y[offset], len, threshold);
+        if (count_changed_pixels_swar(&x[offset], &y[offset], len, threshold) != expected ||
+            count_changed_pixels(&x[offset], &y[offset], len, threshold) != expected)
+        {
+            fprintf(stderr, "offset %zu len %zu threshold %d: mismatch\n", offset, len, threshold);
+            ++failures;
+        }
+    }
+    if (failures)
+        return 1;
+
+    // Motion buffer size
+    const size_t len = 7500;
+    const int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    volatile int sink = 0;
+    auto time_us = [&](int (*f)(const uint8_t*, const uint8_t*, size_t, int))
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            sink = sink + f(x.data(), y.data(), len, 10);
+        const auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+    };
+    const auto t_scalar = time_us(count_changed_pixels_scalar);
+    const auto t_swar = time_us(count_changed_pixels_swar);
+    printf("%zu bytes: scalar %.2f us, swar %.2f us\n", len, t_scalar, t_swar);
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Exercises Frame_ring: wrap-around into two segments, recycling of
+// the oldest frames, claimed frames surviving until released, and the
+// history estimate.
+
+#include "framering.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+/// Frame n has size 100 + 37*n and its bytes are (n + offset) & 0xFF
+static std::vector<uint8_t> make_frame(int n, camera_fb_t& fb)
+{
+    std::vector<uint8_t> data(100 + 37*n);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (n + i) & 0xFF;
+    fb = {};
+    fb.buf = data.data();
+    fb.len = data.size();
+    fb.format = PIXFORMAT_JPEG;
+    fb.timestamp.tv_sec = n/10;
+    fb.timestamp.tv_usec = (n % 10)*100000;
+    return data;
+}
+
+static bool frame_matches(Frame_ring& ring, uint32_t seq, int n)
+{
+    camera_fb_t fb;
+    const auto expected = make_frame(n, fb);
+    ring_frame frame;
+    upload_segment segments[2];
+    size_t count;
+    if (!ring.get(seq, frame, segments, count) || frame.len != expected.size() || frame.time_ms != 100*n)
+        return false;
+    std::vector<uint8_t> data;
+    for (size_t i = 0; i < count; ++i)
+        data.insert(data.end(), segments[i].data, segments[i].data + segments[i].size);
+    return data == expected;
+}
+
+int main()
+{
+    Frame_ring ring(3000, 8);
+
+    // Fill well past capacity: only the newest frames remain, and every one reads back intact
+    uint32_t seqs[20];
+    bool wrapped = false;
+    for (int n = 0; n < 20; ++n)
+    {
+        camera_fb_t fb;
+        const auto data = make_frame(n, fb);
+        CHECK(ring.push(&fb, 100*n, seqs[n]));
+        CHECK(frame_matches(ring, seqs[n], n));
+        ring_frame frame;
+        upload_segment segments[2];
+        size_t count;
+        ring.get(seqs[n], frame, segments, count);
+        wrapped = wrapped || count == 2;
+    }
+    CHECK(wrapped);
+    auto stats = ring.get_stats();
+    CHECK(stats.used <= 3000);
+    CHECK(stats.stored == 20);
+    CHECK(stats.overwritten == 20u - stats.frames);
+    CHECK(!frame_matches(ring, seqs[0], 0));
+    CHECK(frame_matches(ring, seqs[19], 19));
+    // Frames are 0.1 s apart
+    CHECK(stats.frame_interval_secs > 0.099f && stats.frame_interval_secs < 0.101f);
+    CHECK(stats.history_secs > 0.1f * 3000/stats.avg_frame_bytes - 0.01f);
+
+    // Claim the last three; a second claim finds nothing new
+    uint32_t claimed[4];
+    CHECK(ring.claim_latest(3, claimed) == 3);
+    CHECK(claimed[0] == seqs[17] && claimed[2] == seqs[19]);
+    CHECK(ring.claim_latest(3, claimed) == 0);
+
+    // Claimed frames are not overwritten; the ring refuses new frames instead
+    int n = 20;
+    int rejected = 0;
+    for (int i = 0; i < 10; ++i, ++n)
+    {
+        camera_fb_t fb;
+        const auto data = make_frame(n, fb);
+        uint32_t seq;
+        if (!ring.push(&fb, 100*n, seq))
+            ++rejected;
+    }
+    CHECK(rejected > 0);
+    CHECK(ring.get_stats().rejected == (uint32_t) rejected);
+    CHECK(frame_matches(ring, seqs[17], 17));
+    CHECK(frame_matches(ring, seqs[19], 19));
+
+    // Once released they are recycled
+    for (int i = 17; i < 20; ++i)
+        ring.release(seqs[i]);
+    camera_fb_t fb;
+    const auto data = make_frame(n, fb);
+    uint32_t seq;
+    CHECK(ring.push(&fb, 100*n, seq));
+    CHECK(frame_matches(ring, seq, n));
+
+    // Too large for the ring
+    std::vector<uint8_t> big(4000);
+    fb.buf = big.data();
+    fb.len = big.size();
+    CHECK(!ring.push(&fb, 100*n, seq));
+
+    if (failures)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,131 @@
+// Checks the lock-free histogram used for pipeline statistics: bucket
+// placement, percentiles, the compact heartbeat format, and that no
+// counts are lost when several tasks record at once.
+
+#include "histogram.h"
+#include "stagetiming.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+int main()
+{
+    {
+        Histogram h;
+        const auto empty = h.get_stats();
+        check(empty.count == 0 && histogram_average(empty) == 0 &&
+              histogram_percentile(empty, 90) == 0, "empty histogram");
+
+        for (uint32_t v : { 0u, 1u, 2u, 3u, 4u, 1000u, 0xFFFFFFFFu })
+            h.add(v);
+        const auto stats = h.get_stats();
+        check(stats.count == 7, "count");
+        check(stats.max == 0xFFFFFFFFu, "max");
+        check(stats.total == 1010ULL + 0xFFFFFFFFULL, "total");
+        check(stats.buckets[0] == 1 && stats.buckets[1] == 1 && stats.buckets[2] == 2 &&
+              stats.buckets[3] == 1 && stats.buckets[10] == 1 && stats.buckets[32] == 1,
+              "bucket placement");
+        char buf[64];
+        histogram_format(stats, buf, sizeof(buf));
+        check(!strcmp(buf, "0:1,1:1,2:2,3:1,10:1,32:1"), "format");
+        histogram_format(stats, buf, 12);
+        check(!strcmp(buf, "0:1,1:1,2:2"), "format truncates whole entries");
+    }
+    {
+        // 90 small values and 10 large ones
+        Histogram h;
+        for (int i = 0; i < 90; ++i)
+            h.add(100);
+        for (int i = 0; i < 10; ++i)
+            h.add(5000);
+        const auto stats = h.get_stats();
+        check(histogram_percentile(stats, 50) == 127, "p50 is the bucket bound");
+        check(histogram_percentile(stats, 90) == 127, "p90 still in the small bucket");
+        check(histogram_percentile(stats, 91) == 5000, "p91 is capped by the maximum");
+        check(histogram_average(stats) == 590, "average");
+    }
+    {
+        // Concurrent recording
+        Histogram h;
+        const int threads = 4;
+        const int per_thread = 100000;
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+            workers.emplace_back([&h, t] {
+                for (int i = 0; i < per_thread; ++i)
+                    h.add(t*1000 + i % 1000);
+            });
+        for (auto& w : workers)
+            w.join();
+        const auto stats = h.get_stats();
+        uint32_t bucket_total = 0;
+        for (auto b : stats.buckets)
+            bucket_total += b;
+        check(stats.count == threads*per_thread && bucket_total == stats.count, "concurrent count");
+        check(stats.max == (threads - 1)*1000 + 999, "concurrent max");
+        uint64_t expected_total = 0;
+        for (int t = 0; t < threads; ++t)
+            for (int i = 0; i < per_thread; ++i)
+                expected_total += t*1000 + i % 1000;
+        check(stats.total == expected_total, "concurrent total");
+    }
+    {
+        // A total carried into its high word is never seen half done: every
+        // total read while adding is a whole number of adds
+        Histogram h;
+        const uint32_t value = 0xC0000000;
+        const int threads = 3;
+        const int per_thread = 100000;
+        std::atomic<bool> done{false};
+        bool torn = false;
+        uint64_t last = 0;
+        bool monotonic = true;
+        std::thread reader([&] {
+            while (!done)
+            {
+                const uint64_t total = h.get_stats().total;
+                torn = torn || total % value;
+                monotonic = monotonic && total >= last;
+                last = total;
+            }
+        });
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+            workers.emplace_back([&h, value] {
+                for (int i = 0; i < per_thread; ++i)
+                    h.add(value);
+            });
+        for (auto& w : workers)
+            w.join();
+        done = true;
+        reader.join();
+        check(!torn && monotonic, "total read while adding");
+        check(h.get_stats().total == static_cast<uint64_t>(value)*threads*per_thread, "total with carries");
+    }
+    {
+        stage_record(Stage::decode, 3000);
+        stage_record(Stage::decode, 5000);
+        const auto stats = stage_get_stats(Stage::decode);
+        check(stats.count == 2 && stats.last_us == 5000 && stats.max_us == 5000 &&
+              stats.total_us == 8000, "stage stats");
+        check(stage_get_average_us(Stage::decode) == 4000, "stage average");
+        check(stage_get_percentile_us(Stage::decode, 50) == 4095, "stage percentile");
+        check(stage_get_stats(Stage::diff).count == 0, "stages are separate");
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+// Checks band-parallel decoding: restart markers written by jpge are found
+// at the expected MCU rows, and decoding the bands on several threads gives
+// the same image, byte for byte, as decoding the whole image on one.
+
+#include "JPEGBANDS.h"
+#include "img_converters.h"
+#include "jpg_decoder.h"
+#include "jpge.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+static std::atomic<int> failures(0);
+
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+static std::vector<uint8_t> read_file(const std::string& path)
+{
+    std::vector<uint8_t> data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+    return data;
+}
+
+class vector_stream : public jpge::output_stream
+{
+public:
+    std::vector<uint8_t> data;
+
+    bool put_buf(const void* buf, int len) override
+    {
+        if (buf)
+            data.insert(data.end(), static_cast<const uint8_t*>(buf), static_cast<const uint8_t*>(buf) + len);
+        return true;
+    }
+
+    jpge::uint get_size() const override
+    {
+        return data.size();
+    }
+};
+
+static std::vector<uint8_t> encode(const std::vector<uint8_t>& rgb, int width, int height,
+                                   jpge::subsampling_t subsampling, int restart_mcu_rows)
+{
+    jpge::params params;
+    params.m_quality = 80;
+    params.m_subsampling = subsampling;
+    params.m_restart_mcu_rows = restart_mcu_rows;
+    vector_stream stream;
+    jpge::jpeg_encoder encoder;
+    if (!encoder.init(&stream, width, height, 3, params))
+        return {};
+    for (int y = 0; y < height; ++y)
+        encoder.process_scanline(&rgb[y * width * 3]);
+    encoder.process_scanline(nullptr);
+    return stream.data;
+}
+
+static int count_restart_markers(const std::vector<uint8_t>& jpeg)
+{
+    int n = 0;
+    for (size_t i = 0; i + 1 < jpeg.size(); ++i)
+        n += jpeg[i] == 0xFF && jpeg[i + 1] >= 0xD0 && jpeg[i + 1] <= 0xD7;
+    return n;
+}
+
+static std::atomic<int> s_calls;
+
+static int fail_band_2(const JPEGBAND* band, int worker, void* arg)
+{
+    ++s_calls;
+    // two workers take every other band
+    const int index = band - static_cast<JPEGBANDS*>(arg)->band;
+    CHECK(worker == index % 2);
+    return index != 2;
+}
+
+int main()
+{
+    auto picture = read_file(std::string(PICTURES_DIR) + "/test_outside.jpeg");
+    if (picture.empty())
+    {
+        fprintf(stderr, "Cannot read test picture\n");
+        return 1;
+    }
+    const int width = 480;
+    const int height = 320;
+    std::vector<uint8_t> rgb(width * height * 3);
+    CHECK(fmt2rgb888(picture.data(), picture.size(), PIXFORMAT_JPEG, rgb.data()));
+
+    // Camera frames have no restart markers: one band
+    JPEGBANDS bands;
+    CHECK(JPEG_findBands(picture.data(), picture.size(), 4, &bands) == 1);
+    CHECK(bands.iRestartInterval == 0 && bands.band[0].iHeight == height);
+    CHECK(JPEG_findBands(picture.data(), 100, 4, &bands) == 0);
+
+    // A marker after every MCU row (16 lines): cut into even bands
+    auto every_row = encode(rgb, width, height, jpge::H2V2, 1);
+    CHECK(count_restart_markers(every_row) == height/16 - 1);
+    CHECK(JPEG_findBands(every_row.data(), every_row.size(), 4, &bands) == 4);
+    CHECK(bands.iRestartInterval == width/16 && bands.iMCUHeight == 16);
+    for (int i = 0; i < 4; ++i)
+        CHECK(bands.band[i].iY == i * 80 && bands.band[i].iHeight == 80);
+
+    // Every 3 rows of 8 lines: the first marker at or past each even share
+    auto every_3_rows = encode(rgb, width, height, jpge::Y_ONLY, 3);
+    CHECK(JPEG_findBands(every_3_rows.data(), every_3_rows.size(), 3, &bands) == 3);
+    CHECK(bands.iMCUHeight == 8);
+    CHECK(bands.band[1].iY == 15 * 8 && bands.band[2].iY == 27 * 8);
+    CHECK(bands.band[2].iY + bands.band[2].iHeight == height);
+
+    // Threads decode the same image
+    for (auto jpeg : { &every_row, &every_3_rows })
+        for (int type = JPG_OUTPUT_LUMA; type <= JPG_OUTPUT_RGB565; ++type)
+            for (int scale = 0; scale <= JPG_SCALE_MAX; ++scale)
+            {
+                const size_t size = (width >> scale) * (height >> scale) * (type == JPG_OUTPUT_LUMA ? 1 : 2);
+                std::vector<uint8_t> single(size, 0xAB);
+                std::vector<uint8_t> banded(size, 0xCD);
+                jpg_decode_output_t out = {};
+                out.type = jpg_output_t(type);
+                out.scale = jpg_scale_t(scale);
+                out.buf = single.data();
+                out.buf_size = size;
+                jpg_decoder_set_threads(1);
+                CHECK(jpg_decoder_decode(JPG_DECODER_JPEGDEC, jpeg->data(), jpeg->size(), &out) == ESP_OK);
+                out.buf = banded.data();
+                jpg_decoder_set_threads(4);
+                CHECK(jpg_decoder_decode(JPG_DECODER_JPEGDEC, jpeg->data(), jpeg->size(), &out) == ESP_OK);
+                CHECK(single == banded);
+            }
+
+    // The row mask applies to the bands at their place in the image
+    {
+        const int w = width/8;
+        const int h = height/8;
+        std::vector<uint8_t> mask(h);
+        for (int y = 0; y < h; ++y)
+            mask[y] = y % 3 != 0;
+        std::vector<uint8_t> single(w * h, 0xAB);
+        std::vector<uint8_t> banded(w * h, 0xAB);
+        jpg_decode_output_t out = {};
+        out.type = JPG_OUTPUT_LUMA;
+        out.scale = JPG_SCALE_8X;
+        out.buf = single.data();
+        out.buf_size = single.size();
+        out.row_mask = mask.data();
+        jpg_decoder_set_threads(1);
+        CHECK(jpg_decoder_decode(JPG_DECODER_JPEGDEC, every_row.data(), every_row.size(), &out) == ESP_OK);
+        out.buf = banded.data();
+        jpg_decoder_set_threads(3);
+        CHECK(jpg_decoder_decode(JPG_DECODER_JPEGDEC, every_row.data(), every_row.size(), &out) == ESP_OK);
+        CHECK(single == banded);
+        jpg_decoder_set_threads(1);
+    }
+
+    // Every band runs, on fewer threads than bands, and a failure is reported
+    CHECK(JPEG_findBands(every_row.data(), every_row.size(), 5, &bands) == 5);
+    s_calls = 0;
+    CHECK(JPEG_decodeBands(&bands, 2, fail_band_2, &bands) == 0);
+    CHECK(s_calls == 5);
+
+    if (failures)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
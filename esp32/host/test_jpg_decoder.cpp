@@ -0,0 +1,212 @@
+// Checks the JPEG decoder interface: both backends give the same image
+// for every output and scale they support, strides, row masks and buffer
+// sizes are honoured, and the selection used by jpg_decode() can be
+// changed. Also checks JPEG to BMP conversion, which goes through it.
+
+#include "img_converters.h"
+#include "jpg_decoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+static std::vector<uint8_t> read_file(const std::string& path)
+{
+    std::vector<uint8_t> data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+    return data;
+}
+
+static jpg_decode_output_t make_output(jpg_output_t type, jpg_scale_t scale, std::vector<uint8_t>& buf,
+                                       size_t stride = 0)
+{
+    jpg_decode_output_t out = {};
+    out.type = type;
+    out.scale = scale;
+    out.buf = buf.data();
+    out.stride = stride;
+    out.buf_size = buf.size();
+    return out;
+}
+
+/// Average absolute difference per byte
+static double average_difference(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, size_t len)
+{
+    long total = 0;
+    for (size_t i = 0; i < len; ++i)
+        total += abs(a[i] - b[i]);
+    return total/double(len);
+}
+
+int main()
+{
+    auto picture = read_file(std::string(PICTURES_DIR) + "/test_outside.jpeg");
+    if (picture.empty())
+    {
+        fprintf(stderr, "Cannot read test picture\n");
+        return 1;
+    }
+    const uint8_t* src = picture.data();
+    const size_t len = picture.size();
+    uint16_t width = 0;
+    uint16_t height = 0;
+    CHECK(jpg_get_size(src, len, &width, &height));
+    CHECK(width == 480 && height == 320);
+    CHECK(!jpg_get_size(src, 12, &width, &height));
+
+    CHECK(jpg_decoder_supports(JPG_DECODER_JPEGDEC, JPG_OUTPUT_LUMA, JPG_SCALE_8X));
+    CHECK(jpg_decoder_supports(JPG_DECODER_JPEGDEC, JPG_OUTPUT_RGB565, JPG_SCALE_NONE));
+    CHECK(!jpg_decoder_supports(JPG_DECODER_JPEGDEC, JPG_OUTPUT_RGB888, JPG_SCALE_NONE));
+    CHECK(jpg_decoder_supports(JPG_DECODER_TJPGD, JPG_OUTPUT_RGB888, JPG_SCALE_2X));
+
+    // The backends agree, apart from rounding in the IDCT and color conversion.
+    // JPEGDEC's 1/4 scale only uses the lowest 2x2 coefficients, so it is
+    // further off.
+    const int bytes_per_pixel[JPG_OUTPUT_MAX] = { 1, 2, 3 };
+    for (int type = JPG_OUTPUT_LUMA; type <= JPG_OUTPUT_RGB565; ++type)
+        for (int scale = 0; scale <= JPG_SCALE_MAX; ++scale)
+        {
+            const size_t size = (width >> scale) * (height >> scale) * bytes_per_pixel[type];
+            std::vector<uint8_t> a(size, 0xAB);
+            std::vector<uint8_t> b(size, 0xAB);
+            auto out_a = make_output(jpg_output_t(type), jpg_scale_t(scale), a);
+            auto out_b = make_output(jpg_output_t(type), jpg_scale_t(scale), b);
+            CHECK(jpg_decoder_decode(JPG_DECODER_JPEGDEC, src, len, &out_a) == ESP_OK);
+            CHECK(jpg_decoder_decode(JPG_DECODER_TJPGD, src, len, &out_b) == ESP_OK);
+            if (type == JPG_OUTPUT_LUMA)
+            {
+                const double diff = average_difference(a, b, size);
+                printf("luma 1/%d: average difference %.2f\n", 1 << scale, diff);
+                CHECK(diff < (scale == JPG_SCALE_4X ? 10 : 3));
+            }
+            else
+            {
+                // Compare the green channel, which has the most bits
+                std::vector<uint8_t> green_a(size/2);
+                std::vector<uint8_t> green_b(size/2);
+                for (size_t i = 0; i < size/2; ++i)
+                {
+                    green_a[i] = ((a[2*i] | a[2*i + 1] << 8) >> 5) & 0x3F;
+                    green_b[i] = ((b[2*i] | b[2*i + 1] << 8) >> 5) & 0x3F;
+                }
+                const double diff = average_difference(green_a, green_b, size/2);
+                printf("rgb565 1/%d: average green difference %.2f\n", 1 << scale, diff);
+                CHECK(diff < (scale == JPG_SCALE_4X ? 3 : 1.5));
+            }
+        }
+
+    // RGB888 is B, G, R and matches fmt2rgb888()
+    {
+        const size_t size = width * height * 3;
+        std::vector<uint8_t> a(size);
+        std::vector<uint8_t> b(size);
+        auto out = make_output(JPG_OUTPUT_RGB888, JPG_SCALE_NONE, a);
+        CHECK(jpg_decoder_decode(JPG_DECODER_JPEGDEC, src, len, &out) == ESP_ERR_NOT_SUPPORTED);
+        CHECK(jpg_decode(src, len, &out) == ESP_OK);
+        CHECK(fmt2rgb888(src, len, PIXFORMAT_JPEG, b.data()));
+        CHECK(a == b);
+
+        uint8_t* bmp = nullptr;
+        size_t bmp_len = 0;
+        CHECK(fmt2bmp(const_cast<uint8_t*>(src), len, width, height, PIXFORMAT_JPEG, &bmp, &bmp_len));
+        CHECK(bmp_len == size + 54 && bmp[0] == 'B' && bmp[1] == 'M');
+        CHECK(bmp && !memcmp(bmp + 54, a.data(), size));
+        free(bmp);
+    }
+
+    // Rows with a zero mask entry and the bytes past each row are left alone
+    for (int decoder = 0; decoder < JPG_DECODER_MAX; ++decoder)
+        for (jpg_scale_t scale : { JPG_SCALE_4X, JPG_SCALE_8X })
+        {
+            const int w = width >> scale;
+            const int h = height >> scale;
+            const size_t stride = w + 7;
+            std::vector<uint8_t> full(stride * h, 0xAB);
+            std::vector<uint8_t> masked(stride * h, 0xAB);
+            std::vector<uint8_t> mask(h, 1);
+            for (int y = 0; y < h; y += 3)
+                mask[y] = 0;
+            auto out = make_output(JPG_OUTPUT_LUMA, scale, full, stride);
+            CHECK(jpg_decoder_decode(jpg_decoder_t(decoder), src, len, &out) == ESP_OK);
+            out = make_output(JPG_OUTPUT_LUMA, scale, masked, stride);
+            out.row_mask = mask.data();
+            CHECK(jpg_decoder_decode(jpg_decoder_t(decoder), src, len, &out) == ESP_OK);
+            bool ok = true;
+            for (int y = 0; y < h; ++y)
+            {
+                const uint8_t* row = masked.data() + y * stride;
+                if (mask[y])
+                    ok = ok && !memcmp(row, full.data() + y * stride, w);
+                else
+                    for (int x = 0; x < w; ++x)
+                        ok = ok && row[x] == 0xAB;
+                for (size_t x = w; x < stride; ++x)
+                    ok = ok && row[x] == 0xAB;
+            }
+            CHECK(ok);
+        }
+
+    // Errors
+    {
+        std::vector<uint8_t> buf((width >> 3) * (height >> 3) - 1);
+        auto out = make_output(JPG_OUTPUT_LUMA, JPG_SCALE_8X, buf);
+        CHECK(jpg_decode(src, len, &out) == ESP_ERR_INVALID_SIZE);
+        out.stride = (width >> 3) - 1;
+        CHECK(jpg_decode(src, len, &out) == ESP_ERR_INVALID_SIZE);
+        const uint8_t not_jpeg[16] = {};
+        buf.resize(buf.size() + 1);
+        out = make_output(JPG_OUTPUT_LUMA, JPG_SCALE_8X, buf);
+        CHECK(jpg_decode(not_jpeg, sizeof(not_jpeg), &out) == ESP_ERR_INVALID_ARG);
+        CHECK(jpg_decode(src, len, &out) == ESP_OK);
+    }
+
+    // Selection: the public converters keep TJpgDec until told otherwise
+    CHECK(jpg_decoder_get_selected(JPG_OUTPUT_RGB888, JPG_SCALE_NONE) == JPG_DECODER_TJPGD);
+    for (int scale = 0; scale <= JPG_SCALE_MAX; ++scale)
+        CHECK(jpg_decoder_get_selected(JPG_OUTPUT_RGB565, jpg_scale_t(scale)) == JPG_DECODER_TJPGD);
+    CHECK(jpg_decoder_get_selected(JPG_OUTPUT_LUMA, JPG_SCALE_8X) == JPG_DECODER_JPEGDEC);
+    {
+        const size_t size = (width >> 2) * (height >> 2) * 2;
+        std::vector<uint8_t> a(size);
+        std::vector<uint8_t> b(size);
+        auto out = make_output(JPG_OUTPUT_RGB565, JPG_SCALE_4X, b);
+        CHECK(jpg2rgb565(src, len, a.data(), JPG_SCALE_4X));
+        CHECK(jpg_decoder_decode(JPG_DECODER_TJPGD, src, len, &out) == ESP_OK);
+        CHECK(a == b);
+    }
+    CHECK(jpg_decoder_select(JPG_OUTPUT_RGB888, JPG_SCALE_NONE, JPG_DECODER_JPEGDEC) == ESP_ERR_NOT_SUPPORTED);
+    CHECK(jpg_decoder_select(JPG_OUTPUT_LUMA, JPG_SCALE_2X, JPG_DECODER_TJPGD) == ESP_OK);
+    CHECK(jpg_decoder_get_selected(JPG_OUTPUT_LUMA, JPG_SCALE_2X) == JPG_DECODER_TJPGD);
+    {
+        // Only what fits the work buffer is measured
+        std::vector<uint8_t> work((width >> 2) * (height >> 2) * 3);
+        jpg_decoder_timings_t timings;
+        CHECK(jpg_decoder_calibrate(src, len, work.data(), work.size(), 1, &timings) == ESP_OK);
+        CHECK(timings.us[JPG_OUTPUT_RGB888][JPG_SCALE_4X][JPG_DECODER_TJPGD] > 0);
+        CHECK(timings.us[JPG_OUTPUT_RGB888][JPG_SCALE_4X][JPG_DECODER_JPEGDEC] == 0);
+        CHECK(timings.us[JPG_OUTPUT_RGB565][JPG_SCALE_NONE][JPG_DECODER_JPEGDEC] == 0);
+        CHECK(timings.us[JPG_OUTPUT_LUMA][JPG_SCALE_2X][JPG_DECODER_JPEGDEC] == 0);
+        CHECK(jpg_decoder_get_selected(JPG_OUTPUT_LUMA, JPG_SCALE_2X) == JPG_DECODER_TJPGD);
+        CHECK(timings.us[JPG_OUTPUT_LUMA][JPG_SCALE_8X][JPG_DECODER_JPEGDEC] > 0);
+    }
+
+    if (failures)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,179 @@
+// Checks the JPEG encoder session: feeding it lines in bands of any size
+// gives the same image as encoding the whole frame, fmt2jpg() and
+// fmt2jpg_cb() agree, YUV422 encoded as it is keeps its colors, and
+// misuse is refused.
+
+#include "img_converters.h"
+#include "yuv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+static std::vector<uint8_t> read_file(const std::string& path)
+{
+    std::vector<uint8_t> data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+    return data;
+}
+
+static size_t append_jpeg(void* arg, size_t index, const void* data, size_t len)
+{
+    auto out = static_cast<std::vector<uint8_t>*>(arg);
+    if (data)
+        out->insert(out->end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + len);
+    return len;
+}
+
+/// B, G, R to YUV422 with video levels, as the camera sends it
+static std::vector<uint8_t> to_yuv422(const std::vector<uint8_t>& bgr, int width, int height)
+{
+    std::vector<uint8_t> yuv(width * height * 2);
+    for (int i = 0; i < width * height; i += 2)
+    {
+        int u = 0;
+        int v = 0;
+        for (int j = 0; j < 2; ++j)
+        {
+            const int b = bgr[(i + j) * 3], g = bgr[(i + j) * 3 + 1], r = bgr[(i + j) * 3 + 2];
+            yuv[(i + j) * 2] = 16 + (66 * r + 129 * g + 25 * b + 128) / 256;
+            u += 128 + (-38 * r - 74 * g + 112 * b + 128) / 256;
+            v += 128 + (112 * r - 94 * g - 18 * b + 128) / 256;
+        }
+        yuv[i * 2 + 1] = u / 2;
+        yuv[i * 2 + 3] = v / 2;
+    }
+    return yuv;
+}
+
+static std::vector<uint8_t> encode_whole(const std::vector<uint8_t>& src, int width, int height, pixformat_t format)
+{
+    std::vector<uint8_t> out;
+    if (!fmt2jpg_cb(const_cast<uint8_t*>(src.data()), src.size(), width, height, format, 80, append_jpeg, &out))
+        out.clear();
+    return out;
+}
+
+/// Lines in bands of 1, 7, 16 and 100, then whatever is left
+static std::vector<uint8_t> encode_in_bands(const std::vector<uint8_t>& src, int width, int height, pixformat_t format)
+{
+    std::vector<uint8_t> out;
+    jpg_encoder_session_t* session = jpg_encoder_start(width, height, format, 80, append_jpeg, &out);
+    if (!session)
+        return out;
+    const size_t line_len = src.size() / height;
+    const int bands[] = { 1, 7, 16, 100, height };
+    int y = 0;
+    bool ok = true;
+    for (int band : bands)
+    {
+        const int lines = std::min(band, height - y);
+        ok = ok && jpg_encoder_write(session, &src[y * line_len], lines);
+        y += lines;
+    }
+    if (!jpg_encoder_end(session) || !ok)
+        out.clear();
+    return out;
+}
+
+/// Average absolute difference per byte
+static double average_difference(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b)
+{
+    long total = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+        total += abs(a[i] - b[i]);
+    return total/double(a.size());
+}
+
+int main()
+{
+    auto picture = read_file(std::string(PICTURES_DIR) + "/test_outside.jpeg");
+    if (picture.empty())
+    {
+        fprintf(stderr, "Cannot read test picture\n");
+        return 1;
+    }
+    const int width = 480;
+    const int height = 320;
+    std::vector<uint8_t> bgr(width * height * 3);
+    CHECK(fmt2rgb888(picture.data(), picture.size(), PIXFORMAT_JPEG, bgr.data()));
+
+    std::vector<uint8_t> yuv = to_yuv422(bgr, width, height);
+    std::vector<uint8_t> gray(width * height);
+    std::vector<uint8_t> rgb565(width * height * 2);
+    for (int y = 0; y < height; ++y)
+    {
+        yuv422_to_gray(&yuv[y * width * 2], &gray[y * width], width);
+        yuv422_to_rgb565(&yuv[y * width * 2], &rgb565[y * width * 2], width);
+    }
+
+    // Bands give the same bytes as the whole frame, and fmt2jpg() as fmt2jpg_cb()
+    struct { const std::vector<uint8_t>* src; pixformat_t format; } inputs[] = {
+        { &yuv, PIXFORMAT_YUV422 }, { &gray, PIXFORMAT_GRAYSCALE },
+        { &rgb565, PIXFORMAT_RGB565 }, { &bgr, PIXFORMAT_RGB888 },
+    };
+    for (auto& input : inputs)
+    {
+        auto whole = encode_whole(*input.src, width, height, input.format);
+        CHECK(whole.size() > 1000);
+        CHECK(encode_in_bands(*input.src, width, height, input.format) == whole);
+
+        uint8_t* out = nullptr;
+        size_t out_len = 0;
+        CHECK(fmt2jpg(const_cast<uint8_t*>(input.src->data()), input.src->size(), width, height, input.format, 80,
+                      &out, &out_len));
+        CHECK(out && out_len == whole.size() && !memcmp(out, whole.data(), out_len));
+        free(out);
+    }
+
+    // YUV422 goes into the encoder as it is, as BT.601 with video levels: it
+    // comes out close to the RGB it was made from
+    {
+        auto native = encode_whole(yuv, width, height, PIXFORMAT_YUV422);
+        auto direct = encode_whole(bgr, width, height, PIXFORMAT_RGB888);
+        std::vector<uint8_t> a(bgr.size());
+        std::vector<uint8_t> b(bgr.size());
+        CHECK(fmt2rgb888(native.data(), native.size(), PIXFORMAT_JPEG, a.data()));
+        CHECK(fmt2rgb888(direct.data(), direct.size(), PIXFORMAT_JPEG, b.data()));
+        const double native_error = average_difference(a, bgr);
+        const double direct_error = average_difference(b, bgr);
+        printf("average error: yuv422 %.2f, rgb888 %.2f\n", native_error, direct_error);
+        CHECK(native_error < direct_error + 1);
+    }
+
+    // Misuse
+    {
+        std::vector<uint8_t> out;
+        CHECK(!jpg_encoder_start(width, height, PIXFORMAT_JPEG, 80, append_jpeg, &out));
+        CHECK(!jpg_encoder_start(width - 1, height, PIXFORMAT_YUV422, 80, append_jpeg, &out));
+
+        jpg_encoder_session_t* session = jpg_encoder_start(width, height, PIXFORMAT_GRAYSCALE, 80, append_jpeg, &out);
+        CHECK(session);
+        CHECK(jpg_encoder_write(session, gray.data(), height - 16));
+        CHECK(!jpg_encoder_write(session, gray.data(), 17));
+        const size_t written = out.size();
+        CHECK(!jpg_encoder_end(session)); // short of the height: no end of image
+        CHECK(out.size() == written);
+    }
+
+    if (failures)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
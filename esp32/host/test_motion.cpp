@@ -0,0 +1,289 @@
+// Checks the motion grid: masks and weights change what counts as motion,
+// and lines of fully masked cells are neither decoded nor written. Also
+// checks that a frame of half the full size gives the same motion image
+// as a full size one.
+
+#include "defs.h"
+#include "motion.h"
+
+#include "JPEGDEC.h"
+#include "jpge.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+char config_s3_access_key[40];
+char config_s3_secret_key[40];
+char config_gateway_token[80];
+int8_t config_instance_number = 0;
+int config_keepalive_secs = DEFAULT_KEEPALIVE_SECS;
+int config_pixel_threshold = DEFAULT_PIXEL_THRESHOLD;
+int config_percent_threshold = DEFAULT_PERCENT_THRESHOLD;
+int config_noise_sigmas = DEFAULT_NOISE_SIGMAS;
+int config_background_shift = DEFAULT_BACKGROUND_SHIFT;
+bool config_active = true;
+bool config_continuous = false;
+bool config_burst_upload = DEFAULT_BURST_UPLOAD;
+int config_target_fps = DEFAULT_TARGET_FPS;
+int config_target_frame_kb = DEFAULT_TARGET_FRAME_KB;
+bool config_dual_resolution = DEFAULT_DUAL_RESOLUTION;
+bool config_raw_motion = DEFAULT_RAW_MOTION;
+
+void downsample(const camera_fb_t* fb, uint8_t* buf);
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+static std::vector<uint8_t> read_file(const std::string& path)
+{
+    std::vector<uint8_t> data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+    return data;
+}
+
+static camera_fb_t make_fb(std::vector<uint8_t>& data)
+{
+    camera_fb_t fb = {};
+    fb.buf = data.data();
+    fb.len = data.size();
+    fb.format = PIXFORMAT_JPEG;
+    return fb;
+}
+
+class Memory_stream : public jpge::output_stream
+{
+public:
+    bool put_buf(const void* buf, int len) override
+    {
+        data.insert(data.end(), static_cast<const uint8_t*>(buf), static_cast<const uint8_t*>(buf) + len);
+        return true;
+    }
+
+    jpge::uint get_size() const override
+    {
+        return data.size();
+    }
+
+    std::vector<uint8_t> data;
+};
+
+/// Gray level of a test scene at full size coordinates: gradients and a few boxes
+static int scene(int x, int y)
+{
+    int v = 40 + x/16 + y/12;
+    if (x >= 320 && x < 704 && y >= 200 && y < 520)
+        v += 80;
+    if (x >= 1000 && x < 1200 && y >= 800 && y < 1000)
+        v -= 30;
+    return v;
+}
+
+/// The scene as a JPEG of width x height with 4:2:2 sampling, like the OV2640
+static std::vector<uint8_t> encode_scene(int width, int height)
+{
+    const int scale = FRAMESIZE_X/width;
+    Memory_stream stream;
+    jpge::params params;
+    params.m_quality = 90;
+    params.m_subsampling = jpge::H2V1;
+    jpge::jpeg_encoder encoder;
+    if (!encoder.init(&stream, width, height, 3, params))
+        return {};
+    std::vector<uint8_t> line(width * 3);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            int sum = 0;
+            for (int j = 0; j < scale; ++j)
+                for (int i = 0; i < scale; ++i)
+                    sum += scene(x*scale + i, y*scale + j);
+            memset(&line[x * 3], sum/(scale*scale), 3);
+        }
+        encoder.process_scanline(line.data());
+    }
+    encoder.process_scanline(nullptr);
+    return stream.data;
+}
+
+/// Motion between two frames, starting from a fresh reference
+static bool detect(const camera_fb_t& a, const camera_fb_t& b)
+{
+    motion_detect(&a);
+    return motion_detect(&b);
+}
+
+int main()
+{
+    auto outside = read_file(std::string(PICTURES_DIR) + "/test_outside.jpeg");
+    auto inside = read_file(std::string(PICTURES_DIR) + "/test_inside.jpeg");
+    if (outside.empty() || inside.empty())
+    {
+        fprintf(stderr, "Cannot read test pictures\n");
+        return 1;
+    }
+    const auto fb_outside = make_fb(outside);
+    const auto fb_inside = make_fb(inside);
+    constexpr int blocks_x = FRAMESIZE_X/8;
+    constexpr int blocks_y = FRAMESIZE_Y/8;
+
+    // Invalid grids are rejected and leave the grid alone
+    CHECK(!motion_set_grid(0, 1, nullptr, 0, nullptr, 0));
+    CHECK(!motion_set_grid(blocks_x + 1, 1, nullptr, 0, nullptr, 0));
+    const uint8_t short_mask[1] = {};
+    CHECK(!motion_set_grid(4, 1, short_mask, sizeof(short_mask), nullptr, 0));
+    auto grid = motion_get_grid();
+    CHECK(grid.cell_x == DEFAULT_MOTION_CELL_X && grid.cell_y == DEFAULT_MOTION_CELL_Y);
+    CHECK(grid.width == blocks_x/4 && grid.height == blocks_y && grid.active_cells == grid.width*grid.height);
+
+    // No mask
+    CHECK(motion_set_grid(4, 1, nullptr, 0, nullptr, 0));
+    CHECK(!detect(fb_outside, fb_outside));
+    CHECK(detect(fb_outside, fb_inside));
+
+    // Uniform weights make no difference
+    const int cells = grid.width * grid.height;
+    std::vector<uint8_t> weights(cells, 3);
+    CHECK(motion_set_grid(4, 1, nullptr, 0, weights.data(), weights.size()));
+    CHECK(detect(fb_outside, fb_inside));
+
+    // Mask the cells covered by the images: what is left never changes
+    std::vector<uint8_t> mask((cells + 7)/8, 0);
+    for (int gy = 0; gy < 320/8; ++gy)
+        for (int gx = 0; gx < 480/8/4; ++gx)
+        {
+            const int cell = gy * grid.width + gx;
+            mask[cell/8] |= 1 << (cell % 8);
+        }
+    CHECK(motion_set_grid(4, 1, mask.data(), mask.size(), nullptr, 0));
+    CHECK(motion_get_grid().active_cells == cells - (320/8) * (480/8/4));
+    CHECK(!detect(fb_outside, fb_inside));
+
+    // Zero weight has the same effect as masking
+    weights.assign(cells, 1);
+    for (int i = 0; i < cells; ++i)
+        if (mask[i/8] & (1 << (i % 8)))
+            weights[i] = 0;
+    CHECK(motion_set_grid(4, 1, nullptr, 0, weights.data(), weights.size()));
+    CHECK(!detect(fb_outside, fb_inside));
+
+    // Everything masked
+    mask.assign(mask.size(), 0xFF);
+    CHECK(motion_set_grid(4, 1, mask.data(), mask.size(), nullptr, 0));
+    CHECK(motion_get_grid().active_cells == 0);
+    CHECK(!detect(fb_outside, fb_inside));
+
+    // 1x1 cells with all rows from 10 down masked: those lines are left untouched
+    // and the rest matches a full decode
+    static uint8_t full[blocks_x * blocks_y];
+    static uint8_t partial[blocks_x * blocks_y];
+    CHECK(motion_set_grid(1, 1, nullptr, 0, nullptr, 0));
+    downsample(&fb_outside, full);
+    mask.assign((blocks_x * blocks_y + 7)/8, 0);
+    for (int i = 10 * blocks_x; i < blocks_x * blocks_y; ++i)
+        mask[i/8] |= 1 << (i % 8);
+    CHECK(motion_set_grid(1, 1, mask.data(), mask.size(), nullptr, 0));
+    memset(partial, 0xAB, sizeof(partial));
+    downsample(&fb_outside, partial);
+    CHECK(!memcmp(full, partial, 10 * blocks_x));
+    bool untouched = true;
+    for (int i = 10 * blocks_x; i < blocks_x * blocks_y; ++i)
+        untouched = untouched && partial[i] == 0xAB;
+    CHECK(untouched);
+
+    // Half size frames are decoded at 1/4 scale to the same image
+    auto full_jpeg = encode_scene(FRAMESIZE_X, FRAMESIZE_Y);
+    auto half_jpeg = encode_scene(FRAMESIZE_X/2, FRAMESIZE_Y/2);
+    CHECK(!full_jpeg.empty() && !half_jpeg.empty());
+    const auto fb_full = make_fb(full_jpeg);
+    const auto fb_half = make_fb(half_jpeg);
+    static uint8_t half[blocks_x * blocks_y];
+    CHECK(motion_set_grid(1, 1, nullptr, 0, nullptr, 0));
+    downsample(&fb_full, full);
+    downsample(&fb_half, half);
+    int total_diff = 0;
+    int max_diff = 0;
+    for (int i = 0; i < blocks_x * blocks_y; ++i)
+    {
+        const int diff = abs(full[i] - half[i]);
+        total_diff += diff;
+        max_diff = diff > max_diff ? diff : max_diff;
+    }
+    printf("Half size frame: average difference %.2f, max %d\n",
+           total_diff/double(blocks_x * blocks_y), max_diff);
+    CHECK(total_diff <= blocks_x * blocks_y && max_diff <= 16);
+    CHECK(motion_set_grid(4, 1, nullptr, 0, nullptr, 0));
+    CHECK(!detect(fb_full, fb_half));
+
+    // Raw grayscale motion frames, binned and scaled by the sensor, are
+    // averaged to the same image without decoding
+    std::vector<uint8_t> gray(RAW_MOTION_WIDTH * RAW_MOTION_HEIGHT);
+    const int raw_scale = FRAMESIZE_X/RAW_MOTION_WIDTH;
+    for (int y = 0; y < RAW_MOTION_HEIGHT; ++y)
+        for (int x = 0; x < RAW_MOTION_WIDTH; ++x)
+        {
+            int sum = 0;
+            for (int j = 0; j < raw_scale; ++j)
+                for (int i = 0; i < raw_scale; ++i)
+                    sum += scene(x*raw_scale + i, y*raw_scale + j);
+            gray[y * RAW_MOTION_WIDTH + x] = sum/(raw_scale*raw_scale);
+        }
+    camera_fb_t fb_gray = {};
+    fb_gray.buf = gray.data();
+    fb_gray.len = gray.size();
+    fb_gray.width = RAW_MOTION_WIDTH;
+    fb_gray.height = RAW_MOTION_HEIGHT;
+    fb_gray.format = PIXFORMAT_GRAYSCALE;
+    static uint8_t raw[blocks_x * blocks_y];
+    CHECK(motion_set_grid(1, 1, nullptr, 0, nullptr, 0));
+    downsample(&fb_gray, raw);
+    total_diff = 0;
+    max_diff = 0;
+    for (int i = 0; i < blocks_x * blocks_y; ++i)
+    {
+        const int diff = abs(full[i] - raw[i]);
+        total_diff += diff;
+        max_diff = diff > max_diff ? diff : max_diff;
+    }
+    printf("Raw motion frame: average difference %.2f, max %d\n",
+           total_diff/double(blocks_x * blocks_y), max_diff);
+    CHECK(total_diff <= blocks_x * blocks_y && max_diff <= 16);
+    CHECK(motion_set_grid(4, 1, nullptr, 0, nullptr, 0));
+    CHECK(!detect(fb_full, fb_gray));
+    CHECK(detect(fb_gray, fb_inside));
+
+    // Grayscale frames of other sizes are rejected and leave the image alone
+    CHECK(motion_set_grid(1, 1, nullptr, 0, nullptr, 0));
+    memset(partial, 0xAB, sizeof(partial));
+    fb_gray.width = RAW_MOTION_WIDTH - 4;
+    downsample(&fb_gray, partial);
+    untouched = true;
+    for (int i = 0; i < blocks_x * blocks_y; ++i)
+        untouched = untouched && partial[i] == 0xAB;
+    CHECK(untouched);
+
+    // Whichever decoders calibration picks, motion sees the same
+    motion_calibrate_decoder(&fb_full);
+    CHECK(motion_set_grid(4, 1, nullptr, 0, nullptr, 0));
+    CHECK(!detect(fb_full, fb_half));
+    CHECK(!detect(fb_outside, fb_outside));
+    CHECK(detect(fb_outside, fb_inside));
+
+    if (failures)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,126 @@
+// Runs the JPEG quality controller against a simulated sensor whose frame
+// size is inversely proportional to the quality value, with the frames
+// already in the pipeline still at the old quality. Checks that it settles
+// within its dead band, stops changing once there, follows a change of
+// scene, waits for several frames between changes, respects its limits,
+// and goes back to its starting quality without a target.
+
+#include "quality.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <deque>
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+/// Sensor with a pipeline of captured frames
+class Sensor
+{
+public:
+    Sensor(int quality, int pipeline)
+        : quality(quality)
+    {
+        for (int i = 0; i < pipeline; ++i)
+            in_flight.push_back(quality);
+    }
+
+    /// Size of the next frame, for a scene of the given detail
+    size_t next(size_t detail)
+    {
+        const int q = in_flight.front();
+        in_flight.pop_front();
+        in_flight.push_back(quality);
+        // +-5% noise
+        return detail/q*(95 + rand() % 11)/100;
+    }
+
+    int quality;
+
+private:
+    /// Quality of each captured frame not yet returned
+    std::deque<int> in_flight;
+};
+
+/// Run frames and return the number of quality changes
+static int run(Quality_controller& controller, Sensor& sensor, size_t detail, size_t target, int frames)
+{
+    int changes = 0;
+    for (int i = 0; i < frames; ++i)
+    {
+        const int quality = controller.update(sensor.next(detail), target);
+        if (quality != sensor.quality)
+            ++changes;
+        sensor.quality = quality;
+    }
+    return changes;
+}
+
+int main()
+{
+    srand(1);
+    const size_t target = 120*1024;
+    {
+        // A busy scene: 250 KB at quality 12
+        Quality_controller controller(12, 6, 40, 2);
+        Sensor sensor(12, 2);
+        const size_t detail = 250*1024*12;
+        run(controller, sensor, detail, target, 60);
+        const size_t size = detail/controller.get_quality();
+        printf("busy scene: quality %d, %zu KB\n", controller.get_quality(), size/1024);
+        check(size > target*7/8 && size < target*9/8, "busy scene settles near target");
+        check(run(controller, sensor, detail, target, 200) == 0, "no changes once settled");
+
+        // The scene gets quieter
+        const size_t quiet = 60*1024*12;
+        run(controller, sensor, quiet, target, 60);
+        const size_t quiet_size = quiet/controller.get_quality();
+        printf("quiet scene: quality %d, %zu KB\n", controller.get_quality(), quiet_size/1024);
+        check(quiet_size > target*7/8 && quiet_size < target*9/8, "quiet scene settles near target");
+    }
+    {
+        // Cannot reach the target
+        Quality_controller controller(12, 6, 40, 2);
+        Sensor sensor(12, 2);
+        run(controller, sensor, 2000*1024*12, target, 100);
+        check(controller.get_quality() == 40, "clamped at maximum");
+        run(controller, sensor, 10*1024*12, target, 100);
+        check(controller.get_quality() == 6, "clamped at minimum");
+    }
+    {
+        // Several frames are averaged before each change
+        Quality_controller controller(12, 6, 40, 2);
+        int frames = 0;
+        while (controller.update(500*1024, target) == 12 && frames < 10)
+            ++frames;
+        check(frames == 3, "first change after four frames");
+        const int quality = controller.get_quality();
+        frames = 0;
+        while (controller.update(500*1024, target) == quality && frames < 10)
+            ++frames;
+        check(frames == 2 + 3, "next change after the skipped frames and four more");
+    }
+    {
+        // No target
+        Quality_controller controller(12, 6, 40, 2);
+        Sensor sensor(12, 2);
+        check(run(controller, sensor, 250*1024*12, 0, 50) == 0 && controller.get_quality() == 12,
+              "no target keeps quality");
+        check(controller.get_average() > 200*1024, "average tracked without target");
+
+        // Dropping the target goes back to the starting quality
+        run(controller, sensor, 250*1024*12, target, 60);
+        check(controller.get_quality() != 12, "steered away from the start");
+        check(controller.update(250*1024, 0) == 12, "no target restores the starting quality");
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,145 @@
+// Checks the JPEG dimension parser and the tracking of sensor framesize
+// switches: frames of the old size are dropped and counted, the latency
+// is recorded, and a switch that never completes is given up on.
+
+#include "resolution.h"
+#include "stagetiming.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+static std::vector<uint8_t> read_file(const std::string& path)
+{
+    std::vector<uint8_t> data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+    return data;
+}
+
+/// Minimal JPEG header: SOI, an APP0 segment, and a baseline SOF
+static std::vector<uint8_t> make_header(int width, int height)
+{
+    return {
+        0xFF, 0xD8,
+        0xFF, 0xE0, 0x00, 0x04, 0x00, 0x00,
+        0xFF, 0xC0, 0x00, 0x11, 0x08,
+        static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height),
+        static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width),
+        0x03, 0x01, 0x21, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01,
+        0xFF, 0xD9,
+    };
+}
+
+static camera_fb_t make_fb(std::vector<uint8_t>& data)
+{
+    camera_fb_t fb = {};
+    fb.buf = data.data();
+    fb.len = data.size();
+    fb.format = PIXFORMAT_JPEG;
+    return fb;
+}
+
+int main()
+{
+    int width = 0;
+    int height = 0;
+    auto picture = read_file(std::string(PICTURES_DIR) + "/test_inside.jpeg");
+    CHECK(jpeg_get_dimensions(picture.data(), picture.size(), width, height));
+    CHECK(width == 320 && height == 240);
+
+    auto uxga = make_header(1600, 1200);
+    CHECK(jpeg_get_dimensions(uxga.data(), uxga.size(), width, height));
+    CHECK(width == 1600 && height == 1200);
+    CHECK(!jpeg_get_dimensions(uxga.data(), 12, width, height));
+    const uint8_t no_sof[] = { 0xFF, 0xD8, 0xFF, 0xDA, 0x00, 0x02, 0xFF, 0xD9 };
+    CHECK(!jpeg_get_dimensions(no_sof, sizeof(no_sof), width, height));
+    const uint8_t not_jpeg[] = { 0x00, 0xD8, 0xFF, 0xC0, 0x00, 0x11 };
+    CHECK(!jpeg_get_dimensions(not_jpeg, sizeof(not_jpeg), width, height));
+
+    auto svga = make_header(800, 600);
+    const auto fb_uxga = make_fb(uxga);
+    const auto fb_svga = make_fb(svga);
+    {
+        Resolution_switch sw(FRAMESIZE_UXGA, 4);
+        CHECK(!sw.is_settling());
+        CHECK(sw.check_frame(&fb_svga, 0));     // no switch in progress: anything goes
+
+        // Two frames of the old size still in the pipeline
+        sw.start(FRAMESIZE_SVGA, 1000);
+        CHECK(sw.is_settling() && sw.get_framesize() == FRAMESIZE_SVGA);
+        CHECK(!sw.check_frame(&fb_uxga, 20000));
+        CHECK(!sw.check_frame(&fb_uxga, 40000));
+        CHECK(sw.check_frame(&fb_svga, 61000));
+        CHECK(!sw.is_settling());
+        auto stats = sw.get_stats();
+        CHECK(stats.switches == 1 && stats.timeouts == 0);
+        CHECK(stats.last_us == 60000 && stats.max_us == 60000);
+        CHECK(stats.last_settle_frames == 2 && stats.max_settle_frames == 2);
+        CHECK(stage_get_stats(Stage::framesize).last_us == 60000);
+
+        // Back, with the first frame already the new size
+        sw.start(FRAMESIZE_UXGA, 100000);
+        CHECK(sw.check_frame(&fb_uxga, 130000));
+        stats = sw.get_stats();
+        CHECK(stats.switches == 2 && stats.last_us == 30000 && stats.max_us == 60000);
+        CHECK(stats.last_settle_frames == 0 && stats.max_settle_frames == 2);
+
+        // A switch the sensor never makes counts as a timeout only
+        const auto recorded = stage_get_stats(Stage::framesize).count;
+        sw.start(FRAMESIZE_SVGA, 200000);
+        for (int i = 0; i < 3; ++i)
+            CHECK(!sw.check_frame(&fb_uxga, 210000 + i));
+        CHECK(sw.is_settling());
+        CHECK(!sw.check_frame(&fb_uxga, 220000));
+        CHECK(!sw.is_settling());
+        stats = sw.get_stats();
+        CHECK(stats.timeouts == 1 && stats.switches == 2);
+        CHECK(stats.last_us == 30000 && stats.max_us == 60000);
+        CHECK(stats.last_settle_frames == 0 && stats.max_settle_frames == 2);
+        CHECK(stage_get_stats(Stage::framesize).count == recorded);
+    }
+    {
+        // To raw grayscale frames and back
+        std::vector<uint8_t> gray(400 * 300);
+        camera_fb_t fb_gray = {};
+        fb_gray.buf = gray.data();
+        fb_gray.len = gray.size();
+        fb_gray.width = 400;
+        fb_gray.height = 300;
+        fb_gray.format = PIXFORMAT_GRAYSCALE;
+        Resolution_switch sw(FRAMESIZE_UXGA, 4);
+        sw.start_raw(PIXFORMAT_GRAYSCALE, 400, 300, 0);
+        CHECK(sw.is_raw() && sw.is_settling());
+        CHECK(!sw.check_frame(&fb_uxga, 10000));
+        fb_gray.width = 800;
+        CHECK(!sw.check_frame(&fb_gray, 20000));
+        fb_gray.width = 400;
+        CHECK(sw.check_frame(&fb_gray, 30000));
+        auto stats = sw.get_stats();
+        CHECK(stats.switches == 1 && stats.last_us == 30000 && stats.last_settle_frames == 2);
+
+        // A grayscale frame is not taken for a JPEG one
+        sw.start(FRAMESIZE_UXGA, 100000);
+        CHECK(!sw.is_raw() && sw.get_framesize() == FRAMESIZE_UXGA);
+        CHECK(!sw.check_frame(&fb_gray, 110000));
+        CHECK(sw.check_frame(&fb_uxga, 120000));
+    }
+
+    if (failures)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,152 @@
+// Uploads a series of objects through Upload_client to the local S3
+// stand-in (run via s3_standin.py --run), alternating between whole
+// buffers and segmented uploads, some with S3 metadata headers. Checks
+// connection reuse and reads every object back to verify its contents
+// and metadata.
+//
+//   test_upload <uploads> <expected connections> <expected reconnects>
+
+#include "defs.h"
+#include "uploadclient.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+static esp_err_t collect_metadata(esp_http_client_event_t* evt)
+{
+    if (evt->event_id == HTTP_EVENT_ON_HEADER && !strncmp(evt->header_key, "x-amz-meta-", 11))
+    {
+        auto metadata = static_cast<std::string*>(evt->user_data);
+        *metadata += evt->header_key;
+        *metadata += ":";
+        *metadata += evt->header_value;
+        *metadata += "\n";
+    }
+    return ESP_OK;
+}
+
+static bool verify_object(int port, const char* resource, const std::vector<unsigned char>& expected,
+                          const std::string& expected_metadata)
+{
+    std::string metadata;
+    esp_http_client_config_t config {
+        .host = "127.0.0.1",
+        .port = port,
+        .path = resource,
+        .event_handler = collect_metadata,
+        .transport_type = HTTP_TRANSPORT_OVER_TCP,
+        .user_data = &metadata,
+    };
+    auto client = esp_http_client_init(&config);
+    std::vector<unsigned char> body;
+    bool ok = esp_http_client_open(client, 0) == ESP_OK &&
+        esp_http_client_fetch_headers(client) == static_cast<int64_t>(expected.size());
+    char buf[4096];
+    int n;
+    while (ok && (n = esp_http_client_read(client, buf, sizeof(buf))) > 0)
+        body.insert(body.end(), buf, buf + n);
+    esp_http_client_cleanup(client);
+    if (ok && metadata != expected_metadata)
+        fprintf(stderr, "%s: metadata '%s', expected '%s'\n", resource,
+                metadata.c_str(), expected_metadata.c_str());
+    return ok && body == expected && metadata == expected_metadata;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s <uploads> <expected connections> <expected reconnects>\n", argv[0]);
+        return 2;
+    }
+    const int uploads = atoi(argv[1]);
+    const unsigned expected_connections = atoi(argv[2]);
+    const unsigned expected_reconnects = atoi(argv[3]);
+    const char* port = getenv("S3_STANDIN_PORT");
+    const char* access_key = getenv("S3_STANDIN_ACCESS_KEY");
+    const char* secret_key = getenv("S3_STANDIN_SECRET_KEY");
+    if (!port || !access_key || !secret_key)
+    {
+        fprintf(stderr, "Run through s3_standin.py --run\n");
+        return 2;
+    }
+
+    Upload_client client("127.0.0.1", atoi(port), HTTP_TRANSPORT_OVER_TCP,
+                         access_key, secret_key);
+    std::vector<unsigned char> data(100000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<unsigned char>(i * 7);
+
+    time_t now = time(nullptr);
+    struct tm timeinfo;
+    gmtime_r(&now, &timeinfo);
+    // Unsorted, to check that the signature sorts them
+    const upload_header headers[] = {
+        { "x-amz-meta-seq", "42" },
+        { "x-amz-meta-capture-us", "31250" },
+        { "x-amz-meta-aec", "310" },
+    };
+    const std::string expected_metadata = "x-amz-meta-seq:42\nx-amz-meta-capture-us:31250\nx-amz-meta-aec:310\n";
+    int failed = 0;
+    for (int i = 0; i < uploads; ++i)
+    {
+        char resource[40];
+        snprintf(resource, sizeof(resource), "/hal9kcam/test-%d.jpg", i);
+        // Every third upload has metadata, which must not leak into the next
+        const bool with_metadata = i % 3 == 2;
+        esp_err_t err;
+        if (with_metadata)
+        {
+            const upload_segment whole = { data.data(), data.size() };
+            err = client.put(resource, &whole, 1, timeinfo,
+                             "application/octet-stream",
+                             headers, sizeof(headers)/sizeof(headers[0]));
+        }
+        else if (i % 2)
+        {
+            // Uneven slices, as from a ring buffer
+            const upload_segment segments[] = {
+                { data.data(), 1000 },
+                { data.data() + 1000, 0 },
+                { data.data() + 1000, UPLOAD_CHUNK_SIZE + 1 },
+                { data.data() + 1000 + UPLOAD_CHUNK_SIZE + 1, data.size() - 1000 - UPLOAD_CHUNK_SIZE - 1 },
+            };
+            err = client.put(resource, segments, sizeof(segments)/sizeof(segments[0]), timeinfo);
+        }
+        else
+            err = client.put(resource, data.data(), data.size(), timeinfo);
+        if (err != ESP_OK)
+        {
+            fprintf(stderr, "Upload %d failed: %s, status %d\n", i,
+                    esp_err_to_name(err), client.get_status_code());
+            ++failed;
+        }
+        else if (!verify_object(atoi(port), resource, data,
+                                with_metadata ? expected_metadata : std::string()))
+        {
+            fprintf(stderr, "Upload %d: stored object differs\n", i);
+            ++failed;
+        }
+    }
+
+    const auto& stats = client.get_stats();
+    printf("requests %u failures %u connections %u reused %u reconnects %u handshake avg %u ms max %u ms\n",
+           (unsigned) stats.requests, (unsigned) stats.failures,
+           (unsigned) stats.connections, (unsigned) stats.reused,
+           (unsigned) stats.reconnects,
+           (unsigned) (stats.connections ? stats.total_handshake_ms/stats.connections : 0),
+           (unsigned) stats.max_handshake_ms);
+    if (failed || stats.requests != static_cast<uint32_t>(uploads) || stats.failures ||
+        stats.connections != expected_connections || stats.reconnects != expected_reconnects)
+    {
+        fprintf(stderr, "FAILED: expected %d requests, %u connections and %u reconnects\n",
+                uploads, expected_connections, expected_reconnects);
+        return 1;
+    }
+    return 0;
+}
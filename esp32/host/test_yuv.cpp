@@ -0,0 +1,87 @@
+// Checks that the YUV422 line converters are bit-exact against yuv2rgb(),
+// the lookup table they replace, for every Y, U and V, and that
+// fmt2rgb888() gives the same output through them.
+
+#include "img_converters.h"
+#include "yuv.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+int main()
+{
+    // One line per (U, V): every Y as Y0, and 255 - Y as Y1
+    const size_t width = 512;
+    std::vector<uint8_t> line(width * 2);
+    std::vector<uint8_t> rgb(width * 3), bgr(width * 3), rgb565(width * 2), gray(width);
+    int mismatches = 0;
+    for (int u = 0; u < 256; ++u)
+        for (int v = 0; v < 256; ++v)
+        {
+            for (size_t i = 0; i < width; i += 2)
+            {
+                line[2*i] = i/2;
+                line[2*i + 1] = u;
+                line[2*i + 2] = 255 - i/2;
+                line[2*i + 3] = v;
+            }
+            yuv422_to_rgb888(line.data(), rgb.data(), width);
+            yuv422_to_bgr888(line.data(), bgr.data(), width);
+            yuv422_to_rgb565(line.data(), rgb565.data(), width);
+            yuv422_to_gray(line.data(), gray.data(), width);
+            for (size_t i = 0; i < width; ++i)
+            {
+                const uint8_t y = line[2*i];
+                uint8_t r, g, b;
+                yuv2rgb(y, u, v, &r, &g, &b);
+                const uint16_t c = (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+                const bool ok = rgb[3*i] == r && rgb[3*i + 1] == g && rgb[3*i + 2] == b &&
+                    bgr[3*i] == b && bgr[3*i + 1] == g && bgr[3*i + 2] == r &&
+                    rgb565[2*i] == c >> 8 && rgb565[2*i + 1] == (c & 0xFF) &&
+                    gray[i] == y;
+                if (!ok && mismatches++ < 10)
+                    fprintf(stderr, "y %d u %d v %d: expected %d %d %d\n", y, u, v, r, g, b);
+            }
+        }
+    CHECK(mismatches == 0);
+
+    // yuv422_to_gray() takes the Y bytes and writes exactly width pixels
+    {
+        const uint8_t src[12] = { 1, 100, 2, 200, 3, 100, 4, 200, 5, 100, 6, 200 };
+        uint8_t out[7] = { 0, 0, 0, 0, 0, 0, 0xAB };
+        yuv422_to_gray(src, out, 6);
+        CHECK(!memcmp(out, "\1\2\3\4\5\6\xAB", 7));
+    }
+
+    // fmt2rgb888() converts through the line converter
+    {
+        const int w = 64;
+        const int h = 4;
+        std::vector<uint8_t> frame(w * h * 2);
+        for (size_t i = 0; i < frame.size(); ++i)
+            frame[i] = i * 37 + (i >> 5);
+        std::vector<uint8_t> out(w * h * 3);
+        CHECK(fmt2rgb888(frame.data(), frame.size(), PIXFORMAT_YUV422, out.data()));
+        bool ok = true;
+        for (int i = 0; i < w * h; ++i)
+        {
+            const uint8_t* pair = &frame[4 * (i/2)];
+            uint8_t r, g, b;
+            yuv2rgb(pair[i % 2 ? 2 : 0], pair[1], pair[3], &r, &g, &b);
+            ok = ok && out[3*i] == b && out[3*i + 1] == g && out[3*i + 2] == r;
+        }
+        CHECK(ok);
+    }
+
+    if (failures)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
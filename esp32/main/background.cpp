@@ -0,0 +1,95 @@
+#include "background.h"
+#include "framediff.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+/// Cells per call of count_changed_pixels(); a multiple of FRAMEDIFF_ALIGNMENT
+static constexpr size_t CHUNK_CELLS = 64;
+
+void Background_model::reset(const uint8_t* frame, size_t cells)
+{
+    mean.resize(cells);
+    variance.assign(cells, 0);
+    background.resize(cells + FRAMEDIFF_ALIGNMENT);
+    const auto address = reinterpret_cast<uintptr_t>(background.data());
+    background_offset = (FRAMEDIFF_ALIGNMENT - address % FRAMEDIFF_ALIGNMENT) % FRAMEDIFF_ALIGNMENT;
+    memcpy(get_background(), frame, cells);
+    for (size_t i = 0; i < cells; ++i)
+        mean[i] = frame[i] << 8;
+}
+
+uint8_t* Background_model::get_background()
+{
+    return background.data() + background_offset;
+}
+
+const uint8_t* Background_model::get_background() const
+{
+    return background.data() + background_offset;
+}
+
+size_t Background_model::size() const
+{
+    return mean.size();
+}
+
+uint8_t Background_model::get_mean(size_t cell) const
+{
+    return get_background()[cell];
+}
+
+int Background_model::get_deviation_x16(size_t cell) const
+{
+    // variance is in 1/16 luma^2
+    return static_cast<int>(sqrtf(variance[cell] * 16.0f));
+}
+
+uint32_t Background_model::update(const uint8_t* frame,
+                                  const cell_run* runs, size_t run_count,
+                                  const uint8_t* weights,
+                                  int min_threshold, int sigmas, int alpha_shift)
+{
+    uint8_t* bg = get_background();
+    const bool fixed = !sigmas && !weights;
+    const int32_t sigmas2 = sigmas * sigmas;
+    uint32_t changes = 0;
+    for (size_t r = 0; r < run_count; ++r)
+    {
+        const size_t end = runs[r].start + runs[r].length;
+        size_t i = runs[r].start;
+        while (i < end)
+        {
+            // Chunks end on aligned cells, so all but the first and last of
+            // a run are aligned in both buffers
+            const size_t chunk_end = std::min(end, (i/CHUNK_CELLS + 1) * CHUNK_CELLS);
+            // Cells further than min_threshold: with a fixed threshold these
+            // are the changes, otherwise the candidates for the noise test
+            const int candidates = count_changed_pixels(frame + i, bg + i, chunk_end - i, min_threshold);
+            if (fixed)
+                changes += candidates;
+            const bool test = candidates && !fixed;
+            for (; i < chunk_end; ++i)
+            {
+                const int32_t d = frame[i] - bg[i];
+                // Squared deviation in Q12.4, saturated to 16 bits
+                int32_t d2 = d * d * 16;
+                if (d2 > 0xFFFF)
+                    d2 = 0xFFFF;
+                if (test && abs(d) > min_threshold && d2 > sigmas2 * variance[i])
+                    changes += weights ? weights[i] : 1;
+
+                int32_t m = mean[i];
+                m += ((frame[i] << 8) - m) >> alpha_shift;
+                mean[i] = m;
+                bg[i] = (m + 128) >> 8;
+                if (sigmas)
+                    variance[i] += (d2 - variance[i]) >> alpha_shift;
+            }
+        }
+    }
+    return changes;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/// A span of grid cells that are not masked
+struct cell_run
+{
+    uint16_t start;
+    uint16_t length;
+};
+
+/// Per-cell background: an exponential moving average of the cell value
+/// and of its squared deviation, both 16-bit fixed point. A cell has
+/// changed if it is further from its mean than both min_threshold and
+/// sigmas standard deviations of its own noise. The cells further than
+/// min_threshold are found first, a chunk at a time, with
+/// count_changed_pixels(); only chunks with such cells get the noise test.
+class Background_model
+{
+public:
+    /// Start over from frame, which has one byte per cell
+    void reset(const uint8_t* frame, size_t cells);
+
+    /// Return the summed weight (1 per cell if weights is null) of the cells
+    /// in runs that differ from the model, then blend the frame into it with
+    /// weight 1/2^alpha_shift. sigmas == 0 disables the noise estimate.
+    uint32_t update(const uint8_t* frame,
+                    const cell_run* runs, size_t run_count,
+                    const uint8_t* weights,
+                    int min_threshold, int sigmas, int alpha_shift);
+
+    size_t size() const;
+
+    /// Background value of a cell
+    uint8_t get_mean(size_t cell) const;
+
+    /// Noise standard deviation of a cell, in 1/16 luma steps
+    int get_deviation_x16(size_t cell) const;
+
+private:
+    /// Mean rounded to 8 bits, aligned to FRAMEDIFF_ALIGNMENT like the
+    /// motion buffer so count_changed_pixels() can use its vector path
+    uint8_t* get_background();
+    const uint8_t* get_background() const;
+
+    std::vector<uint16_t> mean;         ///< Q8.8
+    std::vector<uint16_t> variance;     ///< Q12.4, saturating
+    std::vector<uint8_t> background;    ///< Holds the aligned background at background_offset
+    size_t background_offset = 0;
+};
@@ -0,0 +1,62 @@
+#include "burst.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void Burst::clear()
+{
+    frames = 0;
+    segment_count = 0;
+    size = 0;
+}
+
+bool Burst::add(const upload_segment* frame_segments, size_t count, int64_t time_ms,
+                const char* content_type, const char* extra_headers)
+{
+    if (frames >= BURST_MAX_FRAMES || count > MAX_SEGMENTS_PER_FRAME)
+        return false;
+    size_t frame_size = 0;
+    for (size_t i = 0; i < count; ++i)
+        frame_size += frame_segments[i].size;
+    // Each part but the first starts with the CRLF ending the previous one
+    auto header = headers[frames];
+    const int len = snprintf(header, PART_HEADER_SIZE,
+                             "%s--%s\r\nContent-Type: %s\r\nContent-Length: %u\r\n"
+                             "X-Timestamp: %lld.%03d\r\n%s\r\n",
+                             frames ? "\r\n" : "",
+                             BURST_BOUNDARY,
+                             content_type,
+                             (unsigned) frame_size,
+                             (long long) (time_ms/1000),
+                             (int) (time_ms % 1000),
+                             extra_headers ? extra_headers : "");
+    if (len < 0 || static_cast<size_t>(len) >= PART_HEADER_SIZE)
+        return false;
+    segments[segment_count++] = { reinterpret_cast<const unsigned char*>(header), (size_t) len };
+    size += len;
+    for (size_t i = 0; i < count; ++i)
+        if (frame_segments[i].size)
+            segments[segment_count++] = frame_segments[i];
+    size += frame_size;
+    ++frames;
+    return true;
+}
+
+size_t Burst::get_frame_count() const
+{
+    return frames;
+}
+
+const upload_segment* Burst::get_segments(size_t& count)
+{
+    const int len = snprintf(trailer, sizeof(trailer), "\r\n--%s--\r\n", BURST_BOUNDARY);
+    segments[segment_count] = { reinterpret_cast<const unsigned char*>(trailer), (size_t) len };
+    count = segment_count + 1;
+    return segments;
+}
+
+size_t Burst::get_size() const
+{
+    // "\r\n--" boundary "--\r\n"
+    return size + 8 + strlen(BURST_BOUNDARY);
+}
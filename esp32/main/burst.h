@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "uploadclient.h"
+
+/// Maximum number of frames in one burst object
+constexpr const size_t BURST_MAX_FRAMES = 8;
+
+constexpr const char* BURST_BOUNDARY = "hal32camframe";
+
+/// Content type of a burst object
+constexpr const char* BURST_CONTENT_TYPE = "multipart/x-mixed-replace; boundary=hal32camframe";
+
+/// Builds a multipart/x-mixed-replace (MJPEG) object from several frames
+/// without copying them. Each part carries the frame's capture time as
+///
+///   X-Timestamp: <seconds since the epoch>.<milliseconds>
+///
+/// followed by any extra headers given for the frame.
+///
+/// The frames must stay valid until the object has been uploaded.
+class Burst
+{
+public:
+    void clear();
+
+    /// Add a frame made up of one or more segments. Return false if the burst is
+    /// full or the part header would not fit.
+    /// extra_headers, if given, are complete "Name: value\r\n" lines.
+    bool add(const upload_segment* segments, size_t count, int64_t time_ms,
+             const char* content_type = "image/jpeg",
+             const char* extra_headers = nullptr);
+
+    size_t get_frame_count() const;
+
+    /// Return the segments making up the whole object
+    const upload_segment* get_segments(size_t& count);
+
+    /// Total object size
+    size_t get_size() const;
+
+private:
+    static constexpr const size_t MAX_SEGMENTS_PER_FRAME = 2;
+    static constexpr const size_t PART_HEADER_SIZE = 256;
+
+    size_t frames = 0;
+    size_t segment_count = 0;
+    size_t size = 0;
+    char headers[BURST_MAX_FRAMES][PART_HEADER_SIZE];
+    char trailer[32];
+    upload_segment segments[BURST_MAX_FRAMES * (MAX_SEGMENTS_PER_FRAME + 1) + 1];
+};
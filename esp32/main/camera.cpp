@@ -1,12 +1,19 @@
 #include "defs.h"
+#include "framequeue.h"
+#include "framering.h"
 #include "heartbeat.h"
+#include "histogram.h"
 #include "motion.h"
-#include "upload.h"
+#include "quality.h"
+#include "resolution.h"
+#include "stagetiming.h"
 
 #include <esp_log.h>
 #include <esp_system.h>
+#include <esp_timer.h>
 #include <nvs_flash.h>
 #include <sys/param.h>
+#include <sys/time.h>
 #include <string.h>
 
 #include "freertos/FreeRTOS.h"
@@ -51,19 +58,42 @@ static camera_config_t camera_config = {
     .pin_pclk = CAM_PIN_PCLK,
 
     // XCLK 20MHz or 10MHz for OV2640 double FPS (Experimental)
-    .xclk_freq_hz = 10000000, //20000000,
+    .xclk_freq_hz = CAMERA_XCLK_HZ,
     .ledc_timer = LEDC_TIMER_0,
     .ledc_channel = LEDC_CHANNEL_0,
 
     .pixel_format = PIXFORMAT_JPEG,
     .frame_size = FRAMESIZE,
 
-    .jpeg_quality = 12, //0-63 lower number means higher quality
-    .fb_count = 1,       //if more than one, i2s runs in continuous mode. Use only with JPEG
+    .jpeg_quality = JPEG_QUALITY, //0-63 lower number means higher quality
+    .fb_count = CAMERA_FB_COUNT, //if more than one, i2s runs in continuous mode. Use only with JPEG
     .fb_location = CAMERA_FB_IN_PSRAM,
-    .grab_mode = CAMERA_GRAB_WHEN_EMPTY,
+    // The sensor keeps capturing while we process; always take the newest frame
+    .grab_mode = CAMERA_FB_COUNT > 1 ? CAMERA_GRAB_LATEST : CAMERA_GRAB_WHEN_EMPTY,
 };
 
+/// Sizes of captured frames, for the heartbeat
+static Histogram frame_sizes;
+
+/// Frames already captured when the quality changes are not counted
+static Quality_controller quality_controller(JPEG_QUALITY, JPEG_QUALITY_MIN, JPEG_QUALITY_MAX,
+                                             CAMERA_FB_COUNT);
+
+static Resolution_switch resolution_switch(FRAMESIZE, MAX_SETTLE_FRAMES);
+
+/// What the sensor delivers
+enum class Capture_mode
+{
+    full,           ///< FRAMESIZE JPEG
+    motion_jpeg,    ///< MOTION_FRAMESIZE JPEG
+    motion_raw,     ///< RAW_MOTION_WIDTH x RAW_MOTION_HEIGHT grayscale
+};
+
+static Capture_mode capture_mode = Capture_mode::full;
+
+/// ov2640_sensor_mode_t: 2x2 binned 800x600 readout of the whole array
+constexpr const int OV2640_MODE_SVGA = 1;
+
 static esp_err_t init_camera()
 {
     //initialize the camera
@@ -73,10 +103,71 @@ static esp_err_t init_camera()
         ESP_LOGE(TAG, "Camera Init Failed");
         return err;
     }
+    esp_camera_set_exposure_interval(EXPOSURE_READ_INTERVAL_MS);
 
     return ESP_OK;
 }
 
+/// Switch the sensor and the driver back to JPEG frames of framesize.
+/// The driver always gets the FRAMESIZE buffer size, as later switches
+/// between JPEG sizes only change the sensor.
+static bool set_jpeg(sensor_t* sensor, framesize_t framesize)
+{
+    if (sensor->set_pixformat(sensor, PIXFORMAT_JPEG) ||
+        sensor->set_framesize(sensor, framesize) ||
+        esp_camera_set_capture_format(PIXFORMAT_JPEG, FRAMESIZE_X, FRAMESIZE_Y) != ESP_OK)
+        return false;
+    sensor->set_quality(sensor, quality_controller.get_quality());
+    return true;
+}
+
+/// Return false if the sensor cannot deliver mode
+static bool set_capture_mode(Capture_mode mode)
+{
+    if (mode == capture_mode)
+        return true;
+    auto sensor = esp_camera_sensor_get();
+    if (!sensor)
+        return false;
+    const int64_t start_us = esp_timer_get_time();
+    if (mode == Capture_mode::motion_raw)
+    {
+        if (sensor->id.PID != OV2640_PID)
+            return false;
+        // The sensor bins to 800x600 and its DSP scales that down, so the
+        // frames cover the same field of view as the JPEG ones
+        if (sensor->set_pixformat(sensor, PIXFORMAT_GRAYSCALE) ||
+            sensor->set_res_raw(sensor, OV2640_MODE_SVGA, 0, 0, 0, 0, 0,
+                                FRAMESIZE_X/2, FRAMESIZE_Y/2,
+                                RAW_MOTION_WIDTH, RAW_MOTION_HEIGHT, true, true) ||
+            esp_camera_set_capture_format(PIXFORMAT_GRAYSCALE,
+                                          RAW_MOTION_WIDTH, RAW_MOTION_HEIGHT) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Cannot set raw motion frames");
+            if (!set_jpeg(sensor, resolution_switch.get_framesize()))
+                ESP_LOGE(TAG, "Cannot restore JPEG frames");
+            return false;
+        }
+        resolution_switch.start_raw(PIXFORMAT_GRAYSCALE, RAW_MOTION_WIDTH, RAW_MOTION_HEIGHT,
+                                    start_us);
+    }
+    else
+    {
+        const framesize_t framesize = mode == Capture_mode::full ? FRAMESIZE : MOTION_FRAMESIZE;
+        const bool ok = capture_mode == Capture_mode::motion_raw
+            ? set_jpeg(sensor, framesize)
+            : !sensor->set_framesize(sensor, framesize);
+        if (!ok)
+        {
+            ESP_LOGE(TAG, "Cannot set framesize %d", (int) framesize);
+            return false;
+        }
+        resolution_switch.start(framesize, start_us);
+    }
+    capture_mode = mode;
+    return true;
+}
+
 void flash_indicator_led()
 {
     gpio_set_level(LED_PIN, true);
@@ -85,17 +176,29 @@ void flash_indicator_led()
 }
 
 
-void camera_task(void*)
+void camera_task(void* arg)
 {
+    auto ring = static_cast<Frame_ring*>(arg);
     if (init_camera() != ESP_OK)
         return;
 
     time_t last_heartbeat = 0;
     time_t last_pic = 0;
+    int post_roll = 0;
     
+    TickType_t frame_start = xTaskGetTickCount();
     while (1)
     {
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        // Pace the loop to the target frame rate, but not while waiting for a framesize switch
+        if (config_target_fps > 0 && !resolution_switch.is_settling())
+        {
+            const TickType_t period = pdMS_TO_TICKS(1000/config_target_fps);
+            const TickType_t elapsed = xTaskGetTickCount() - frame_start;
+            if (elapsed < period)
+                vTaskDelay(period - elapsed);
+        }
+        frame_start = xTaskGetTickCount();
+        const int64_t frame_start_us = esp_timer_get_time();
 
         // Get current time
         time_t current = 0;
@@ -105,12 +208,34 @@ void camera_task(void*)
 
         if (current - last_heartbeat > config_keepalive_secs)
         {
-            heartbeat(timeinfo, last_pic);
+            const auto ring_stats = ring->get_stats();
+            ESP_LOGI(TAG, "Frame ring: %d frames, %zu bytes, %.1f s of history",
+                     ring_stats.frames, ring_stats.used, ring_stats.history_secs);
+            ESP_LOGI(TAG, "Average us: capture %u store %u decode %u diff %u upload %u frame %u",
+                     (unsigned) stage_get_average_us(Stage::capture),
+                     (unsigned) stage_get_average_us(Stage::store),
+                     (unsigned) stage_get_average_us(Stage::decode),
+                     (unsigned) stage_get_average_us(Stage::diff),
+                     (unsigned) stage_get_average_us(Stage::upload),
+                     (unsigned) stage_get_average_us(Stage::frame));
+            heartbeat(timeinfo, last_pic, ring_stats, frame_sizes.get_stats(),
+                      quality_controller.get_quality(), resolution_switch.get_stats());
             last_heartbeat = current;
         }
 
         if (config_active)
         {
+            // In dual resolution mode, only the frames after motion are full size
+            Capture_mode mode = Capture_mode::full;
+            if (config_dual_resolution && !post_roll)
+                mode = config_raw_motion ? Capture_mode::motion_raw : Capture_mode::motion_jpeg;
+            if (!set_capture_mode(mode) && mode == Capture_mode::motion_raw)
+            {
+                ESP_LOGW(TAG, "Raw motion frames not available, using JPEG");
+                config_raw_motion = false;
+                set_capture_mode(Capture_mode::motion_jpeg);
+            }
+
             flash_indicator_led();
             char ts[20];
             strftime(ts, sizeof(ts), "%Y%m%d%H%M%S", &timeinfo);
@@ -118,21 +243,100 @@ void camera_task(void*)
 #if USE_FLASH
             gpio_set_level((gpio_num_t) 4, true);
             vTaskDelay(100 / portTICK_PERIOD_MS);
+            // The latest frame was exposed before the flash came on
+            esp_camera_fb_return(esp_camera_fb_get());
 #endif
+            const int64_t capture_start_us = esp_timer_get_time();
             auto pic = esp_camera_fb_get();
+            stage_record(Stage::capture, esp_timer_get_time() - capture_start_us);
             gpio_set_level((gpio_num_t) 4, false);
             if (!pic)
             {
                 ESP_LOGE(TAG, "No picture taken!");
                 continue;
             }
+            if (!resolution_switch.check_frame(pic, esp_timer_get_time()))
+            {
+                printf("captured before framesize switch\n");
+                esp_camera_fb_return(pic);
+                continue;
+            }
             printf("size: %zu...", pic->len);
+            const bool jpeg = pic->format == PIXFORMAT_JPEG;
+            if (jpeg)
+                frame_sizes.add(pic->len);
 
-            if (motion_detect(pic, timeinfo))
-                last_pic = current;
+            // Wall clock time of capture, from the frame's time since boot
+            struct timeval now;
+            gettimeofday(&now, nullptr);
+            const int64_t age_us = esp_timer_get_time() -
+                (pic->timestamp.tv_sec * 1000000LL + pic->timestamp.tv_usec);
+            const int64_t time_ms = (now.tv_sec * 1000000LL + now.tv_usec - age_us)/1000;
+
+            // Raw motion frames are only looked at, never uploaded
+            uint32_t seq;
+            bool stored = false;
+            if (jpeg)
+            {
+                Stage_timer timer(Stage::store);
+                stored = ring->push(pic, time_ms, seq);
+            }
+            // Pick the JPEG decoders for motion on the first frame
+            static bool decoders_calibrated = false;
+            if (jpeg && !decoders_calibrated)
+            {
+                motion_calibrate_decoder(pic);
+                decoders_calibrated = true;
+            }
+            const bool motion = motion_detect(pic);
             
             // Release buffer
+            const size_t pic_len = pic->len;
             esp_camera_fb_return(pic);
+
+            // Adjust the quality between frames, for full size frames only
+            const int quality = quality_controller.get_quality();
+            if (jpeg && capture_mode == Capture_mode::full &&
+                quality_controller.update(pic_len, config_target_frame_kb*1024) != quality)
+            {
+                auto sensor = esp_camera_sensor_get();
+                if (sensor)
+                    sensor->set_quality(sensor, quality_controller.get_quality());
+            }
+            stage_record(Stage::frame, esp_timer_get_time() - frame_start_us);
+
+            if (!jpeg)
+            {
+                // The full size frames from the next one on are uploaded
+                if (motion)
+                {
+                    last_pic = current;
+                    post_roll = POST_ROLL_FRAMES;
+                }
+                continue;
+            }
+            if (!stored)
+            {
+                ESP_LOGW(TAG, "Frame ring full");
+                continue;
+            }
+            if (motion || post_roll > 0)
+            {
+                // Upload this frame along with any not yet uploaded frames leading up to it
+                uint32_t seqs[PRE_ROLL_FRAMES + 1];
+                const auto count = ring->claim_latest(PRE_ROLL_FRAMES + 1, seqs);
+                if (motion)
+                {
+                    last_pic = current;
+                    post_roll = POST_ROLL_FRAMES;
+                }
+                else
+                    --post_roll;
+                for (size_t i = 0; i < count; ++i)
+                    frame_queue_push(seqs[i], post_roll == 0 && i == count - 1);
+            }
         }
+        else
+            vTaskDelay(100 / portTICK_PERIOD_MS);
     }
 }
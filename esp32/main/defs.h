@@ -9,9 +9,15 @@ constexpr const char* S3_ACCESS_KEY = "s3a";
 constexpr const char* S3_SECRET_KEY = "s3s";
 constexpr const char* INSTANCE_KEY = "inst";
 constexpr const char* GATEWAY_TOKEN_KEY = "gwt";
+constexpr const char* MOTION_GRID_KEY = "grid";
+constexpr const char* MOTION_MASK_KEY = "gridm";
+constexpr const char* MOTION_WEIGHTS_KEY = "gridw";
 
 constexpr const int DEFAULT_KEEPALIVE_SECS = 60;
 
+constexpr const char* S3_HOST = "minio.hal9k.dk";
+constexpr const int S3_PORT = 443;
+
 constexpr const auto LED_PIN = (gpio_num_t) 12;
 
 extern char config_s3_access_key[];
@@ -21,8 +27,15 @@ extern int8_t config_instance_number;
 extern int config_keepalive_secs;
 extern int config_pixel_threshold;
 extern int config_percent_threshold;
+extern int config_noise_sigmas;
+extern int config_background_shift;
 extern bool config_active;
 extern bool config_continuous;
+extern bool config_burst_upload;
+extern int config_target_fps;
+extern int config_target_frame_kb;
+extern bool config_dual_resolution;
+extern bool config_raw_motion;
 
 constexpr const char* TAG = "HAL32CAM";
 
@@ -31,8 +44,86 @@ constexpr const framesize_t FRAMESIZE = FRAMESIZE_UXGA;
 constexpr const int FRAMESIZE_X = 1600;
 constexpr const int FRAMESIZE_Y = 1200;
 
+/// In dual resolution mode the sensor runs at this size, half of FRAMESIZE,
+/// until motion is seen, and switches to FRAMESIZE for the frames after it
+constexpr const framesize_t MOTION_FRAMESIZE = FRAMESIZE_SVGA;
+constexpr const bool DEFAULT_DUAL_RESOLUTION = false;
+
+/// With raw motion frames, the motion frames of dual resolution mode are
+/// grayscale instead of JPEG: the OV2640 bins to SVGA and scales the window
+/// down to this size, so there is nothing to decode. OV2640 only.
+constexpr const int RAW_MOTION_WIDTH = FRAMESIZE_X/4;
+constexpr const int RAW_MOTION_HEIGHT = FRAMESIZE_Y/4;
+constexpr const bool DEFAULT_RAW_MOTION = false;
+
+/// Frames of the old size dropped after a framesize switch before giving up on it
+constexpr const int MAX_SETTLE_FRAMES = 8;
+
+/// Camera frame buffers in PSRAM. With more than one the sensor captures
+/// continuously and we always process the newest frame.
+constexpr const int CAMERA_FB_COUNT = 2;
+
+/// Sensor clock. 20 MHz doubles the OV2640 frame rate but needs the JPEG
+/// copy out of the DMA buffers to keep up; the heartbeat reports it along
+/// with the capture rate and driver drops so the two can be compared.
+constexpr const int CAMERA_XCLK_HZ = 10000000;
+
+/// Exposure and gain change slowly, so the uploaded metadata uses a reading
+/// at most this old rather than reading the sensor for every frame
+constexpr const int EXPOSURE_READ_INTERVAL_MS = 1000;
+
+/// JPEG quality (0-63, lower is better) at startup, and the range the
+/// quality controller may use
+constexpr const int JPEG_QUALITY = 12;
+constexpr const int JPEG_QUALITY_MIN = 6;
+constexpr const int JPEG_QUALITY_MAX = 40;
+
+/// The quality controller steers the average frame size toward this
+/// (0 = keep JPEG_QUALITY). Well below the UXGA frame buffer of 375 KB.
+constexpr const int DEFAULT_TARGET_FRAME_KB = 120;
+
+/// Camera loop rate; 0 means as fast as frames can be processed
+constexpr const int DEFAULT_TARGET_FPS = 5;
+
 /// Minimum change in greyscale value (0-255) for pixel to be considered changed
 constexpr const int DEFAULT_PIXEL_THRESHOLD = 10;
 
-/// Minimum percent of changed pixels for motion detection
+/// A cell must also differ from its background by this many standard deviations
+/// of its own noise (0 = use DEFAULT_PIXEL_THRESHOLD alone)
+constexpr const int DEFAULT_NOISE_SIGMAS = 3;
+
+/// Each frame is blended into the background with weight 1/2^DEFAULT_BACKGROUND_SHIFT
+constexpr const int DEFAULT_BACKGROUND_SHIFT = 3;
+
+/// Minimum percent of changed cells for motion detection
 constexpr const int DEFAULT_PERCENT_THRESHOLD = 2;
+
+/// Motion grid cell size in 8x8 pixel blocks (50x150 cells for UXGA)
+constexpr const int DEFAULT_MOTION_CELL_X = 4;
+constexpr const int DEFAULT_MOTION_CELL_Y = 1;
+
+/// Room for the heartbeat response, which may carry a motion grid mask
+constexpr const size_t HEARTBEAT_RESPONSE_SIZE = 16384;
+
+/// Room for the heartbeat request path, which carries the stats as a query
+/// string of up to about 950 bytes
+constexpr const size_t HEARTBEAT_PATH_SIZE = 1024;
+
+/// PSRAM set aside for the most recent frames, so frames from before a trigger can be uploaded
+constexpr const size_t FRAME_RING_BYTES = 1536*1024;
+constexpr const size_t FRAME_RING_MAX_FRAMES = 32;
+
+/// Frames uploaded from before a trigger
+constexpr const int PRE_ROLL_FRAMES = 3;
+
+/// Frames uploaded after a trigger
+constexpr const int POST_ROLL_FRAMES = 2;
+
+/// Upload each motion event as one multipart object rather than one object per frame
+constexpr const bool DEFAULT_BURST_UPLOAD = true;
+
+/// How long to wait for the next frame of a motion event before uploading what we have
+constexpr const int BURST_WAIT_MS = 2000;
+
+/// Number of frames waiting for upload
+constexpr const int FRAME_QUEUE_LENGTH = PRE_ROLL_FRAMES + 1 + POST_ROLL_FRAMES + 2;
@@ -1,6 +1,8 @@
 #include "defs.h"
 #include "eventhandler.h"
 
+#include <string.h>
+
 #include "esp_log.h"
 #include "esp_tls.h"
 
@@ -23,9 +25,17 @@ esp_err_t http_event_handler(esp_http_client_event_t* evt)
     case HTTP_EVENT_ON_DATA:
         if (evt->user_data)
         {
-            auto p = reinterpret_cast<char*>(evt->user_data);
-            memcpy(p, evt->data, evt->data_len);
-            p[evt->data_len] = 0;
+            // The body may arrive in several pieces
+            auto response = reinterpret_cast<http_response_buffer*>(evt->user_data);
+            size_t n = evt->data_len;
+            if (n > response->size - 1 - response->len)
+            {
+                ESP_LOGE(TAG, "HTTP response truncated to %zu bytes", response->size - 1);
+                n = response->size - 1 - response->len;
+            }
+            memcpy(response->data + response->len, evt->data, n);
+            response->len += n;
+            response->data[response->len] = 0;
         }
         break;
     case HTTP_EVENT_ON_FINISH:
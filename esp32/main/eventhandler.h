@@ -4,3 +4,11 @@
 #include "esp_http_client.h"
 
 esp_err_t http_event_handler(esp_http_client_event_t* evt);
+
+/// Collects the response body when passed as user_data to http_event_handler
+struct http_response_buffer
+{
+    char* data;
+    size_t size;    ///< Capacity, including the terminating zero
+    size_t len;
+};
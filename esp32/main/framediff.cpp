@@ -0,0 +1,93 @@
+#include "framediff.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_ESP32S3
+extern "C" int framediff_count_pie(const uint8_t* a, const uint8_t* b, size_t blocks, int threshold);
+#endif
+
+int count_changed_pixels_scalar(const uint8_t* a, const uint8_t* b, size_t len, int threshold)
+{
+    int changes = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        const auto diff = abs(static_cast<int>(a[i]) - static_cast<int>(b[i]));
+        if (diff > threshold)
+            ++changes;
+    }
+    return changes;
+}
+
+static constexpr uint32_t HIGH_BITS = 0x80808080;
+static constexpr uint32_t LOW_BITS = 0x01010101;
+
+/// Per byte x - y (mod 256), with a mask of 0x80 in the bytes where x < y
+static inline uint32_t sub_bytes(uint32_t x, uint32_t y, uint32_t& borrow)
+{
+    const uint32_t diff = ((x | HIGH_BITS) - (y & ~HIGH_BITS)) ^ ((x ^ ~y) & HIGH_BITS);
+    borrow = ((~x & y) | (~(x ^ y) & diff)) & HIGH_BITS;
+    return diff;
+}
+
+/// Add the four byte counters
+static inline int sum_bytes(uint32_t x)
+{
+    return (x & 0xFF) + ((x >> 8) & 0xFF) + ((x >> 16) & 0xFF) + (x >> 24);
+}
+
+int count_changed_pixels_swar(const uint8_t* a, const uint8_t* b, size_t len, int threshold)
+{
+    if (threshold < 0)
+        return len;
+    if (threshold > 254)
+        return 0;
+    // diff > threshold <=> diff - (threshold + 1) does not borrow
+    const uint32_t limit = (threshold + 1) * LOW_BITS;
+    const size_t words = len/4;
+    int changes = 0;
+    size_t i = 0;
+    while (i < words)
+    {
+        // Per byte counters, flushed before they can overflow
+        uint32_t counts = 0;
+        const size_t end = words - i > 255 ? i + 255 : words;
+        for (; i < end; ++i)
+        {
+            uint32_t x, y;
+            memcpy(&x, a + 4*i, 4);
+            memcpy(&y, b + 4*i, 4);
+            uint32_t borrow;
+            const uint32_t diff = sub_bytes(x, y, borrow);
+            // Negate the bytes where x < y; ~diff + 1 cannot carry as diff != 0 there
+            const uint32_t mask = (borrow >> 7) * 0xFF;
+            const uint32_t abs_diff = (diff ^ mask) + (mask & LOW_BITS);
+            sub_bytes(abs_diff, limit, borrow);
+            counts += (~borrow & HIGH_BITS) >> 7;
+        }
+        changes += sum_bytes(counts);
+    }
+    return changes + count_changed_pixels_scalar(a + 4*words, b + 4*words, len - 4*words, threshold);
+}
+
+int count_changed_pixels(const uint8_t* a, const uint8_t* b, size_t len, int threshold)
+{
+#if CONFIG_IDF_TARGET_ESP32S3
+    // The vector kernel saturates differences at 127. It needs both buffers
+    // aligned, which they are together after the same number of bytes.
+    const size_t misalignment = reinterpret_cast<uintptr_t>(a) % FRAMEDIFF_ALIGNMENT;
+    const size_t head = (FRAMEDIFF_ALIGNMENT - misalignment) % FRAMEDIFF_ALIGNMENT;
+    if (misalignment == reinterpret_cast<uintptr_t>(b) % FRAMEDIFF_ALIGNMENT &&
+        len >= head + 16 && threshold >= 0 && threshold < 127)
+    {
+        const size_t blocks = (len - head)/16;
+        const size_t tail = head + 16*blocks;
+        return count_changed_pixels_swar(a, b, head, threshold) +
+            framediff_count_pie(a + head, b + head, blocks, threshold) +
+            count_changed_pixels_swar(a + tail, b + tail, len - tail, threshold);
+    }
+#endif
+    return count_changed_pixels_swar(a, b, len, threshold);
+}
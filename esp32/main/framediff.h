@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Buffers passed to count_changed_pixels() should be at the same offset
+/// from a multiple of this for the vector kernel to be used
+constexpr const size_t FRAMEDIFF_ALIGNMENT = 16;
+
+/// Return the number of i < len for which |a[i] - b[i]| > threshold.
+/// Uses the ESP32-S3 PIE vector instructions when built for that target,
+/// otherwise 32-bit SWAR.
+int count_changed_pixels(const uint8_t* a, const uint8_t* b, size_t len, int threshold);
+
+/// Reference implementation
+int count_changed_pixels_scalar(const uint8_t* a, const uint8_t* b, size_t len, int threshold);
+
+/// 4 pixels per 32-bit word
+int count_changed_pixels_swar(const uint8_t* a, const uint8_t* b, size_t len, int threshold);
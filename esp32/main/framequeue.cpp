@@ -0,0 +1,91 @@
+#include "defs.h"
+#include "framequeue.h"
+
+#include <atomic>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "esp_log.h"
+
+static QueueHandle_t queue = nullptr;
+static Frame_ring* frame_ring = nullptr;
+static std::atomic<Overflow_policy> overflow_policy(Overflow_policy::drop_oldest);
+static std::atomic<int> max_depth(0);
+static std::atomic<uint32_t> queued(0);
+static std::atomic<uint32_t> dropped(0);
+
+void frame_queue_init(size_t length, Overflow_policy policy, Frame_ring* ring)
+{
+    frame_ring = ring;
+    queue = xQueueCreate(length, sizeof(queued_frame));
+    ESP_ERROR_CHECK(queue ? ESP_OK : ESP_ERR_NO_MEM);
+    overflow_policy = policy;
+}
+
+void frame_queue_set_policy(Overflow_policy policy)
+{
+    overflow_policy = policy;
+}
+
+bool frame_queue_push(uint32_t seq, bool burst_end)
+{
+    const queued_frame frame = { seq, burst_end };
+    bool ok = false;
+    switch (overflow_policy)
+    {
+    case Overflow_policy::block:
+        ok = xQueueSend(queue, &frame, portMAX_DELAY) == pdTRUE;
+        break;
+
+    case Overflow_policy::drop_newest:
+        ok = xQueueSend(queue, &frame, 0) == pdTRUE;
+        break;
+
+    case Overflow_policy::drop_oldest:
+        while (!(ok = xQueueSend(queue, &frame, 0) == pdTRUE))
+        {
+            queued_frame oldest;
+            if (xQueueReceive(queue, &oldest, 0) == pdTRUE)
+            {
+                frame_queue_release(oldest.seq);
+                ++dropped;
+                ESP_LOGW(TAG, "Frame queue full: dropped oldest");
+            }
+        }
+        break;
+    }
+    if (!ok)
+    {
+        frame_queue_release(seq);
+        ++dropped;
+        ESP_LOGW(TAG, "Frame queue full: dropped newest");
+        return false;
+    }
+    ++queued;
+    const int depth = uxQueueMessagesWaiting(queue);
+    int prev_max = max_depth;
+    while (depth > prev_max && !max_depth.compare_exchange_weak(prev_max, depth))
+        ;
+    return true;
+}
+
+bool frame_queue_pop(queued_frame& frame, TickType_t timeout)
+{
+    return xQueueReceive(queue, &frame, timeout) == pdTRUE;
+}
+
+void frame_queue_release(uint32_t seq)
+{
+    frame_ring->release(seq);
+}
+
+frame_queue_stats frame_queue_get_stats()
+{
+    frame_queue_stats stats;
+    stats.depth = queue ? uxQueueMessagesWaiting(queue) : 0;
+    stats.max_depth = max_depth;
+    stats.queued = queued;
+    stats.dropped = dropped;
+    return stats;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "framering.h"
+
+/// What to do when a frame is pushed onto a full queue
+enum class Overflow_policy
+{
+    drop_oldest,
+    drop_newest,
+    block,
+};
+
+/// A frame held in the ring, waiting for upload
+struct queued_frame
+{
+    uint32_t seq;       ///< Sequence number in the ring
+    bool burst_end;     ///< Last frame of a motion event
+};
+
+struct frame_queue_stats
+{
+    int depth;          ///< Frames currently waiting
+    int max_depth;      ///< Highest depth seen
+    uint32_t queued;    ///< Frames accepted
+    uint32_t dropped;   ///< Frames lost to overflow
+};
+
+/// Queued frames are held in the ring and referred to by sequence number
+void frame_queue_init(size_t length, Overflow_policy policy, Frame_ring* ring);
+
+void frame_queue_set_policy(Overflow_policy policy);
+
+/// Queue a frame claimed from the ring. Return false if the frame was dropped,
+/// in which case it has been released.
+bool frame_queue_push(uint32_t seq, bool burst_end = false);
+
+/// Return false on timeout
+bool frame_queue_pop(queued_frame& frame, TickType_t timeout);
+
+/// Release a frame obtained from frame_queue_pop() back to the ring
+void frame_queue_release(uint32_t seq);
+
+frame_queue_stats frame_queue_get_stats();
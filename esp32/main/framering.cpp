@@ -0,0 +1,145 @@
+#include "defs.h"
+#include "framering.h"
+
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+Frame_ring::Frame_ring(size_t _capacity, size_t _max_frames)
+    : capacity(_capacity),
+      max_frames(_max_frames)
+{
+    buf = static_cast<uint8_t*>(heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM));
+    slots = new ring_frame[max_frames];
+    if (!buf)
+    {
+        ESP_LOGE(TAG, "Cannot allocate frame ring of %zu bytes", capacity);
+        capacity = 0;
+    }
+}
+
+Frame_ring::~Frame_ring()
+{
+    heap_caps_free(buf);
+    delete[] slots;
+}
+
+ring_frame& Frame_ring::slot(uint32_t seq)
+{
+    return slots[seq % max_frames];
+}
+
+bool Frame_ring::evict_oldest()
+{
+    if (oldest_seq == next_seq)
+        return false;
+    auto& oldest = slot(oldest_seq);
+    if (oldest.state == CLAIMED)
+        return false;
+    if (oldest.state == STORED)
+        ++overwritten;
+    used -= oldest.len;
+    ++oldest_seq;
+    return true;
+}
+
+bool Frame_ring::push(const camera_fb_t* fb, int64_t time_ms, uint32_t& seq)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!fb->len || fb->len > capacity)
+    {
+        ++rejected;
+        return false;
+    }
+    while (next_seq - oldest_seq >= max_frames || capacity - used < fb->len)
+        if (!evict_oldest())
+        {
+            ++rejected;
+            return false;
+        }
+    // Data is kept contiguous (modulo wrap) from the oldest frame
+    const size_t offset = oldest_seq == next_seq ? 0 : (slot(oldest_seq).offset + used) % capacity;
+    const size_t first = fb->len < capacity - offset ? fb->len : capacity - offset;
+    memcpy(buf + offset, fb->buf, first);
+    memcpy(buf, fb->buf + first, fb->len - first);
+
+    seq = next_seq++;
+    auto& frame = slot(seq);
+    frame.seq = seq;
+    frame.offset = offset;
+    frame.len = fb->len;
+    frame.format = fb->format;
+    frame.timestamp = fb->timestamp;
+    frame.time_ms = time_ms;
+    const time_t secs = time_ms/1000;
+    gmtime_r(&secs, &frame.timeinfo);
+    frame.camera_seq = fb->seq;
+    frame.capture_us = fb->capture_us;
+    frame.half_buffers = fb->half_buffers;
+    frame.aec = fb->aec;
+    frame.agc = fb->agc;
+    frame.state = STORED;
+    used += fb->len;
+    ++stored;
+    return true;
+}
+
+size_t Frame_ring::claim_latest(size_t n, uint32_t* seqs)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = 0;
+    uint32_t seq = next_seq;
+    while (count < n && seq != oldest_seq && slot(seq - 1).state == STORED)
+    {
+        --seq;
+        slot(seq).state = CLAIMED;
+        ++count;
+    }
+    for (size_t i = 0; i < count; ++i)
+        seqs[i] = seq + i;
+    return count;
+}
+
+bool Frame_ring::get(uint32_t seq, ring_frame& frame, upload_segment segments[2], size_t& count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (seq - oldest_seq >= next_seq - oldest_seq)
+        return false;
+    frame = slot(seq);
+    const size_t first = frame.len < capacity - frame.offset ? frame.len : capacity - frame.offset;
+    segments[0] = { buf + frame.offset, first };
+    segments[1] = { buf, frame.len - first };
+    count = first < frame.len ? 2 : 1;
+    return true;
+}
+
+void Frame_ring::release(uint32_t seq)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (seq - oldest_seq < next_seq - oldest_seq)
+        slot(seq).state = RELEASED;
+}
+
+frame_ring_stats Frame_ring::get_stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    frame_ring_stats stats = {};
+    stats.capacity = capacity;
+    stats.used = used;
+    stats.frames = next_seq - oldest_seq;
+    stats.stored = stored;
+    stats.overwritten = overwritten;
+    stats.rejected = rejected;
+    if (stats.frames)
+        stats.avg_frame_bytes = used/stats.frames;
+    if (stats.frames >= 2)
+    {
+        const auto& first = slot(oldest_seq).timestamp;
+        const auto& last = slot(next_seq - 1).timestamp;
+        const float span = (last.tv_sec - first.tv_sec) + (last.tv_usec - first.tv_usec)/1e6f;
+        stats.frame_interval_secs = span/(stats.frames - 1);
+        stats.history_secs = stats.frame_interval_secs * capacity/stats.avg_frame_bytes;
+    }
+    return stats;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <mutex>
+
+#include "esp_camera.h"
+
+#include "uploadclient.h"
+
+/// A compressed frame stored in the ring
+struct ring_frame
+{
+    uint32_t seq;               ///< Sequence number, used as handle
+    size_t offset;              ///< Start of data in the ring
+    size_t len;
+    pixformat_t format;
+    struct timeval timestamp;   ///< Capture time since boot, from camera_fb_t
+    int64_t time_ms;            ///< Wall clock time of capture, ms since the epoch
+    struct tm timeinfo;         ///< Wall clock time of capture
+    uint32_t camera_seq;        ///< Metadata from camera_fb_t
+    uint32_t capture_us;
+    uint16_t half_buffers;
+    uint16_t aec;
+    uint16_t agc;
+    uint8_t state;
+};
+
+struct frame_ring_stats
+{
+    size_t capacity;            ///< Bytes
+    size_t used;                ///< Bytes
+    int frames;                 ///< Frames currently held
+    uint32_t stored;            ///< Frames stored since start
+    uint32_t overwritten;       ///< Frames recycled without being claimed
+    uint32_t rejected;          ///< Frames not stored because claimed frames filled the ring
+    size_t avg_frame_bytes;
+    float frame_interval_secs;  ///< Average time between stored frames
+    float history_secs;         ///< History that fits at the current frame size and rate
+};
+
+/// Fixed-size byte ring of recent compressed frames. Memory is
+/// allocated once; frames are copied in back to back and may wrap
+/// around the end, in which case they are read out as two segments.
+/// Frames claimed for upload are never overwritten until released.
+class Frame_ring
+{
+public:
+    Frame_ring(size_t capacity, size_t max_frames);
+
+    ~Frame_ring();
+
+    /// Copy the frame into the ring, recycling the oldest unclaimed frames.
+    /// time_ms is the wall clock time of capture.
+    /// Return false if there is no room.
+    bool push(const camera_fb_t* fb, int64_t time_ms, uint32_t& seq);
+
+    /// Claim up to n of the most recent unclaimed frames, stopping at the
+    /// first frame that has already been claimed.
+    /// Sequence numbers are stored oldest first; return the number claimed.
+    size_t claim_latest(size_t n, uint32_t* seqs);
+
+    /// Get a claimed frame as one or two segments. Return false if seq is not held.
+    bool get(uint32_t seq, ring_frame& frame, upload_segment segments[2], size_t& count);
+
+    /// Allow a claimed frame to be recycled
+    void release(uint32_t seq);
+
+    frame_ring_stats get_stats();
+
+private:
+    enum : uint8_t
+    {
+        STORED,
+        CLAIMED,
+        RELEASED,
+    };
+
+    ring_frame& slot(uint32_t seq);
+
+    bool evict_oldest();
+
+    uint8_t* buf = nullptr;
+    size_t capacity;
+    size_t max_frames;
+    ring_frame* slots = nullptr;
+    uint32_t oldest_seq = 0;
+    uint32_t next_seq = 0;
+    size_t used = 0;
+    uint32_t stored = 0;
+    uint32_t overwritten = 0;
+    uint32_t rejected = 0;
+    std::mutex mutex;
+};
@@ -1,16 +1,105 @@
 #include "defs.h"
 #include "eventhandler.h"
+#include "framequeue.h"
 #include "heartbeat.h"
+#include "motion.h"
+#include "stagetiming.h"
+#include "upload.h"
 
 #include <string>
+#include <vector>
 
 #include "cJSON.h"
 
+#include "esp_camera.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "esp_http_client.h"
+#include "esp_timer.h"
+
+#include "mbedtls/base64.h"
+
+#include "nvs.h"
+
+static bool decode_base64(const cJSON* node, std::vector<uint8_t>& data)
+{
+    data.clear();
+    if (!node)
+        return true;
+    if (!cJSON_IsString(node))
+        return false;
+    const auto src = reinterpret_cast<const unsigned char*>(node->valuestring);
+    const size_t len = strlen(node->valuestring);
+    data.resize(len*3/4 + 3);
+    size_t written = 0;
+    if (mbedtls_base64_decode(data.data(), data.size(), &written, src, len))
+        return false;
+    data.resize(written);
+    return true;
+}
+
+static esp_err_t set_blob(nvs_handle my_handle, const char* key, const std::vector<uint8_t>& data)
+{
+    if (!data.empty())
+        return nvs_set_blob(my_handle, key, data.data(), data.size());
+    const auto err = nvs_erase_key(my_handle, key);
+    return err == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : err;
+}
+
+/// Apply and persist a motion grid of the form
+///   { "x": <cell width>, "y": <cell height>, "mask": <base64>, "weights": <base64> }
+/// where cell sizes are in 8x8 blocks and mask and weights are optional
+static void set_motion_grid(const cJSON* node)
+{
+    // The grid is sent with every heartbeat, so only act on changes
+    static std::string current;
+    char* text = cJSON_PrintUnformatted(node);
+    if (!text)
+        return;
+    const bool changed = current != text;
+    current = text;
+    cJSON_free(text);
+    if (!changed)
+        return;
+
+    auto x_node = cJSON_GetObjectItem(node, "x");
+    auto y_node = cJSON_GetObjectItem(node, "y");
+    std::vector<uint8_t> mask, weights;
+    if (!x_node || !y_node ||
+        !decode_base64(cJSON_GetObjectItem(node, "mask"), mask) ||
+        !decode_base64(cJSON_GetObjectItem(node, "weights"), weights) ||
+        !motion_set_grid(x_node->valueint, y_node->valueint,
+                         mask.empty() ? nullptr : mask.data(), mask.size(),
+                         weights.empty() ? nullptr : weights.data(), weights.size()))
+    {
+        ESP_LOGE(TAG, "Invalid motion grid");
+        return;
+    }
+    printf("New motion grid %dx%d cells\n", x_node->valueint, y_node->valueint);
+
+    nvs_handle my_handle;
+    if (nvs_open("storage", NVS_READWRITE, &my_handle) != ESP_OK)
+        return;
+    const uint8_t cell_size[2] = { static_cast<uint8_t>(x_node->valueint),
+                                   static_cast<uint8_t>(y_node->valueint) };
+    esp_err_t err = nvs_set_blob(my_handle, MOTION_GRID_KEY, cell_size, sizeof(cell_size));
+    if (err == ESP_OK)
+        err = set_blob(my_handle, MOTION_MASK_KEY, mask);
+    if (err == ESP_OK)
+        err = set_blob(my_handle, MOTION_WEIGHTS_KEY, weights);
+    if (err == ESP_OK)
+        err = nvs_commit(my_handle);
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "Cannot save motion grid: %s", esp_err_to_name(err));
+    nvs_close(my_handle);
+}
 
 void heartbeat(const struct tm& current,
-               time_t last_pic)
+               time_t last_pic,
+               const frame_ring_stats& ring_stats,
+               const histogram_stats& frame_sizes,
+               int jpeg_quality,
+               const resolution_switch_stats& switch_stats)
 {
     char ts[35] = { 0 };
     if (last_pic)
@@ -19,20 +108,105 @@ void heartbeat(const struct tm& current,
         gmtime_r(&last_pic, &timeinfo);
         strftime(ts, sizeof(ts), "&last_pic=%Y-%m-%d%%20%H:%M:%S", &timeinfo);
     }
-    char resource[85];
-    sprintf(resource, "/camera/%d?active=%d&continuous=%d&version=%s%s",
-            (int) config_instance_number,
-            (int) config_active,
-            (int) config_continuous,
-            VERSION,
-            ts);
-    char buffer[256];
+    const auto queue_stats = frame_queue_get_stats();
+    const auto upload_stats = upload_get_client_stats();
+    const auto grid = motion_get_grid();
+    camera_drop_stats_t drops = {};
+    esp_camera_get_drop_stats(&drops);
+
+    // Capture rate since the previous heartbeat, in tenths of a frame per second
+    static uint32_t last_frames = 0;
+    static int64_t last_us = 0;
+    const int64_t now_us = esp_timer_get_time();
+    const unsigned rate_x10 = last_us && now_us > last_us ?
+        (frame_sizes.count - last_frames) * 10000000LL/(now_us - last_us) : 0;
+    last_frames = frame_sizes.count;
+    last_us = now_us;
+    char size_histogram[128];
+    histogram_format(frame_sizes, size_histogram, sizeof(size_histogram));
+
+    char resource[HEARTBEAT_PATH_SIZE];
+    const int resource_len = snprintf(resource, sizeof(resource),
+             "/camera/%d?active=%d&continuous=%d&version=%s&queued=%u&dropped=%u&maxdepth=%d"
+             "&conns=%u&reused=%u&hs_ms=%u&history=%d&burst=%d&grid=%dx%d&cells=%d"
+             "&fps=%d&cap_ms=%u&dec_ms=%u&diff_us=%u&up_ms=%u&frame_ms=%u"
+             "&no_soi=%u&no_eoi=%u&fb_ovf=%u&fbq_snd=%u&fbq_rcv=%u&ev_ovf=%u"
+             "&xclk_mhz=%d&frames=%u&rate=%u.%u&jpeg_avg=%u&jpeg_p90=%u&jpeg_hist=%s"
+             "&cap_p90=%u&dec_p90=%u&diff_p90=%u&up_p90=%u&frame_p90=%u"
+             "&quality=%d&frame_kb=%d"
+             "&dual=%d&raw=%d&switches=%u&sw_ms=%u&sw_p90=%u&settle=%d&settle_max=%d&sw_timeouts=%u%s",
+             (int) config_instance_number,
+             (int) config_active,
+             (int) config_continuous,
+             VERSION,
+             (unsigned) queue_stats.queued,
+             (unsigned) queue_stats.dropped,
+             queue_stats.max_depth,
+             (unsigned) upload_stats.connections,
+             (unsigned) upload_stats.reused,
+             (unsigned) (upload_stats.connections ? upload_stats.total_handshake_ms/upload_stats.connections : 0),
+             (int) ring_stats.history_secs,
+             (int) config_burst_upload,
+             grid.width, grid.height, grid.active_cells,
+             config_target_fps,
+             (unsigned) stage_get_average_us(Stage::capture)/1000,
+             (unsigned) stage_get_average_us(Stage::decode)/1000,
+             (unsigned) stage_get_average_us(Stage::diff),
+             (unsigned) stage_get_average_us(Stage::upload)/1000,
+             (unsigned) stage_get_average_us(Stage::frame)/1000,
+             (unsigned) drops.no_soi,
+             (unsigned) drops.no_eoi,
+             (unsigned) drops.fb_overflow,
+             (unsigned) drops.fbq_send,
+             (unsigned) drops.fbq_receive,
+             (unsigned) drops.event_overflow,
+             CAMERA_XCLK_HZ/1000000,
+             (unsigned) drops.frames,
+             rate_x10/10, rate_x10%10,
+             (unsigned) histogram_average(frame_sizes),
+             (unsigned) histogram_percentile(frame_sizes, 90),
+             size_histogram,
+             (unsigned) stage_get_percentile_us(Stage::capture, 90)/1000,
+             (unsigned) stage_get_percentile_us(Stage::decode, 90)/1000,
+             (unsigned) stage_get_percentile_us(Stage::diff, 90),
+             (unsigned) stage_get_percentile_us(Stage::upload, 90)/1000,
+             (unsigned) stage_get_percentile_us(Stage::frame, 90)/1000,
+             jpeg_quality,
+             config_target_frame_kb,
+             (int) config_dual_resolution,
+             (int) config_raw_motion,
+             (unsigned) switch_stats.switches,
+             (unsigned) switch_stats.last_us/1000,
+             (unsigned) stage_get_percentile_us(Stage::framesize, 90)/1000,
+             switch_stats.last_settle_frames,
+             switch_stats.max_settle_frames,
+             (unsigned) switch_stats.timeouts,
+             ts);
+    if (resource_len < 0 || static_cast<size_t>(resource_len) >= sizeof(resource))
+    {
+        ESP_LOGE(TAG, "Heartbeat request too long: %d", resource_len);
+        return;
+    }
+    http_response_buffer response = {
+        static_cast<char*>(heap_caps_malloc(HEARTBEAT_RESPONSE_SIZE, MALLOC_CAP_SPIRAM)),
+        HEARTBEAT_RESPONSE_SIZE,
+        0
+    };
+    if (!response.data)
+    {
+        ESP_LOGE(TAG, "No memory for heartbeat response");
+        return;
+    }
+    response.data[0] = 0;
     esp_http_client_config_t config {
         .host = "acsgateway.hal9k.dk",
         .path = resource,
         .event_handler = http_event_handler,
         .transport_type = HTTP_TRANSPORT_OVER_SSL,
-        .user_data = buffer,
+        // The request line, with the whole path, must fit the transmit
+        // buffer, which is only 512 bytes by default
+        .buffer_size_tx = static_cast<int>(HEARTBEAT_PATH_SIZE) + 32,
+        .user_data = &response,
         .crt_bundle_attach = esp_crt_bundle_attach,
     };
     esp_http_client_handle_t client = esp_http_client_init(&config);
@@ -49,7 +223,7 @@ void heartbeat(const struct tm& current,
     if (err == ESP_OK)
     {
         ESP_LOGI(TAG, "Heartbeat status = %d", esp_http_client_get_status_code(client));
-        auto root = cJSON_Parse(buffer);
+        auto root = cJSON_Parse(response.data);
         if (root)
         {
             auto keepalive_node = cJSON_GetObjectItem(root, "keepalive");
@@ -82,6 +256,79 @@ void heartbeat(const struct tm& current,
                     config_pixel_threshold = pixel;
                 }
             }
+            auto grid_node = cJSON_GetObjectItem(root, "grid");
+            if (grid_node && cJSON_IsObject(grid_node))
+                set_motion_grid(grid_node);
+            auto burst_node = cJSON_GetObjectItem(root, "burst");
+            if (burst_node && cJSON_IsBool(burst_node))
+            {
+                const bool burst = cJSON_IsTrue(burst_node);
+                if (burst != config_burst_upload)
+                {
+                    printf("%s burst upload\n", burst ? "Enabling" : "Disabling");
+                    config_burst_upload = burst;
+                }
+            }
+            auto fps_node = cJSON_GetObjectItem(root, "fps");
+            if (fps_node)
+            {
+                auto fps = fps_node->valueint;
+                if (fps != config_target_fps && fps >= 0 && fps <= 30)
+                {
+                    printf("New target frame rate %d\n", fps);
+                    config_target_fps = fps;
+                }
+            }
+            auto frame_kb_node = cJSON_GetObjectItem(root, "frame_kb");
+            if (frame_kb_node)
+            {
+                auto frame_kb = frame_kb_node->valueint;
+                if (frame_kb != config_target_frame_kb && frame_kb >= 0 && frame_kb <= 1024)
+                {
+                    printf("New target frame size %d KB\n", frame_kb);
+                    config_target_frame_kb = frame_kb;
+                }
+            }
+            auto dual_node = cJSON_GetObjectItem(root, "dual");
+            if (dual_node && cJSON_IsBool(dual_node))
+            {
+                const bool dual = cJSON_IsTrue(dual_node);
+                if (dual != config_dual_resolution)
+                {
+                    printf("Dual resolution %s\n", dual ? "on" : "off");
+                    config_dual_resolution = dual;
+                }
+            }
+            auto raw_node = cJSON_GetObjectItem(root, "raw");
+            if (raw_node && cJSON_IsBool(raw_node))
+            {
+                const bool raw = cJSON_IsTrue(raw_node);
+                if (raw != config_raw_motion)
+                {
+                    printf("Raw motion frames %s\n", raw ? "on" : "off");
+                    config_raw_motion = raw;
+                }
+            }
+            auto sigmas_node = cJSON_GetObjectItem(root, "sigmas");
+            if (sigmas_node)
+            {
+                auto sigmas = sigmas_node->valueint;
+                if (sigmas != config_noise_sigmas && sigmas >= 0)
+                {
+                    printf("New noise threshold %d sigmas\n", sigmas);
+                    config_noise_sigmas = sigmas;
+                }
+            }
+            auto alpha_node = cJSON_GetObjectItem(root, "alpha");
+            if (alpha_node)
+            {
+                auto shift = alpha_node->valueint;
+                if (shift != config_background_shift && shift >= 0 && shift <= 8)
+                {
+                    printf("New background update rate 1/%d\n", 1 << shift);
+                    config_background_shift = shift;
+                }
+            }
             auto action_node = cJSON_GetObjectItem(root, "action");
             if (action_node && action_node->type == cJSON_String)
             {
@@ -114,4 +361,5 @@ void heartbeat(const struct tm& current,
         ESP_LOGE(TAG, "Error performing http request %s", esp_err_to_name(err));
     
     esp_http_client_cleanup(client);
+    heap_caps_free(response.data);
 }
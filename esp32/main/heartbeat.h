@@ -3,5 +3,15 @@
 #include <string>
 #include <time.h>
 
+#include "framering.h"
+#include "histogram.h"
+#include "resolution.h"
+
+/// frame_sizes are the sizes of all captured frames since boot,
+/// jpeg_quality the current sensor quality setting
 void heartbeat(const struct tm& current,
-               time_t last_pic);
+               time_t last_pic,
+               const frame_ring_stats& ring_stats,
+               const histogram_stats& frame_sizes,
+               int jpeg_quality,
+               const resolution_switch_stats& switch_stats);
@@ -0,0 +1,91 @@
+#include "histogram.h"
+
+#include <stdio.h>
+
+static int bucket_of(uint32_t value)
+{
+    return value ? 32 - __builtin_clz(value) : 0;
+}
+
+void Histogram::add(uint32_t value)
+{
+    ++buckets[bucket_of(value)];
+    ++count;
+    ++adds_started;
+    const uint32_t prev_low = total_low.fetch_add(value);
+    if (prev_low + value < prev_low)
+        ++total_high;
+    ++adds_finished;
+    uint32_t prev_max = max;
+    while (value > prev_max && !max.compare_exchange_weak(prev_max, value))
+        ;
+}
+
+histogram_stats Histogram::get_stats() const
+{
+    // Each counter is read atomically, so a concurrent add() may show up
+    // in some fields and not yet in others
+    histogram_stats stats;
+    stats.count = count;
+    stats.max = max;
+    // No add() was under way if as many had started by the end as had
+    // finished by the start
+    uint32_t finished;
+    do
+    {
+        finished = adds_finished;
+        stats.total = static_cast<uint64_t>(total_high) << 32 | total_low;
+    } while (adds_started != finished);
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+        stats.buckets[i] = buckets[i];
+    return stats;
+}
+
+uint32_t histogram_average(const histogram_stats& stats)
+{
+    return stats.count ? stats.total/stats.count : 0;
+}
+
+uint32_t histogram_percentile(const histogram_stats& stats, int percent)
+{
+    uint32_t bucket_total = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+        bucket_total += stats.buckets[i];
+    if (!bucket_total)
+        return 0;
+    const uint64_t target = (static_cast<uint64_t>(bucket_total)*percent + 99)/100;
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        seen += stats.buckets[i];
+        if (seen >= target && stats.buckets[i])
+        {
+            const uint32_t bound = i ? static_cast<uint32_t>((1ULL << i) - 1) : 0;
+            return bound < stats.max ? bound : stats.max;
+        }
+    }
+    return stats.max;
+}
+
+int histogram_format(const histogram_stats& stats, char* buf, size_t size)
+{
+    if (!size)
+        return 0;
+    size_t len = 0;
+    buf[0] = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        if (!stats.buckets[i])
+            continue;
+        const int n = snprintf(buf + len, size - len, "%s%d:%u",
+                               len ? "," : "", i, (unsigned) stats.buckets[i]);
+        if (n < 0 || static_cast<size_t>(n) >= size - len)
+        {
+            // Drop the partial entry
+            buf[len] = 0;
+            break;
+        }
+        len += n;
+    }
+    return len;
+}
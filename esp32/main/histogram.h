@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+/// Bucket 0 counts zeros, bucket i values in [2^(i-1), 2^i)
+constexpr const int HISTOGRAM_BUCKETS = 33;
+
+struct histogram_stats
+{
+    uint32_t count;
+    uint32_t max;
+    uint64_t total;
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+};
+
+/// Power-of-two histogram that can be updated from any task without locking.
+/// Only 32-bit atomics are used, as 64-bit ones take a lock on the ESP32.
+class Histogram
+{
+public:
+    void add(uint32_t value);
+
+    histogram_stats get_stats() const;
+
+private:
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> max{0};
+    /// The 64-bit total in two words, with the carry added separately.
+    /// Readers retry while any add() is between started and finished.
+    std::atomic<uint32_t> total_low{0};
+    std::atomic<uint32_t> total_high{0};
+    std::atomic<uint32_t> adds_started{0};
+    std::atomic<uint32_t> adds_finished{0};
+    std::atomic<uint32_t> buckets[HISTOGRAM_BUCKETS] = {};
+};
+
+/// Average value, 0 if empty
+uint32_t histogram_average(const histogram_stats& stats);
+
+/// Upper bound of the bucket holding the given percentile, 0 if empty
+uint32_t histogram_percentile(const histogram_stats& stats, int percent);
+
+/// Write the nonzero buckets as "bucket:count,..." and return the length
+int histogram_format(const histogram_stats& stats, char* buf, size_t size);
@@ -1,6 +1,10 @@
 #include "connect.h"
 #include "console.h"
 #include "defs.h"
+#include "framequeue.h"
+#include "framering.h"
+#include "motion.h"
+#include "upload.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -86,6 +90,33 @@ void get_nvs_i8(nvs_handle my_handle, const char* key, int8_t& value)
     esp_restart();
 }
 
+void get_nvs_blob(nvs_handle my_handle, const char* key, std::vector<uint8_t>& data)
+{
+    size_t size = 0;
+    data.clear();
+    if (nvs_get_blob(my_handle, key, nullptr, &size) != ESP_OK || !size)
+        return;
+    data.resize(size);
+    if (nvs_get_blob(my_handle, key, data.data(), &size) != ESP_OK)
+        data.clear();
+}
+
+// Use the default grid if none is stored
+void load_motion_grid(nvs_handle my_handle)
+{
+    uint8_t cell_size[2];
+    size_t size = sizeof(cell_size);
+    if (nvs_get_blob(my_handle, MOTION_GRID_KEY, cell_size, &size) != ESP_OK || size != sizeof(cell_size))
+        return;
+    std::vector<uint8_t> mask, weights;
+    get_nvs_blob(my_handle, MOTION_MASK_KEY, mask);
+    get_nvs_blob(my_handle, MOTION_WEIGHTS_KEY, weights);
+    if (!motion_set_grid(cell_size[0], cell_size[1],
+                         mask.empty() ? nullptr : mask.data(), mask.size(),
+                         weights.empty() ? nullptr : weights.data(), weights.size()))
+        printf("%s: invalid motion grid\n", MOTION_GRID_KEY);
+}
+
 char config_s3_access_key[40];
 char config_s3_secret_key[40];
 char config_gateway_token[80];
@@ -93,8 +124,15 @@ int8_t config_instance_number = 0;
 int config_keepalive_secs = DEFAULT_KEEPALIVE_SECS;
 int config_pixel_threshold = DEFAULT_PIXEL_THRESHOLD;
 int config_percent_threshold = DEFAULT_PERCENT_THRESHOLD;
+int config_noise_sigmas = DEFAULT_NOISE_SIGMAS;
+int config_background_shift = DEFAULT_BACKGROUND_SHIFT;
 bool config_active = true;
 bool config_continuous = false;
+bool config_burst_upload = DEFAULT_BURST_UPLOAD;
+int config_target_fps = DEFAULT_TARGET_FPS;
+int config_target_frame_kb = DEFAULT_TARGET_FRAME_KB;
+bool config_dual_resolution = DEFAULT_DUAL_RESOLUTION;
+bool config_raw_motion = DEFAULT_RAW_MOTION;
 
 void flash_led(int n)
 {
@@ -161,6 +199,7 @@ void app_main()
     get_nvs_string(my_handle, S3_SECRET_KEY, config_s3_secret_key, sizeof(config_s3_secret_key));
     get_nvs_string(my_handle, GATEWAY_TOKEN_KEY, config_gateway_token, sizeof(config_gateway_token));
     get_nvs_i8(my_handle, INSTANCE_KEY, config_instance_number);
+    load_motion_grid(my_handle);
     nvs_close(my_handle);
 
     printf("HAL32CAM v %s instance %d\n", VERSION,
@@ -201,5 +240,8 @@ void app_main()
         obtain_time();
     }
     
-    xTaskCreate(&camera_task, "camera_task", 32768, nullptr, 5, nullptr);
+    auto ring = new Frame_ring(FRAME_RING_BYTES, FRAME_RING_MAX_FRAMES);
+    frame_queue_init(FRAME_QUEUE_LENGTH, Overflow_policy::drop_oldest, ring);
+    xTaskCreate(&upload_task, "upload_task", 12288, ring, 4, nullptr);
+    xTaskCreate(&camera_task, "camera_task", 32768, ring, 5, nullptr);
 }
@@ -1,91 +1,283 @@
+#include "background.h"
 #include "defs.h"
+#include "framediff.h"
 #include "motion.h"
-#include "upload.h"
+#include "stagetiming.h"
 
-#include "JPEGDEC.h"
+#include <string.h>
+#include <vector>
+
+#include "jpg_decoder.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "esp_system.h"
 
 constexpr const int FACTOR = 8;
 constexpr const int BUFSIZE_X = FRAMESIZE_X/FACTOR;
 constexpr const int BUFSIZE_Y = FRAMESIZE_Y/FACTOR;
-constexpr const int X_FACTOR = 4;
 
-constexpr const int BUFFER_BYTESIZE = BUFSIZE_X/X_FACTOR * BUFSIZE_Y;
+/// Decodes of each kind when calibrating; the fastest one counts
+constexpr const int CALIBRATION_ITERATIONS = 3;
 
-uint8_t buf1[BUFFER_BYTESIZE];
-uint8_t buf2[BUFFER_BYTESIZE];
-bool current_buf = false;
+// The buffer holds the full 1/8 scale luma image while decoding;
+// after reduction the first grid_width*grid_height bytes hold the cells
+alignas(FRAMEDIFF_ALIGNMENT) uint8_t buf[BUFSIZE_X * BUFSIZE_Y];
 bool first_time = true;
+static Background_model background;
+
+// Current grid
+static int cell_x = 0;
+static int cell_y = 0;
+static int grid_width = 0;
+static int grid_height = 0;
+static std::vector<uint8_t> cell_active;    // per cell
+static std::vector<uint8_t> cell_weights;   // per cell, empty if all are 1
+static std::vector<cell_run> active_runs;
+static uint32_t total_weight = 0;
+static int active_cells = 0;
+static uint8_t line_needed[BUFSIZE_Y];      // per line of the 1/8 scale image
+
+bool motion_set_grid(int new_cell_x, int new_cell_y,
+                     const uint8_t* mask, size_t mask_size,
+                     const uint8_t* weights, size_t weights_size)
+{
+    if (new_cell_x < 1 || new_cell_x > BUFSIZE_X || new_cell_y < 1 || new_cell_y > BUFSIZE_Y)
+        return false;
+    const int width = BUFSIZE_X/new_cell_x;
+    const int height = BUFSIZE_Y/new_cell_y;
+    const size_t cells = width * height;
+    if ((mask && mask_size != (cells + 7)/8) || (weights && weights_size != cells))
+        return false;
+
+    cell_x = new_cell_x;
+    cell_y = new_cell_y;
+    grid_width = width;
+    grid_height = height;
+    cell_active.assign(cells, 1);
+    cell_weights.clear();
+    bool uniform = true;
+    for (size_t i = 0; i < cells; ++i)
+    {
+        if (mask && (mask[i/8] & (1 << (i % 8))))
+            cell_active[i] = 0;
+        if (weights && weights[i] != 1 && cell_active[i])
+            uniform = false;
+    }
+    if (!uniform)
+        cell_weights.assign(weights, weights + cells);
+
+    active_runs.clear();
+    total_weight = 0;
+    active_cells = 0;
+    for (size_t i = 0; i < cells; ++i)
+    {
+        if (!cell_active[i])
+            continue;
+        total_weight += uniform ? 1 : cell_weights[i];
+        ++active_cells;
+        if (!active_runs.empty() && active_runs.back().start + active_runs.back().length == i)
+            ++active_runs.back().length;
+        else
+            active_runs.push_back({ static_cast<uint16_t>(i), 1 });
+    }
+
+    memset(line_needed, 0, sizeof(line_needed));
+    for (int gy = 0; gy < grid_height; ++gy)
+    {
+        bool needed = false;
+        for (int gx = 0; gx < grid_width && !needed; ++gx)
+            needed = cell_active[gy * grid_width + gx];
+        if (needed)
+            memset(line_needed + gy * cell_y, 1, cell_y);
+    }
+
+    // The reference image no longer matches
+    first_time = true;
+    ESP_LOGI(TAG, "Motion grid %dx%d, %d active cells", grid_width, grid_height, active_cells);
+    return true;
+}
+
+motion_grid_info motion_get_grid()
+{
+    if (!grid_width)
+        motion_set_grid(DEFAULT_MOTION_CELL_X, DEFAULT_MOTION_CELL_Y, nullptr, 0, nullptr, 0);
+    motion_grid_info info;
+    info.cell_x = cell_x;
+    info.cell_y = cell_y;
+    info.width = grid_width;
+    info.height = grid_height;
+    info.active_cells = active_cells;
+    return info;
+}
+
+void motion_calibrate_decoder(const camera_fb_t* fb)
+{
+    // Room for the luma of a full size frame at 1/4 scale, the largest
+    // image motion decodes
+    const size_t work_size = BUFSIZE_X * BUFSIZE_Y * 4;
+    auto work = static_cast<uint8_t*>(heap_caps_malloc(work_size, MALLOC_CAP_8BIT));
+    if (!work)
+    {
+        ESP_LOGE(TAG, "No memory to calibrate the JPEG decoders");
+        return;
+    }
+    jpg_decoder_timings_t timings;
+    if (jpg_decoder_calibrate(fb->buf, fb->len, work, work_size, CALIBRATION_ITERATIONS, &timings) == ESP_OK)
+    {
+        const auto& luma = timings.us[JPG_OUTPUT_LUMA];
+        ESP_LOGI(TAG, "Luma decode us: 1/4 JPEGDEC %u TJpgDec %u, 1/8 JPEGDEC %u TJpgDec %u",
+                 (unsigned) luma[JPG_SCALE_4X][JPG_DECODER_JPEGDEC], (unsigned) luma[JPG_SCALE_4X][JPG_DECODER_TJPGD],
+                 (unsigned) luma[JPG_SCALE_8X][JPG_DECODER_JPEGDEC], (unsigned) luma[JPG_SCALE_8X][JPG_DECODER_TJPGD]);
+    }
+    else
+        ESP_LOGE(TAG, "Cannot calibrate the JPEG decoders on this frame");
+    heap_caps_free(work);
+}
 
-// Callback
-static uint8_t* draw_cb_buf = nullptr;
+/// Decode the luma of a JPEG frame at 1/8 of the full size into buf, and set
+/// width and height to the size of the image. Return false if it does not fit.
+static bool decode_luma(const camera_fb_t* fb, uint8_t* buf, int& width, int& height)
+{
+    uint16_t jpeg_width = 0;
+    uint16_t jpeg_height = 0;
+    if (!jpg_get_size(fb->buf, fb->len, &jpeg_width, &jpeg_height))
+    {
+        ESP_LOGE(TAG, "Not a JPEG frame");
+        return false;
+    }
+    // Frames are reduced to 1/8 scale, except that frames of half the
+    // full size (MOTION_FRAMESIZE) give the same image at 1/4 scale
+    const bool half_size = jpeg_width == FRAMESIZE_X/2 && jpeg_height == FRAMESIZE_Y/2;
+    const int factor = half_size ? FACTOR/2 : FACTOR;
+    width = jpeg_width/factor;
+    height = jpeg_height/factor;
+    if (width > BUFSIZE_X || height > BUFSIZE_Y)
+    {
+        ESP_LOGE(TAG, "Frame too large for motion buffer: %dx%d", jpeg_width, jpeg_height);
+        return false;
+    }
+    jpg_decode_output_t out = {};
+    out.type = JPG_OUTPUT_LUMA;
+    out.scale = half_size ? JPG_SCALE_4X : JPG_SCALE_8X;
+    out.buf = buf;
+    out.stride = BUFSIZE_X;
+    out.buf_size = BUFSIZE_X * BUFSIZE_Y;
+    out.row_mask = line_needed;
+    jpg_decode(fb->buf, fb->len, &out); // can fail
+    return true;
+}
 
-int draw_cb(JPEGDRAW* draw)
+/// Reduce a grayscale frame of a whole multiple of the motion image size
+/// by averaging. Return false if the frame has another size.
+static bool reduce_grayscale(const camera_fb_t* fb, uint8_t* buf)
 {
-    //printf("Draw: %d, %d\n", (int) draw->x, (int) draw->y);
-    uint8_t* p = draw_cb_buf + draw->y * BUFSIZE_X / X_FACTOR;
-    int i = 0;
-    while (i < draw->iWidth)
+    const size_t scale = fb->width/BUFSIZE_X;
+    if (!scale || fb->width != BUFSIZE_X * scale || fb->height != BUFSIZE_Y * scale ||
+        fb->len < fb->width * fb->height)
+    {
+        ESP_LOGE(TAG, "Grayscale frame does not fit motion buffer: %zux%zu", fb->width, fb->height);
+        return false;
+    }
+    const int pixels = scale * scale;
+    for (int y = 0; y < BUFSIZE_Y; ++y)
     {
-        int sum = 0;
-        for (int j = 0; j < X_FACTOR; ++j)
+        if (!line_needed[y])
+            continue;
+        const uint8_t* src = fb->buf + y * scale * fb->width;
+        uint8_t* dst = buf + y * BUFSIZE_X;
+        for (int x = 0; x < BUFSIZE_X; ++x, src += scale)
         {
-            uint16_t pixel = draw->pPixels[i + j];
-            uint16_t red = ((pixel & 0xF800)>>11);
-            uint16_t green = ((pixel & 0x07E0)>>5);
-            uint16_t blue = (pixel & 0x001F);
-            uint16_t grayscale = 8*((0.2126 * red) + (0.7152 * green / 2.0) + (0.0722 * blue));
-            sum += grayscale;
+            int sum = 0;
+            for (size_t j = 0; j < scale; ++j)
+                for (size_t i = 0; i < scale; ++i)
+                    sum += src[j * fb->width + i];
+            dst[x] = sum/pixels;
         }
-        *p++ = sum/X_FACTOR;
-        i += X_FACTOR;
     }
-    return 1;
+    return true;
 }
 
 void downsample(const camera_fb_t* fb,
                 uint8_t* buf)
 {
-    draw_cb_buf = buf;
-    JPEGDEC decoder;
-    ESP_ERROR_CHECK(!decoder.openRAM(fb->buf, fb->len, draw_cb));
-    decoder.decode(0, 0, JPEG_SCALE_EIGHTH); // can fail
+    if (!grid_width)
+        motion_set_grid(DEFAULT_MOTION_CELL_X, DEFAULT_MOTION_CELL_Y, nullptr, 0, nullptr, 0);
+
+    int width = BUFSIZE_X;
+    int height = BUFSIZE_Y;
+    if (fb->format == PIXFORMAT_GRAYSCALE)
+    {
+        // Binned and scaled by the sensor, so there is nothing to decode
+        if (!reduce_grayscale(fb, buf))
+            return;
+    }
+    else if (!decode_luma(fb, buf, width, height))
+        return;
+
+    // Average each active cell, in place: cell i is written at or before
+    // the first byte of the cells that are read after it.
+    // Cells outside a smaller image are cleared.
+    const int rows = height/cell_y;
+    const int columns = width/cell_x;
+    const int cell_pixels = cell_x * cell_y;
+    const bool power_of_two = !(cell_pixels & (cell_pixels - 1));
+    const int shift = __builtin_ctz(cell_pixels);
+    for (int gy = 0; gy < grid_height; ++gy)
+    {
+        const uint8_t* row = buf + gy * cell_y * BUFSIZE_X;
+        const uint8_t* active = cell_active.data() + gy * grid_width;
+        uint8_t* p = buf + gy * grid_width;
+        for (int gx = 0; gx < grid_width; ++gx, row += cell_x)
+        {
+            if (!active[gx])
+                continue;
+            if (gy >= rows || gx >= columns)
+            {
+                p[gx] = 0;
+                continue;
+            }
+            int sum = 0;
+            const uint8_t* src = row;
+            for (int y = 0; y < cell_y; ++y, src += BUFSIZE_X)
+                for (int x = 0; x < cell_x; ++x)
+                    sum += src[x];
+            p[gx] = power_of_two ? sum >> shift : sum/cell_pixels;
+        }
+    }
 }
 
-bool motion_detect(const camera_fb_t* fb, const struct tm& cur_tm)
+bool motion_detect(const camera_fb_t* fb)
 {
     if (!config_continuous)
     {
-        const auto old_buf = current_buf ? buf1 : buf2;
-        auto new_buf = current_buf ? buf2 : buf1;
-        current_buf = !current_buf;
-
-        downsample(fb, new_buf);
+        {
+            Stage_timer timer(Stage::decode);
+            downsample(fb, buf);
+        }
         if (first_time)
         {
-            // First time: Save reference image and return false
+            // First time: Start the background model and return false
             first_time = false;
+            background.reset(buf, grid_width * grid_height);
             ESP_LOGI(TAG, "Saved reference image");
             return false;
         }
+        if (!total_weight)
+            return false;
 
-        int changes = 0;
-        for (int i = 0; i < sizeof(buf1); ++i)
-        {
-            const auto diff = abs(static_cast<int>(new_buf[i]) - static_cast<int>(old_buf[i]));
-            if (diff > config_pixel_threshold)
-                ++changes;
-        }
-        printf("%d changes\n", changes);
-        if ((changes*100)/BUFFER_BYTESIZE < config_percent_threshold)
+        Stage_timer timer(Stage::diff);
+        const auto changes = background.update(buf, active_runs.data(), active_runs.size(),
+                                               cell_weights.empty() ? nullptr : cell_weights.data(),
+                                               config_pixel_threshold, config_noise_sigmas,
+                                               config_background_shift);
+        printf("%u changes\n", (unsigned) changes);
+        if ((changes*100)/total_weight < static_cast<uint32_t>(config_percent_threshold))
             return false;
     }
-    upload(fb, cur_tm);
 
     return true;
 }
@@ -1,8 +1,34 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "esp_camera.h"
 
-/// Return true if changes are found
-bool motion_detect(const camera_fb_t* fb, const struct tm& cur_tm);
+struct motion_grid_info
+{
+    int cell_x;         ///< Cell width in 8x8 pixel blocks
+    int cell_y;         ///< Cell height in 8x8 pixel blocks
+    int width;          ///< Cells per row
+    int height;         ///< Rows of cells
+    int active_cells;   ///< Cells not masked
+};
+
+/// Set the motion grid to cells of cell_x by cell_y blocks of 8x8 pixels.
+/// mask has one bit per cell (row major, LSB first, set = ignore the cell);
+/// weights has one byte per cell, giving how much a change in the cell counts.
+/// Either may be null. Return false, leaving the grid unchanged, if the
+/// parameters do not fit the frame size.
+bool motion_set_grid(int cell_x, int cell_y,
+                     const uint8_t* mask, size_t mask_size,
+                     const uint8_t* weights, size_t weights_size);
+
+motion_grid_info motion_get_grid();
+
+/// Time the JPEG decoders on a frame like the ones motion will see, and
+/// select the fastest for each output small enough to be measured in the
+/// room of motion's largest image, which covers the luma motion decodes
+void motion_calibrate_decoder(const camera_fb_t* fb);
+
+/// Return true if changes are found (always true in continuous mode)
+bool motion_detect(const camera_fb_t* fb);
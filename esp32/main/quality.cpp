@@ -0,0 +1,79 @@
+#include "quality.h"
+
+/// Each frame has weight 1/2^AVERAGE_SHIFT in the running average
+static constexpr const int AVERAGE_SHIFT = 2;
+
+/// Frames averaged before the quality may change, so one odd frame right
+/// after a change cannot cause another
+static constexpr const int MIN_SAMPLES = 1 << AVERAGE_SHIFT;
+
+/// Sizes within 1/DEAD_BAND of the target leave the quality alone
+static constexpr const int DEAD_BAND = 8;
+
+Quality_controller::Quality_controller(int quality, int min_quality, int max_quality, int settle_frames)
+    : quality(quality),
+      initial_quality(quality),
+      min_quality(min_quality),
+      max_quality(max_quality),
+      settle_frames(settle_frames)
+{
+}
+
+int Quality_controller::update(size_t frame_size, size_t target_size)
+{
+    if (skip > 0)
+    {
+        // Captured before the last change
+        --skip;
+        return quality;
+    }
+    if (!average)
+        average = frame_size;
+    else if (frame_size >= average)
+        average += (frame_size - average) >> AVERAGE_SHIFT;
+    else
+        average -= (average - frame_size) >> AVERAGE_SHIFT;
+    if (samples < MIN_SAMPLES)
+        ++samples;
+    if (!target_size)
+    {
+        if (quality != initial_quality)
+            set_quality(initial_quality);
+        return quality;
+    }
+    if (samples < MIN_SAMPLES)
+        return quality;
+
+    const size_t band = target_size/DEAD_BAND;
+    if (average <= target_size + band && average + band >= target_size)
+        return quality;
+    const int wanted = static_cast<int>((static_cast<unsigned long long>(quality)*average + target_size/2)/target_size);
+    int next = quality + (wanted - quality)/2;
+    if (next == quality)
+        next += average > target_size ? 1 : -1;
+    if (next < min_quality)
+        next = min_quality;
+    if (next > max_quality)
+        next = max_quality;
+    if (next != quality)
+        set_quality(next);
+    return quality;
+}
+
+void Quality_controller::set_quality(int new_quality)
+{
+    quality = new_quality;
+    skip = settle_frames;
+    average = 0;
+    samples = 0;
+}
+
+int Quality_controller::get_quality() const
+{
+    return quality;
+}
+
+size_t Quality_controller::get_average() const
+{
+    return average;
+}
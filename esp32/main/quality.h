@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+
+/// Steers the JPEG quality setting toward a target frame size.
+///
+/// The size of an OV2640 JPEG is roughly inversely proportional to its
+/// quality value (lower is better quality), so when the average size is
+/// outside a dead band around the target, the quality moves halfway toward
+/// the value that would have hit it. After a change the frames already in
+/// the pipeline are skipped, and the average starts over; it must cover a
+/// few frames before the quality changes again.
+class Quality_controller
+{
+public:
+    Quality_controller(int quality, int min_quality, int max_quality, int settle_frames);
+
+    /// Record the size of a frame and return the quality for the following
+    /// frames. A target of 0 goes back to the quality given at construction.
+    int update(size_t frame_size, size_t target_size);
+
+    int get_quality() const;
+
+    /// Running average of frame sizes since the last change, 0 if none yet
+    size_t get_average() const;
+
+private:
+    int quality;
+    const int initial_quality;
+    const int min_quality;
+    const int max_quality;
+    const int settle_frames;
+    void set_quality(int new_quality);
+
+    int skip = 0;
+    size_t average = 0;
+    int samples = 0;        ///< Frames in the average, up to MIN_SAMPLES
+};
@@ -0,0 +1,124 @@
+#include "resolution.h"
+#include "stagetiming.h"
+
+bool jpeg_get_dimensions(const uint8_t* data, size_t len, int& width, int& height)
+{
+    if (len < 4 || data[0] != 0xFF || data[1] != 0xD8)
+        return false;
+    size_t pos = 2;
+    while (pos + 4 <= len)
+    {
+        if (data[pos] != 0xFF)
+            return false;
+        const uint8_t marker = data[pos + 1];
+        if (marker == 0xFF)
+        {
+            // Fill byte
+            ++pos;
+            continue;
+        }
+        const size_t segment = (data[pos + 2] << 8) | data[pos + 3];
+        // Any SOF except DHT (C4), JPG (C8) and DAC (CC)
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+        {
+            if (segment < 7 || pos + 9 > len)
+                return false;
+            height = (data[pos + 5] << 8) | data[pos + 6];
+            width = (data[pos + 7] << 8) | data[pos + 8];
+            return true;
+        }
+        if (marker == 0xDA || marker == 0xD9)
+            return false;   // Start of scan or end of image, no SOF
+        pos += 2 + segment;
+    }
+    return false;
+}
+
+Resolution_switch::Resolution_switch(framesize_t framesize, int max_settle_frames)
+    : framesize(framesize),
+      max_settle_frames(max_settle_frames)
+{
+}
+
+framesize_t Resolution_switch::get_framesize() const
+{
+    return framesize;
+}
+
+void Resolution_switch::start(framesize_t new_framesize, int64_t now_us)
+{
+    framesize = new_framesize;
+    format = PIXFORMAT_JPEG;
+    settling = true;
+    start_us = now_us;
+    settle_frames = 0;
+}
+
+void Resolution_switch::start_raw(pixformat_t new_format, int width, int height, int64_t now_us)
+{
+    format = new_format;
+    raw_width = width;
+    raw_height = height;
+    settling = true;
+    start_us = now_us;
+    settle_frames = 0;
+}
+
+bool Resolution_switch::is_raw() const
+{
+    return format != PIXFORMAT_JPEG;
+}
+
+bool Resolution_switch::is_settling() const
+{
+    return settling;
+}
+
+bool Resolution_switch::check_frame(const camera_fb_t* fb, int64_t now_us)
+{
+    if (!settling)
+        return true;
+    bool done;
+    if (format == PIXFORMAT_JPEG)
+    {
+        int width = 0;
+        int height = 0;
+        done = fb->format == PIXFORMAT_JPEG &&
+            jpeg_get_dimensions(fb->buf, fb->len, width, height) &&
+            width == resolution[framesize].width && height == resolution[framesize].height;
+    }
+    else
+        done = fb->format == format && fb->width == static_cast<size_t>(raw_width) &&
+            fb->height == static_cast<size_t>(raw_height);
+    if (done)
+    {
+        finish(now_us);
+        return true;
+    }
+    if (++settle_frames >= max_settle_frames)
+    {
+        // Given up on: not a switch, and no latency to record
+        ++stats.timeouts;
+        settling = false;
+    }
+    return false;
+}
+
+void Resolution_switch::finish(int64_t now_us)
+{
+    settling = false;
+    const uint32_t us = now_us - start_us;
+    ++stats.switches;
+    stats.last_us = us;
+    if (us > stats.max_us)
+        stats.max_us = us;
+    stats.last_settle_frames = settle_frames;
+    if (settle_frames > stats.max_settle_frames)
+        stats.max_settle_frames = settle_frames;
+    stage_record(Stage::framesize, us);
+}
+
+resolution_switch_stats Resolution_switch::get_stats() const
+{
+    return stats;
+}
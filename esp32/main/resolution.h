@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_camera.h"
+
+struct resolution_switch_stats
+{
+    uint32_t switches;          ///< Switches completed
+    uint32_t timeouts;          ///< Switches given up on after too many frames, not in the others
+    uint32_t last_us;           ///< From the switch to the first frame of the new size
+    uint32_t max_us;
+    int last_settle_frames;     ///< Frames of the old size dropped after the last completed switch
+    int max_settle_frames;
+};
+
+/// Return the dimensions from the SOF header of a JPEG, or false if there is none
+bool jpeg_get_dimensions(const uint8_t* data, size_t len, int& width, int& height);
+
+/// Tracks switches of the sensor framesize. The frames already captured
+/// when the sensor is switched still have the old size, and the driver
+/// labels them with the new one, so each frame is checked against its
+/// JPEG header until one of the new size arrives. Switches to raw frames
+/// wait for the first frame of the raw format and size.
+class Resolution_switch
+{
+public:
+    /// max_settle_frames frames of the wrong size end the switch anyway
+    Resolution_switch(framesize_t framesize, int max_settle_frames);
+
+    framesize_t get_framesize() const;
+
+    /// Record that the sensor has been told to switch to JPEG frames of framesize
+    void start(framesize_t framesize, int64_t now_us);
+
+    /// Record that the sensor has been told to switch to raw frames of width x height
+    void start_raw(pixformat_t format, int width, int height, int64_t now_us);
+
+    /// True if raw frames were asked for last
+    bool is_raw() const;
+
+    /// True from start() until a frame of the new size has arrived
+    bool is_settling() const;
+
+    /// Return true if the frame has the current size. Frames from before a
+    /// switch return false and should be dropped.
+    bool check_frame(const camera_fb_t* fb, int64_t now_us);
+
+    resolution_switch_stats get_stats() const;
+
+private:
+    void finish(int64_t now_us);
+
+    framesize_t framesize;
+    pixformat_t format = PIXFORMAT_JPEG;
+    int raw_width = 0;
+    int raw_height = 0;
+    const int max_settle_frames;
+    bool settling = false;
+    int64_t start_us = 0;
+    int settle_frames = 0;
+    resolution_switch_stats stats = {};
+};
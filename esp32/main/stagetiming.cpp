@@ -0,0 +1,51 @@
+#include "stagetiming.h"
+
+#include <atomic>
+
+#include "esp_timer.h"
+
+static Histogram histograms[static_cast<int>(Stage::count)];
+static std::atomic<uint32_t> last_us[static_cast<int>(Stage::count)];
+
+void stage_record(Stage stage, uint32_t us)
+{
+    histograms[static_cast<int>(stage)].add(us);
+    last_us[static_cast<int>(stage)] = us;
+}
+
+stage_stats stage_get_stats(Stage stage)
+{
+    const auto h = stage_get_histogram(stage);
+    stage_stats stats;
+    stats.count = h.count;
+    stats.last_us = last_us[static_cast<int>(stage)];
+    stats.max_us = h.max;
+    stats.total_us = h.total;
+    return stats;
+}
+
+histogram_stats stage_get_histogram(Stage stage)
+{
+    return histograms[static_cast<int>(stage)].get_stats();
+}
+
+uint32_t stage_get_average_us(Stage stage)
+{
+    return histogram_average(stage_get_histogram(stage));
+}
+
+uint32_t stage_get_percentile_us(Stage stage, int percent)
+{
+    return histogram_percentile(stage_get_histogram(stage), percent);
+}
+
+Stage_timer::Stage_timer(Stage _stage)
+    : stage(_stage),
+      start_us(esp_timer_get_time())
+{
+}
+
+Stage_timer::~Stage_timer()
+{
+    stage_record(stage, esp_timer_get_time() - start_us);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "histogram.h"
+
+/// Steps each frame goes through
+enum class Stage
+{
+    capture,    ///< Waiting for esp_camera_fb_get()
+    store,      ///< Copying into the frame ring
+    decode,     ///< JPEG decode and reduction to the motion grid
+    diff,       ///< Comparison with the background model
+    upload,     ///< One PUT, frame or burst
+    frame,      ///< Whole camera loop iteration
+    framesize,  ///< Sensor framesize switch until the first frame of the new size
+    count
+};
+
+struct stage_stats
+{
+    uint32_t count;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint64_t total_us;
+};
+
+void stage_record(Stage stage, uint32_t us);
+
+stage_stats stage_get_stats(Stage stage);
+
+/// Distribution of times in microseconds
+histogram_stats stage_get_histogram(Stage stage);
+
+/// Average time in microseconds, 0 if never recorded
+uint32_t stage_get_average_us(Stage stage);
+
+/// Upper bound of the given percentile in microseconds, 0 if never recorded
+uint32_t stage_get_percentile_us(Stage stage, int percent);
+
+/// Records the time from construction to destruction
+class Stage_timer
+{
+public:
+    explicit Stage_timer(Stage stage);
+
+    ~Stage_timer();
+
+private:
+    Stage stage;
+    int64_t start_us;
+};
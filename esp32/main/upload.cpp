@@ -1,83 +1,225 @@
+#include "burst.h"
 #include "defs.h"
-#include "eventhandler.h"
+#include "framequeue.h"
+#include "framering.h"
+#include "stagetiming.h"
 #include "upload.h"
+#include "uploadclient.h"
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+#include <mutex>
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_system.h"
-#include "esp_event.h"
-#include "esp_netif.h"
-#include "esp_tls.h"
 
-#include "mbedtls/base64.h"
-#include "mbedtls/md.h"
 
+static Upload_client* client = nullptr;
 
-void upload(const unsigned char* data, size_t size,
-            const struct tm& current,
-            const char* ext)
+// Copy of the client's stats after each PUT, for other tasks
+static std::mutex stats_mutex;
+static upload_client_stats client_stats = {};
+
+static void put_object(const char* resource,
+                       const upload_segment* segments, size_t count,
+                       const struct tm& current,
+                       const char* content_type,
+                       const upload_header* headers = nullptr, size_t header_count = 0)
 {
-    char ts[20];
-    strftime(ts, sizeof(ts), "%Y%m%d%H%M%S", &current);
-    char resource[40];
-    sprintf(resource, "/hal9kcam/%d-%s.%s", (int) config_instance_number, ts, ext);
-    
-    esp_http_client_config_t config {
-        .host = "minio.hal9k.dk",
-        .path = resource,
-        .event_handler = http_event_handler,
-        .transport_type = HTTP_TRANSPORT_OVER_SSL,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-
-    esp_http_client_set_method(client, HTTP_METHOD_PUT);
-
-    esp_http_client_set_post_field(client, reinterpret_cast<const char*>(data), size);
-
-    char date[40];
-    strftime(date, sizeof(date), "%a, %d %b %Y %T %z", &current);
-    esp_http_client_set_header(client, "Date", date);
-    const char* content_type = "application/octet-stream";
-    esp_http_client_set_header(client, "Content-Type", content_type);
-    char signature[128];
-    snprintf(signature, sizeof(signature), "PUT\n\n%s\n%s\n%s", content_type, date, resource);
-    const char* secret = config_s3_secret_key;
-    const mbedtls_md_info_t* md_info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA1);
-    unsigned char hmac[20]; // SHA1 HMAC is always 20 bytes
-    mbedtls_md_hmac(md_info, (unsigned char*) secret, strlen(secret),
-                    (unsigned char*) signature, strlen(signature), hmac);
-    unsigned char b64hmac[29]; // 20 binary bytes -> 28 Base64 characters
-    b64hmac[28] = 0;
-    size_t written = 0;
-    mbedtls_base64_encode(b64hmac, sizeof(b64hmac), &written, hmac, sizeof(hmac));
-    char auth[80];
-    sprintf(auth, "AWS %s:%s", config_s3_access_key, b64hmac);
-    esp_http_client_set_header(client, "Authorization", auth);
-    esp_err_t err = esp_http_client_perform(client);
+    if (!client)
+        client = new Upload_client(S3_HOST, S3_PORT, HTTP_TRANSPORT_OVER_SSL,
+                                   config_s3_access_key, config_s3_secret_key);
+    esp_err_t err;
+    {
+        Stage_timer timer(Stage::upload);
+        err = client->put(resource, segments, count, current, content_type, headers, header_count);
+    }
 
+    const auto& stats = client->get_stats();
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        client_stats = stats;
+    }
     if (err == ESP_OK)
     {
-        ESP_LOGI(TAG, "Uploaded %s, HTTPS Status = %d",
+        ESP_LOGI(TAG, "Uploaded %s, HTTPS Status = %d (%u connections, %u reused)",
                  resource,
-                 esp_http_client_get_status_code(client));
+                 client->get_status_code(),
+                 (unsigned) stats.connections,
+                 (unsigned) stats.reused);
     }
     else
-        ESP_LOGE(TAG, "Error performing http request %s", esp_err_to_name(err));
-    
-    esp_http_client_cleanup(client);
+        ESP_LOGE(TAG, "Error uploading %s: %s, HTTPS Status = %d",
+                 resource, esp_err_to_name(err), client->get_status_code());
+}
+
+void upload(const upload_segment* segments, size_t count,
+            const struct tm& current,
+            const char* ext)
+{
+    char ts[20];
+    strftime(ts, sizeof(ts), "%Y%m%d%H%M%S", &current);
+    char resource[40];
+    snprintf(resource, sizeof(resource), "/hal9kcam/%d-%s.%s", (int) config_instance_number, ts, ext);
+    put_object(resource, segments, count, current, "application/octet-stream");
+}
+
+void upload(const upload_segment* segments, size_t count,
+            int64_t time_ms,
+            const char* ext,
+            const char* content_type,
+            const upload_header* headers, size_t header_count)
+{
+    const time_t secs = time_ms/1000;
+    struct tm current;
+    gmtime_r(&secs, &current);
+    char ts[20];
+    strftime(ts, sizeof(ts), "%Y%m%d%H%M%S", &current);
+    char resource[48];
+    snprintf(resource, sizeof(resource), "/hal9kcam/%d-%s%03d.%s",
+             (int) config_instance_number, ts, (int) (time_ms % 1000), ext);
+    put_object(resource, segments, count, current, content_type, headers, header_count);
+}
+
+void upload(const unsigned char* data, size_t size,
+            const struct tm& current,
+            const char* ext)
+{
+    const upload_segment segment = { data, size };
+    upload(&segment, 1, current, ext);
+}
+
+upload_client_stats upload_get_client_stats()
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    return client_stats;
+}
+
+static const char* get_extension(pixformat_t format)
+{
+    if (format == PIXFORMAT_JPEG)
+        return "jpg";
+    return "cam";
 }
 
 void upload(const camera_fb_t* fb, const struct tm& current)
 {
     // Picture
     
-    const char* ext = "cam";
-    if (fb->format == PIXFORMAT_JPEG)
-        ext = "jpg";
-    upload(fb->buf, fb->len, current, ext);
+    upload(fb->buf, fb->len, current, get_extension(fb->format));
+}
+
+/// Camera metadata of a frame as S3 object metadata
+class Frame_metadata
+{
+public:
+    explicit Frame_metadata(const ring_frame& frame)
+    {
+        const uint32_t values[] = {
+            frame.camera_seq, frame.capture_us, frame.half_buffers, frame.aec, frame.agc
+        };
+        static const char* const names[] = {
+            "x-amz-meta-seq", "x-amz-meta-capture-us", "x-amz-meta-half-buffers",
+            "x-amz-meta-aec", "x-amz-meta-agc"
+        };
+        for (size_t i = 0; i < COUNT; ++i)
+        {
+            snprintf(text[i], sizeof(text[i]), "%u", (unsigned) values[i]);
+            headers[i] = { names[i], text[i] };
+        }
+    }
+
+    static constexpr const size_t COUNT = 5;
+
+    upload_header headers[COUNT];
+
+private:
+    char text[COUNT][12];
+};
+
+static void upload_frame(Frame_ring* ring, uint32_t seq)
+{
+    ring_frame frame;
+    upload_segment segments[2];
+    size_t count;
+    if (!ring->get(seq, frame, segments, count))
+        return;
+    const Frame_metadata metadata(frame);
+    upload(segments, count, frame.time_ms, get_extension(frame.format),
+           "application/octet-stream", metadata.headers, Frame_metadata::COUNT);
+}
+
+/// Upload the frames as one object, named after the first frame. Each part
+/// carries its frame's camera metadata; the object has the first frame's
+/// sequence number and the number of frames.
+static void upload_burst(Frame_ring* ring, const uint32_t* seqs, size_t count)
+{
+    static Burst burst;
+    burst.clear();
+    int64_t time_ms = 0;
+    uint32_t first_seq = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        ring_frame frame;
+        upload_segment segments[2];
+        size_t segment_count;
+        if (!ring->get(seqs[i], frame, segments, segment_count))
+            continue;
+        if (!burst.get_frame_count())
+        {
+            time_ms = frame.time_ms;
+            first_seq = frame.camera_seq;
+        }
+        char part_headers[128];
+        snprintf(part_headers, sizeof(part_headers),
+                 "X-Seq: %u\r\nX-Capture-Us: %u\r\nX-Half-Buffers: %u\r\nX-AEC: %u\r\nX-AGC: %u\r\n",
+                 (unsigned) frame.camera_seq, (unsigned) frame.capture_us,
+                 (unsigned) frame.half_buffers, (unsigned) frame.aec, (unsigned) frame.agc);
+        burst.add(segments, segment_count, frame.time_ms, "image/jpeg", part_headers);
+    }
+    if (!burst.get_frame_count())
+        return;
+    char seq_text[12];
+    char frames_text[12];
+    snprintf(seq_text, sizeof(seq_text), "%u", (unsigned) first_seq);
+    snprintf(frames_text, sizeof(frames_text), "%u", (unsigned) burst.get_frame_count());
+    const upload_header headers[] = {
+        { "x-amz-meta-seq", seq_text },
+        { "x-amz-meta-frames", frames_text },
+    };
+    size_t segment_count;
+    auto segments = burst.get_segments(segment_count);
+    upload(segments, segment_count, time_ms, "mjpeg", BURST_CONTENT_TYPE,
+           headers, sizeof(headers)/sizeof(headers[0]));
+}
+
+void upload_task(void* arg)
+{
+    auto ring = static_cast<Frame_ring*>(arg);
+    while (1)
+    {
+        queued_frame frame;
+        if (!frame_queue_pop(frame, portMAX_DELAY))
+            continue;
+        if (!config_burst_upload)
+        {
+            upload_frame(ring, frame.seq);
+            frame_queue_release(frame.seq);
+            continue;
+        }
+        // Collect the rest of the motion event
+        uint32_t seqs[BURST_MAX_FRAMES];
+        size_t count = 0;
+        seqs[count++] = frame.seq;
+        while (!frame.burst_end && count < BURST_MAX_FRAMES &&
+               frame_queue_pop(frame, BURST_WAIT_MS/portTICK_PERIOD_MS))
+            seqs[count++] = frame.seq;
+        upload_burst(ring, seqs, count);
+        for (size_t i = 0; i < count; ++i)
+            frame_queue_release(seqs[i]);
+    }
 }
@@ -1,8 +1,35 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "esp_camera.h"
 
+#include "uploadclient.h"
+
+void upload(const unsigned char* data, size_t size,
+            const struct tm& current,
+            const char* ext);
+
+/// Upload the segments as one object, written in UPLOAD_CHUNK_SIZE pieces
+void upload(const upload_segment* segments, size_t count,
+            const struct tm& current,
+            const char* ext);
+
+/// As above, named after time_ms (ms since the epoch) to millisecond precision,
+/// with optional S3 metadata headers
+void upload(const upload_segment* segments, size_t count,
+            int64_t time_ms,
+            const char* ext,
+            const char* content_type = "application/octet-stream",
+            const upload_header* headers = nullptr, size_t header_count = 0);
+
 void upload(const camera_fb_t* fb,
             const struct tm& current);
+
+/// Stats of the S3 client as of the last PUT; safe to call from any task
+upload_client_stats upload_get_client_stats();
+
+/// Uploads frames from the frame queue, either singly or one object per
+/// motion event (see config_burst_upload). arg is the Frame_ring holding them.
+void upload_task(void* arg);
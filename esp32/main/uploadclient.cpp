@@ -0,0 +1,233 @@
+#include "defs.h"
+#include "eventhandler.h"
+#include "uploadclient.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "mbedtls/base64.h"
+#include "mbedtls/md.h"
+
+Upload_client::Upload_client(const char* host, int port,
+                             esp_http_client_transport_t transport,
+                             const char* _access_key, const char* _secret_key)
+    : access_key(_access_key),
+      secret_key(_secret_key)
+{
+    esp_http_client_config_t config {
+        .host = host,
+        .port = port,
+        .path = "/",
+        .event_handler = event_handler,
+        .transport_type = transport,
+        .user_data = this,
+        .crt_bundle_attach = transport == HTTP_TRANSPORT_OVER_SSL ? esp_crt_bundle_attach : nullptr,
+        .keep_alive_enable = true,
+    };
+    client = esp_http_client_init(&config);
+}
+
+Upload_client::~Upload_client()
+{
+    esp_http_client_cleanup(client);
+}
+
+esp_err_t Upload_client::event_handler(esp_http_client_event_t* evt)
+{
+    auto self = reinterpret_cast<Upload_client*>(evt->user_data);
+    switch (evt->event_id)
+    {
+    case HTTP_EVENT_ON_CONNECTED:
+        {
+            // Posted once the TCP connection and TLS handshake are done
+            const auto ms = static_cast<uint32_t>((esp_timer_get_time() - self->request_start_us)/1000);
+            self->connected_in_request = true;
+            self->connection_open = true;
+            ++self->stats.connections;
+            self->stats.last_handshake_ms = ms;
+            self->stats.total_handshake_ms += ms;
+            if (ms > self->stats.max_handshake_ms)
+                self->stats.max_handshake_ms = ms;
+            ESP_LOGI(TAG, "Upload connection opened in %u ms", (unsigned) ms);
+        }
+        return ESP_OK;
+
+    case HTTP_EVENT_ON_HEADER:
+        if (!strcasecmp(evt->header_key, "Connection") && !strcasecmp(evt->header_value, "close"))
+            self->server_closing = true;
+        return ESP_OK;
+
+    case HTTP_EVENT_ON_DATA:
+        // Response body is not used
+        return ESP_OK;
+
+    case HTTP_EVENT_DISCONNECTED:
+        self->connection_open = false;
+        evt->user_data = nullptr;
+        return http_event_handler(evt);
+
+    default:
+        // user_data is not a response buffer, so don't pass it on
+        evt->user_data = nullptr;
+        return http_event_handler(evt);
+    }
+}
+
+/// Maximum number of headers passed to put()
+constexpr const size_t MAX_UPLOAD_HEADERS = 8;
+
+static void make_authorization(char* auth, size_t auth_size,
+                               const char* method,
+                               const char* content_type,
+                               const char* date,
+                               const upload_header* headers, size_t header_count,
+                               const char* resource,
+                               const char* access_key,
+                               const char* secret_key)
+{
+    // x-amz-* headers are signed as "name:value\n", sorted by name
+    const upload_header* amz[MAX_UPLOAD_HEADERS];
+    size_t amz_count = 0;
+    for (size_t i = 0; i < header_count && amz_count < MAX_UPLOAD_HEADERS; ++i)
+    {
+        if (strncmp(headers[i].name, "x-amz-", 6))
+            continue;
+        size_t j = amz_count++;
+        for (; j > 0 && strcmp(amz[j - 1]->name, headers[i].name) > 0; --j)
+            amz[j] = amz[j - 1];
+        amz[j] = &headers[i];
+    }
+    char signature[512];
+    int len = snprintf(signature, sizeof(signature), "%s\n\n%s\n%s\n", method, content_type, date);
+    for (size_t i = 0; i < amz_count && len < (int) sizeof(signature); ++i)
+        len += snprintf(signature + len, sizeof(signature) - len, "%s:%s\n", amz[i]->name, amz[i]->value);
+    if (len < (int) sizeof(signature))
+        snprintf(signature + len, sizeof(signature) - len, "%s", resource);
+    const mbedtls_md_info_t* md_info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA1);
+    unsigned char hmac[20]; // SHA1 HMAC is always 20 bytes
+    mbedtls_md_hmac(md_info, (const unsigned char*) secret_key, strlen(secret_key),
+                    (const unsigned char*) signature, strlen(signature), hmac);
+    unsigned char b64hmac[29]; // 20 binary bytes -> 28 Base64 characters
+    b64hmac[28] = 0;
+    size_t written = 0;
+    mbedtls_base64_encode(b64hmac, sizeof(b64hmac), &written, hmac, sizeof(hmac));
+    snprintf(auth, auth_size, "AWS %s:%s", access_key, b64hmac);
+}
+
+esp_err_t Upload_client::try_put(const char* resource,
+                                 const upload_segment* segments, size_t count,
+                                 const struct tm& date,
+                                 const char* content_type,
+                                 const upload_header* headers, size_t header_count)
+{
+    esp_http_client_set_url(client, resource);
+    esp_http_client_set_method(client, HTTP_METHOD_PUT);
+
+    char date_str[40];
+    strftime(date_str, sizeof(date_str), "%a, %d %b %Y %T %z", &date);
+    esp_http_client_set_header(client, "Date", date_str);
+    esp_http_client_set_header(client, "Content-Type", content_type);
+    for (size_t i = 0; i < header_count; ++i)
+        esp_http_client_set_header(client, headers[i].name, headers[i].value);
+    char auth[80];
+    make_authorization(auth, sizeof(auth), "PUT", content_type, date_str,
+                       headers, header_count, resource,
+                       access_key, secret_key);
+    esp_http_client_set_header(client, "Authorization", auth);
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+        total += segments[i].size;
+
+    request_start_us = esp_timer_get_time();
+    connected_in_request = false;
+    server_closing = false;
+    status_code = 0;
+    auto err = esp_http_client_open(client, total);
+    if (err != ESP_OK)
+        return err;
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto p = reinterpret_cast<const char*>(segments[i].data);
+        size_t remaining = segments[i].size;
+        while (remaining)
+        {
+            const auto chunk = remaining < UPLOAD_CHUNK_SIZE ? remaining : UPLOAD_CHUNK_SIZE;
+            if (esp_http_client_write(client, p, chunk) != static_cast<int>(chunk))
+                return ESP_ERR_HTTP_WRITE_DATA;
+            p += chunk;
+            remaining -= chunk;
+        }
+    }
+    if (esp_http_client_fetch_headers(client) < 0)
+        return ESP_ERR_HTTP_FETCH_HEADER;
+    status_code = esp_http_client_get_status_code(client);
+    // Consume the response body so the connection can be reused
+    char buf[128];
+    while (esp_http_client_read(client, buf, sizeof(buf)) > 0)
+        ;
+    if (server_closing)
+        esp_http_client_close(client);
+    return ESP_OK;
+}
+
+esp_err_t Upload_client::put(const char* resource,
+                             const unsigned char* data, size_t size,
+                             const struct tm& date,
+                             const char* content_type)
+{
+    const upload_segment segment = { data, size };
+    return put(resource, &segment, 1, date, content_type);
+}
+
+esp_err_t Upload_client::put(const char* resource,
+                             const upload_segment* segments, size_t count,
+                             const struct tm& date,
+                             const char* content_type,
+                             const upload_header* headers, size_t header_count)
+{
+    if (header_count > MAX_UPLOAD_HEADERS)
+        return ESP_ERR_INVALID_ARG;
+    const bool reusing = connection_open;
+    auto err = try_put(resource, segments, count, date, content_type, headers, header_count);
+    if (err != ESP_OK && reusing && !connected_in_request)
+    {
+        // The server closed the connection we were reusing: reconnect and retry once
+        ESP_LOGI(TAG, "Reused connection failed (%s), reconnecting", esp_err_to_name(err));
+        esp_http_client_close(client);
+        ++stats.reconnects;
+        err = try_put(resource, segments, count, date, content_type, headers, header_count);
+    }
+    // Headers persist in the client, so don't send them with the next object
+    for (size_t i = 0; i < header_count; ++i)
+        esp_http_client_delete_header(client, headers[i].name);
+    if (err != ESP_OK)
+    {
+        esp_http_client_close(client);
+        ++stats.failures;
+        return err;
+    }
+    if (!connected_in_request)
+        ++stats.reused;
+    if (status_code < 200 || status_code >= 300)
+    {
+        ++stats.failures;
+        return ESP_FAIL;
+    }
+    ++stats.requests;
+    return ESP_OK;
+}
+
+int Upload_client::get_status_code() const
+{
+    return status_code;
+}
+
+const upload_client_stats& Upload_client::get_stats() const
+{
+    return stats;
+}
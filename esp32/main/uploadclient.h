@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "esp_http_client.h"
+
+/// Size of each write to the connection
+constexpr const size_t UPLOAD_CHUNK_SIZE = 4096;
+
+/// One contiguous piece of an object. An object may be made up of
+/// several segments, e.g. slices of a ring buffer.
+struct upload_segment
+{
+    const unsigned char* data;
+    size_t size;
+};
+
+/// Extra request header, e.g. S3 object metadata. Names of x-amz-*
+/// headers must be lower case, as they are signed with the request.
+struct upload_header
+{
+    const char* name;
+    const char* value;
+};
+
+struct upload_client_stats
+{
+    uint32_t requests;          ///< Successful PUTs (HTTP 2xx)
+    uint32_t failures;          ///< PUTs that failed after retrying, or got another status
+    uint32_t connections;       ///< Connections (TLS handshakes) made
+    uint32_t reused;            ///< PUTs sent on an already open connection
+    uint32_t reconnects;        ///< Retries after the server closed a reused connection
+    uint32_t last_handshake_ms;
+    uint32_t max_handshake_ms;
+    uint32_t total_handshake_ms;
+};
+
+/// S3 client which keeps its connection open across PUTs
+class Upload_client
+{
+public:
+    Upload_client(const char* host, int port,
+                  esp_http_client_transport_t transport,
+                  const char* access_key, const char* secret_key);
+
+    ~Upload_client();
+
+    /// Return ESP_OK if the server accepted the object (HTTP 2xx)
+    esp_err_t put(const char* resource,
+                  const unsigned char* data, size_t size,
+                  const struct tm& date,
+                  const char* content_type = "application/octet-stream");
+
+    /// Upload the concatenation of the segments, streamed in UPLOAD_CHUNK_SIZE writes.
+    /// The headers are sent with this request only.
+    esp_err_t put(const char* resource,
+                  const upload_segment* segments, size_t count,
+                  const struct tm& date,
+                  const char* content_type = "application/octet-stream",
+                  const upload_header* headers = nullptr, size_t header_count = 0);
+
+    /// Status code of the last response
+    int get_status_code() const;
+
+    const upload_client_stats& get_stats() const;
+
+private:
+    static esp_err_t event_handler(esp_http_client_event_t* evt);
+
+    esp_err_t try_put(const char* resource,
+                      const upload_segment* segments, size_t count,
+                      const struct tm& date,
+                      const char* content_type,
+                      const upload_header* headers, size_t header_count);
+
+    esp_http_client_handle_t client = nullptr;
+    const char* access_key;
+    const char* secret_key;
+    upload_client_stats stats = {};
+    int64_t request_start_us = 0;
+    bool connected_in_request = false;
+    bool connection_open = false;
+    bool server_closing = false;
+    int status_code = 0;
+};